@@ -0,0 +1,475 @@
+// Microbenchmarks of the Forward and Backward passes of every layer and loss.
+//
+// Usage:
+//   ./afs_bench [--filter <substring>] [--min_time <seconds>]
+//               [--threads <n,n,...>] [--batch_sizes <n,n,...>]
+//               [--output <file.json>]
+//
+// Every case (layer, phase, shape) runs for each batch size and OpenMP
+// thread count. An operation is one batch, i.e. one layer call per sample,
+// and is repeated for at least min_time seconds (0.2 by default). Results
+// are written as JSON, to stdout by default:
+//
+//   {"context": {...},
+//    "benchmarks": [{"name": "Conv2D/forward/28x28x1-5x5x6", "layer": ...,
+//                    "phase": ..., "shape": ..., "batch_size": 32,
+//                    "threads": 4, "iterations": 120, "ns_per_op": ...,
+//                    "ns_per_sample": ..., "gflops": ..., "gbytes_per_s": ...,
+//                    "allocs_per_call": ...}, ...]}
+//
+// FLOPs and bytes are the analytic costs of the layers (LayerCost): the
+// arithmetic of the operation itself and the inputs, parameters and outputs
+// it has to touch once, whatever the implementation does on top.
+// allocs_per_call counts the heap allocations (malloc, operator new and the
+// aligned allocations of armadillo) per layer call, on all threads; it is -1
+// where allocations cannot be intercepted.
+
+#include <armadillo>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "layers/conv2d.h"
+#include "layers/dense.h"
+#include "layers/dropout.h"
+#include "layers/layer_cost.h"
+#include "layers/max_pooling.h"
+#include "layers/relu.h"
+#include "layers/sigmoid.h"
+#include "layers/softmax.h"
+#include "losses/cross_entropy_loss.h"
+#include "losses/mse_loss.h"
+
+using namespace afs;
+
+namespace {
+
+std::atomic<size_t> num_allocations{0};
+
+void CountAllocation() {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+// Count the allocations by interposing the C allocation functions, which
+// operator new and armadillo both end up calling.
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size) noexcept {
+  CountAllocation();
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+  CountAllocation();
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+  if (ptr == nullptr) CountAllocation();
+  return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept {
+  CountAllocation();
+  void *result = __libc_memalign(alignment, size);
+  if (result == nullptr) return ENOMEM;
+  *ptr = result;
+  return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+  CountAllocation();
+  return __libc_memalign(alignment, size);
+}
+}
+const bool kCountsAllocations = true;
+#else
+const bool kCountsAllocations = false;
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// One phase of one layer on one input shape. `run` processes one sample.
+struct Case {
+  std::string layer;
+  std::string phase;
+  std::string shape;
+  // Nominal work per sample.
+  double flops;
+  double bytes;
+  std::function<void()> run;
+};
+
+struct Result {
+  size_t batch_size;
+  size_t threads;
+  size_t iterations;
+  double seconds;
+  size_t allocations;
+};
+
+std::string Shape3D(size_t height, size_t width, size_t depth) {
+  std::ostringstream shape;
+  shape << height << "x" << width << "x" << depth;
+  return shape.str();
+}
+
+const double kDouble = sizeof(double);
+
+void AddConv2D(std::vector<Case> &cases, size_t height, size_t width,
+               size_t depth, size_t filter_size, size_t num_filters) {
+  auto layer = std::make_shared<Conv2D>(height, width, depth, filter_size,
+                                        filter_size, 1, 1, num_filters);
+  auto input = std::make_shared<arma::cube>(height, width, depth,
+                                            arma::fill::randn);
+  auto output = std::make_shared<arma::cube>();
+  layer->Forward(*input, *output);
+  auto upstream = std::make_shared<arma::cube>(arma::size(*output),
+                                               arma::fill::randn);
+
+  const LayerCost cost = layer->GetCost();
+  const std::string shape = Shape3D(height, width, depth) + "-" +
+                            std::to_string(filter_size) + "x" +
+                            std::to_string(filter_size) + "x" +
+                            std::to_string(num_filters);
+  cases.push_back({"Conv2D", "forward", shape, cost.forward_flops,
+                   cost.forward_bytes,
+                   [=]() { layer->Forward(*input, *output); }});
+  cases.push_back({"Conv2D", "backward", shape, cost.backward_flops,
+                   cost.backward_bytes,
+                   [=]() { layer->Backward(*upstream); }});
+}
+
+void AddDense(std::vector<Case> &cases, size_t num_inputs,
+              size_t num_outputs) {
+  auto layer = std::make_shared<Dense>(num_inputs, num_outputs);
+  auto input = std::make_shared<arma::vec>(num_inputs, arma::fill::randn);
+  auto output = std::make_shared<arma::vec>();
+  layer->Forward(*input, *output);
+  auto upstream = std::make_shared<arma::vec>(num_outputs, arma::fill::randn);
+
+  const LayerCost cost = layer->GetCost();
+  const std::string shape =
+      std::to_string(num_inputs) + "x" + std::to_string(num_outputs);
+  cases.push_back({"Dense", "forward", shape, cost.forward_flops,
+                   cost.forward_bytes,
+                   [=]() { layer->Forward(*input, *output); }});
+  cases.push_back({"Dense", "backward", shape, cost.backward_flops,
+                   cost.backward_bytes,
+                   [=]() { layer->Backward(*upstream); }});
+}
+
+void AddMaxPooling(std::vector<Case> &cases, size_t height, size_t width,
+                   size_t depth, size_t window) {
+  auto layer = std::make_shared<MaxPooling>(height, width, depth, window,
+                                            window, window, window);
+  auto input = std::make_shared<arma::cube>(height, width, depth,
+                                            arma::fill::randn);
+  auto output = std::make_shared<arma::cube>();
+  layer->Forward(*input, *output);
+  auto upstream = std::make_shared<arma::cube>(arma::size(*output),
+                                               arma::fill::randn);
+
+  const LayerCost cost = layer->GetCost();
+  const std::string shape =
+      Shape3D(height, width, depth) + "-" + std::to_string(window);
+  cases.push_back({"MaxPooling", "forward", shape, cost.forward_flops,
+                   cost.forward_bytes,
+                   [=]() { layer->Forward(*input, *output); }});
+  cases.push_back({"MaxPooling", "backward", shape, cost.backward_flops,
+                   cost.backward_bytes,
+                   [=]() { layer->Backward(*upstream); }});
+}
+
+void AddReLU(std::vector<Case> &cases, size_t height, size_t width,
+             size_t depth) {
+  auto layer = std::make_shared<ReLU>(height, width, depth);
+  auto input = std::make_shared<arma::cube>(height, width, depth,
+                                            arma::fill::randn);
+  auto output = std::make_shared<arma::cube>();
+  layer->Forward(*input, *output);
+  auto upstream = std::make_shared<arma::cube>(arma::size(*output),
+                                               arma::fill::randn);
+
+  const LayerCost cost = layer->GetCost();
+  const std::string shape = Shape3D(height, width, depth);
+  cases.push_back({"ReLU", "forward", shape, cost.forward_flops,
+                   cost.forward_bytes,
+                   [=]() { layer->Forward(*input, *output); }});
+  cases.push_back({"ReLU", "backward", shape, cost.backward_flops,
+                   cost.backward_bytes,
+                   [=]() { layer->Backward(*upstream); }});
+}
+
+void AddSigmoid(std::vector<Case> &cases, size_t size) {
+  auto layer = std::make_shared<Sigmoid>(size);
+  auto input = std::make_shared<arma::vec>(size, arma::fill::randn);
+  auto output = std::make_shared<arma::vec>();
+  layer->Forward(*input, *output);
+  auto upstream = std::make_shared<arma::vec>(size, arma::fill::randn);
+
+  const LayerCost cost = layer->GetCost();
+  const std::string shape = std::to_string(size);
+  cases.push_back({"Sigmoid", "forward", shape, cost.forward_flops,
+                   cost.forward_bytes,
+                   [=]() { layer->Forward(*input, *output); }});
+  cases.push_back({"Sigmoid", "backward", shape, cost.backward_flops,
+                   cost.backward_bytes,
+                   [=]() { layer->Backward(*upstream); }});
+}
+
+void AddSoftmax(std::vector<Case> &cases, size_t size) {
+  auto layer = std::make_shared<Softmax>(size);
+  auto input = std::make_shared<arma::vec>(size, arma::fill::randn);
+  auto output = std::make_shared<arma::vec>();
+  layer->Forward(*input, *output);
+  auto upstream = std::make_shared<arma::vec>(size, arma::fill::randn);
+
+  const LayerCost cost = layer->GetCost();
+  const std::string shape = std::to_string(size);
+  cases.push_back({"Softmax", "forward", shape, cost.forward_flops,
+                   cost.forward_bytes,
+                   [=]() { layer->Forward(*input, *output); }});
+  cases.push_back({"Softmax", "backward", shape, cost.backward_flops,
+                   cost.backward_bytes,
+                   [=]() { layer->Backward(*upstream); }});
+}
+
+void AddDropout(std::vector<Case> &cases, size_t size, float keep_prop) {
+  auto layer = std::make_shared<Dropout>(keep_prop);
+  auto input = std::make_shared<arma::vec>(size, arma::fill::randn);
+  auto output = std::make_shared<arma::vec>();
+  layer->Forward(*input, *output);
+  auto upstream = std::make_shared<arma::vec>(size, arma::fill::randn);
+
+  const LayerCost cost = layer->GetCost(size);
+  const std::string shape = std::to_string(size);
+  cases.push_back({"Dropout", "forward", shape, cost.forward_flops,
+                   cost.forward_bytes,
+                   [=]() { layer->Forward(*input, *output); }});
+  cases.push_back({"Dropout", "backward", shape, cost.backward_flops,
+                   cost.backward_bytes,
+                   [=]() { layer->Backward(*upstream); }});
+}
+
+void AddLosses(std::vector<Case> &cases, size_t size) {
+  auto predicted = std::make_shared<arma::vec>(size, arma::fill::randu);
+  *predicted /= arma::accu(*predicted);
+  auto actual = std::make_shared<arma::vec>(size, arma::fill::zeros);
+  (*actual)(0) = 1.0;
+
+  const double n = size;
+  const std::string shape = std::to_string(size);
+
+  auto cross_entropy = std::make_shared<CrossEntropyLoss>(size);
+  cross_entropy->Forward(*predicted, *actual);
+  cases.push_back({"CrossEntropyLoss", "forward", shape, 3 * n,
+                   kDouble * 2 * n,
+                   [=]() { cross_entropy->Forward(*predicted, *actual); }});
+  cases.push_back({"CrossEntropyLoss", "backward", shape, 2 * n,
+                   kDouble * 3 * n, [=]() { cross_entropy->Backward(); }});
+
+  auto mse = std::make_shared<MSELoss>();
+  mse->Forward(*predicted, *actual);
+  cases.push_back({"MSELoss", "forward", shape, 3 * n, kDouble * 2 * n,
+                   [=]() { mse->Forward(*predicted, *actual); }});
+  cases.push_back({"MSELoss", "backward", shape, 3 * n, kDouble * 3 * n,
+                   [=]() { mse->Backward(); }});
+}
+
+// The layer shapes of the example networks (MNIST, CIFAR-10, wine quality),
+// plus larger ones.
+std::vector<Case> MakeCases() {
+  std::vector<Case> cases;
+  AddConv2D(cases, 28, 28, 1, 5, 6);
+  AddConv2D(cases, 12, 12, 6, 5, 16);
+  AddConv2D(cases, 32, 32, 3, 5, 16);
+  AddConv2D(cases, 14, 14, 16, 3, 32);
+  AddDense(cases, 256, 10);
+  AddDense(cases, 784, 128);
+  AddDense(cases, 1024, 1024);
+  AddMaxPooling(cases, 24, 24, 6, 2);
+  AddMaxPooling(cases, 28, 28, 16, 2);
+  AddReLU(cases, 24, 24, 6);
+  AddReLU(cases, 28, 28, 16);
+  AddSigmoid(cases, 10);
+  AddSigmoid(cases, 1024);
+  AddSoftmax(cases, 10);
+  AddSoftmax(cases, 1024);
+  AddDropout(cases, 128, 0.5);
+  AddDropout(cases, 1024, 0.5);
+  AddLosses(cases, 10);
+  AddLosses(cases, 1024);
+  return cases;
+}
+
+size_t MaxThreads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+void SetThreads(size_t threads) {
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+}
+
+double SecondsSince(Clock::time_point start) {
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+// Run batches of `batch_size` samples for at least `min_time` seconds,
+// after one warm-up batch.
+Result Measure(const Case &c, size_t batch_size, size_t threads,
+               double min_time) {
+  SetThreads(threads);
+  for (size_t i = 0; i < batch_size; ++i) c.run();
+
+  Result result = {batch_size, threads, 0, 0.0, 0};
+  const size_t allocations_before = num_allocations.load();
+  const Clock::time_point start = Clock::now();
+  do {
+    for (size_t i = 0; i < batch_size; ++i) c.run();
+    ++result.iterations;
+    result.seconds = SecondsSince(start);
+  } while (result.seconds < min_time);
+  result.allocations = num_allocations.load() - allocations_before;
+  return result;
+}
+
+void WriteResult(std::ostream &out, const Case &c, const Result &r) {
+  const double ops = static_cast<double>(r.iterations);
+  const double calls = ops * r.batch_size;
+  out << "{\"name\": \"" << c.layer << "/" << c.phase << "/" << c.shape
+      << "\", \"layer\": \"" << c.layer << "\", \"phase\": \"" << c.phase
+      << "\", \"shape\": \"" << c.shape << "\", \"batch_size\": "
+      << r.batch_size << ", \"threads\": " << r.threads
+      << ", \"iterations\": " << r.iterations
+      << ", \"ns_per_op\": " << r.seconds * 1e9 / ops
+      << ", \"ns_per_sample\": " << r.seconds * 1e9 / calls
+      << ", \"gflops\": " << c.flops * calls / r.seconds * 1e-9
+      << ", \"gbytes_per_s\": " << c.bytes * calls / r.seconds * 1e-9
+      << ", \"allocs_per_call\": "
+      << (kCountsAllocations ? r.allocations / calls : -1.0) << "}";
+}
+
+// Parse a comma-separated list of positive integers. Returns false if an item
+// is not one, e.g. 0, or if the list is empty.
+bool ParseList(const std::string &list, std::vector<size_t> &values) {
+  values.clear();
+  std::istringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (item.empty()) continue;
+    if (item.find_first_not_of("0123456789") != std::string::npos) {
+      return false;
+    }
+    values.push_back(std::stoul(item));
+    if (values.back() == 0) return false;
+  }
+  return !values.empty();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::string filter;
+  std::string output_path;
+  double min_time = 0.2;
+  std::vector<size_t> thread_counts = {1};
+  if (MaxThreads() > 1) thread_counts.push_back(MaxThreads());
+  std::vector<size_t> batch_sizes = {1, 32};
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool known = arg == "--filter" || arg == "--min_time" ||
+                       arg == "--threads" || arg == "--batch_sizes" ||
+                       arg == "--output";
+    if (!known || i + 1 == argc) {
+      std::cerr << "Usage: " << argv[0]
+                << " [--filter <substring>] [--min_time <seconds>]"
+                   " [--threads <n,n,...>] [--batch_sizes <n,n,...>]"
+                   " [--output <file.json>]"
+                << std::endl;
+      return 1;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--filter") {
+      filter = value;
+    } else if (arg == "--min_time") {
+      min_time = std::stod(value);
+    } else if (arg == "--threads" || arg == "--batch_sizes") {
+      if (!ParseList(value,
+                     arg == "--threads" ? thread_counts : batch_sizes)) {
+        std::cerr << arg << " takes a list of positive integers" << std::endl;
+        return 1;
+      }
+    } else {
+      output_path = value;
+    }
+  }
+
+  std::ofstream file;
+  if (!output_path.empty()) {
+    file.open(output_path);
+    if (!file) {
+      std::cerr << "Cannot write " << output_path << std::endl;
+      return 1;
+    }
+  }
+  std::ostream &out = output_path.empty() ? std::cout : file;
+
+  char date[32];
+  const std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+  out << "{\"context\": {\"date\": \"" << date
+      << "\", \"max_threads\": " << MaxThreads()
+      << ", \"min_time\": " << min_time
+      << ", \"counts_allocations\": " << (kCountsAllocations ? "true" : "false")
+      << "},\n \"benchmarks\": [";
+
+  bool first = true;
+  for (const Case &c : MakeCases()) {
+    const std::string name = c.layer + "/" + c.phase + "/" + c.shape;
+    if (name.find(filter) == std::string::npos) continue;
+    for (size_t threads : thread_counts) {
+      for (size_t batch_size : batch_sizes) {
+        const Result result = Measure(c, batch_size, threads, min_time);
+        std::cerr << name << " batch " << batch_size << ", " << threads
+                  << " threads: " << result.seconds * 1e9 / result.iterations
+                  << " ns/op" << std::endl;
+        out << (first ? "\n  " : ",\n  ");
+        WriteResult(out, c, result);
+        first = false;
+      }
+    }
+  }
+  out << "\n]}" << std::endl;
+  return 0;
+}
@@ -0,0 +1,75 @@
+#include "augmentation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace afs {
+
+namespace {
+
+int RandomShift(size_t max_shift, std::mt19937_64 &rng) {
+  if (max_shift == 0) return 0;
+  const int limit = static_cast<int>(max_shift);
+  return std::uniform_int_distribution<int>(-limit, limit)(rng);
+}
+
+inline uint8_t Brighten(uint8_t pixel, int delta) {
+  const int value = pixel + delta;
+  return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+}  // namespace
+
+void Augmentation::Apply(const uint8_t *in, uint8_t *out, size_t rows,
+                         size_t cols, size_t channels,
+                         std::mt19937_64 &rng) const {
+  // Output pixel (r, c) reads source pixel (r + dy, c + dx), in the mirrored
+  // source when flipping.
+  const int dy = RandomShift(options.crop_padding, rng) +
+                 RandomShift(options.max_translation, rng);
+  const int dx = RandomShift(options.crop_padding, rng) +
+                 RandomShift(options.max_translation, rng);
+  const bool flip = options.horizontal_flip && (rng() & 1);
+  int delta = 0;
+  if (options.brightness > 0.0) {
+    std::uniform_real_distribution<double> jitter(-options.brightness,
+                                                  options.brightness);
+    delta = static_cast<int>(std::lround(jitter(rng) * 255.0));
+  }
+
+  const int height = static_cast<int>(rows);
+  const int width = static_cast<int>(cols);
+  // Output columns whose source column is inside the image.
+  const int c_begin = std::min(std::max(-dx, 0), width);
+  const int c_end = std::max(std::min(width - dx, width), c_begin);
+
+  for (size_t s = 0; s < channels; ++s) {
+    for (int r = 0; r < height; ++r) {
+      uint8_t *dst = out + (s * rows + r) * cols;
+      const int src_r = r + dy;
+      if (src_r < 0 || src_r >= height) {
+        std::memset(dst, 0, cols);
+        continue;
+      }
+      const uint8_t *src = in + (s * rows + src_r) * cols;
+
+      std::memset(dst, 0, c_begin);
+      if (flip) {
+        const int last = width - 1 - dx;
+#pragma omp simd
+        for (int c = c_begin; c < c_end; ++c) {
+          dst[c] = Brighten(src[last - c], delta);
+        }
+      } else {
+#pragma omp simd
+        for (int c = c_begin; c < c_end; ++c) {
+          dst[c] = Brighten(src[c + dx], delta);
+        }
+      }
+      std::memset(dst + c_end, 0, width - c_end);
+    }
+  }
+}
+
+}  // namespace afs
@@ -0,0 +1,56 @@
+#ifndef AUGMENTATION_H_
+#define AUGMENTATION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+namespace afs {
+
+// Random transformations of the training images. All are off by default.
+struct AugmentationOptions {
+  // Pad the image with `crop_padding` black pixels on each side and take a
+  // random crop of the original size.
+  size_t crop_padding = 0;
+  // Mirror half of the images left to right.
+  bool horizontal_flip = false;
+  // Shift the image by up to `max_translation` pixels in each direction,
+  // on top of the crop.
+  size_t max_translation = 0;
+  // Add the same random offset in [-brightness, brightness] (in units of
+  // the full 0-255 range) to all the pixels of the image.
+  double brightness = 0.0;
+};
+
+// Applies random AugmentationOptions transformations to uint8 images stored
+// as [channels][rows][cols].
+//
+// The crop, translation and flip of an image all amount to reading each
+// output row from a shifted, possibly reversed source row, so the image is
+// augmented in a single pass over its rows, before its conversion to
+// doubles. The row loops are branch-free and vectorized by the compiler.
+class Augmentation {
+ public:
+  explicit Augmentation(const AugmentationOptions &options = {})
+      : options(options) {}
+
+  // Whether any transformation is enabled.
+  bool Enabled() const {
+    return options.crop_padding > 0 || options.horizontal_flip ||
+           options.max_translation > 0 || options.brightness > 0.0;
+  }
+
+  // Write a randomly transformed copy of `in` to `out`. `rng` is only used
+  // by the calling thread.
+  void Apply(const uint8_t *in, uint8_t *out, size_t rows, size_t cols,
+             size_t channels, std::mt19937_64 &rng) const;
+
+  const AugmentationOptions &GetOptions() const { return options; }
+
+ private:
+  AugmentationOptions options;
+};
+
+}  // namespace afs
+
+#endif
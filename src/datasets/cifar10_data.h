@@ -0,0 +1,79 @@
+#ifndef CIFAR10_DATA_H_
+#define CIFAR10_DATA_H_
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "datasets/dataset.h"
+#include "utils/mapped_file.h"
+
+// CIFAR-10 dataset, read in place from the binary version of the files
+// (data_batch_1.bin ... data_batch_5.bin, test_batch.bin).
+//
+// The files are memory-mapped and the samples are views over their
+// 3073-byte records (1 label byte, then 3 x 32 x 32 pixels), so loading is
+// immediate and pages are only read once the samples are used. Pixels are
+// converted to doubles in [0, 1] when a batch is assembled.
+class CIFAR10Data {
+ public:
+  static const size_t kImageRows = 32;
+  static const size_t kImageCols = 32;
+  static const size_t kImageChannels = 3;
+  static const size_t kNumClasses = 10;
+
+  CIFAR10Data(const std::string &data_dir, double split_ratio = 0.9,
+              uint64_t seed = 0)
+      : train_all(kImageRows, kImageCols, kImageChannels),
+        test_data(kImageRows, kImageCols, kImageChannels) {
+    assert(split_ratio <= 1 && split_ratio >= 0);
+
+    for (int i = 1; i <= 5; ++i) {
+      if (!AddFile(data_dir + "/data_batch_" + std::to_string(i) + ".bin",
+                   train_all)) {
+        exit(1);
+      }
+    }
+    if (!AddFile(data_dir + "/test_batch.bin", test_data)) exit(1);
+
+    train_all.SetNormalization(1.0 / 255.0);
+    test_data.SetNormalization(1.0 / 255.0);
+
+    train_all.Shuffle(seed);
+    train_all.Split(split_ratio, train_data, validation_data);
+  }
+
+  // Samples with one-hot labels, as 32 x 32 x 3 cubes scaled to [0, 1].
+  const afs::Dataset &getTrainData() const { return train_data; }
+
+  const afs::Dataset &getValidationData() const { return validation_data; }
+
+  const afs::Dataset &getTestData() const { return test_data; }
+
+ private:
+  static const size_t kRecordSize =
+      1 + kImageRows * kImageCols * kImageChannels;
+
+  afs::Dataset train_all;
+  afs::Dataset train_data;
+  afs::Dataset validation_data;
+  afs::Dataset test_data;
+
+  static bool AddFile(const std::string &path, afs::Dataset &dataset) {
+    auto file = std::make_shared<afs::MappedFile>();
+    if (!file->Open(path)) return false;
+    if (file->Size() % kRecordSize != 0) {
+      std::cerr << "Unexpected CIFAR-10 file size: " << path << std::endl;
+      return false;
+    }
+    std::shared_ptr<const uint8_t> records(file, file->Data());
+    dataset.AddRecords(records, file->Size() / kRecordSize, kRecordSize, 0, 1,
+                       kNumClasses);
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "data_loader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <string>
+
+#include "utils/alloc_profiler.h"
+#include "utils/trace.h"
+
+namespace afs {
+
+namespace {
+
+// Wait for the other side of a queue: spin briefly, then back off so that
+// an idle worker does not keep a core busy.
+void Backoff(size_t &attempts) {
+  if (++attempts < 64) {
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+}
+
+}  // namespace
+
+DataLoader::DataLoader(size_t batch_size, size_t num_workers,
+                       size_t prefetch_depth, bool drop_last)
+    : batch_size(batch_size),
+      num_workers(num_workers),
+      prefetch_depth(prefetch_depth),
+      drop_last(drop_last) {
+  assert(batch_size > 0 && num_workers > 0 && prefetch_depth > 0);
+  for (size_t w = 0; w < num_workers; ++w) {
+    queues.emplace_back(new SpscQueue<Batch>(prefetch_depth));
+  }
+}
+
+DataLoader::~DataLoader() { Stop(); }
+
+void DataLoader::SetAugmentation(const AugmentationOptions &options,
+                                 uint64_t seed) {
+  Stop();
+  augmentation = Augmentation(options);
+  rngs.clear();
+  for (size_t w = 0; w < num_workers; ++w) {
+    std::seed_seq seeds{static_cast<uint32_t>(seed),
+                        static_cast<uint32_t>(seed >> 32),
+                        static_cast<uint32_t>(w)};
+    rngs.emplace_back(seeds);
+  }
+}
+
+void DataLoader::Start(const Dataset &dataset) {
+  Stop();
+
+  assert(!augmentation.Enabled() ||
+         dataset.GetDataType() == Dataset::DataType::kUInt8);
+  this->dataset = dataset;
+  num_batches = drop_last ? dataset.Size() / batch_size
+                          : (dataset.Size() + batch_size - 1) / batch_size;
+  next_batch = 0;
+  wait_seconds = 0.0;
+
+  stop = false;
+  for (size_t w = 0; w < num_workers; ++w) {
+    workers.emplace_back(&DataLoader::Run, this, w);
+  }
+}
+
+Batch *DataLoader::Next() {
+  if (current != nullptr) {
+    current->Pop();
+    current = nullptr;
+  }
+  if (next_batch == num_batches) return nullptr;
+
+  SpscQueue<Batch> *queue = queues[next_batch % num_workers].get();
+  Batch *batch = queue->Front();
+  if (batch == nullptr) {
+    AFS_TRACE_SCOPE("DataLoader::Wait");
+    auto start = std::chrono::steady_clock::now();
+    size_t attempts = 0;
+    while ((batch = queue->Front()) == nullptr) Backoff(attempts);
+    std::chrono::duration<double> waited =
+        std::chrono::steady_clock::now() - start;
+    wait_seconds += waited.count();
+  }
+  assert(batch->index == next_batch);
+
+  ++next_batch;
+  current = queue;
+  return batch;
+}
+
+void DataLoader::Stop() {
+  stop = true;
+  for (std::thread &worker : workers) worker.join();
+  workers.clear();
+
+  // Drop the batches of an abandoned epoch.
+  for (auto &queue : queues) {
+    while (queue->Front() != nullptr) queue->Pop();
+  }
+  current = nullptr;
+}
+
+void DataLoader::Run(size_t worker_index) {
+  AFS_TRACE_THREAD_NAME("DataLoader worker " + std::to_string(worker_index));
+  AFS_ALLOC_SCOPE("DataLoader", this, kData);
+  SpscQueue<Batch> &queue = *queues[worker_index];
+  const bool augment = augmentation.Enabled();
+  std::vector<uint8_t> augmented(augment ? dataset.SampleSize() : 0);
+  for (size_t b = worker_index; b < num_batches; b += num_workers) {
+    Batch *batch;
+    size_t attempts = 0;
+    while ((batch = queue.BeginPush()) == nullptr) {
+      if (stop) return;
+      Backoff(attempts);
+    }
+
+    AFS_TRACE_SCOPE("DataLoader::Batch");
+    const size_t first = b * batch_size;
+    batch->index = b;
+    batch->size = std::min(batch_size, dataset.Size() - first);
+    if (batch->inputs.size() < batch->size) {
+      batch->inputs.resize(batch->size);
+      batch->targets.resize(batch->size);
+    }
+    for (size_t i = 0; i < batch->size; ++i) {
+      if (augment) {
+        augmentation.Apply(dataset.GetRawUInt8(first + i), augmented.data(),
+                           dataset.Rows(), dataset.Cols(), dataset.Channels(),
+                           rngs[worker_index]);
+        dataset.ReadSample(augmented.data(), batch->inputs[i]);
+      } else {
+        dataset.GetSample(first + i, batch->inputs[i]);
+      }
+      if (dataset.HasTargets()) dataset.GetTarget(first + i, batch->targets[i]);
+    }
+
+    queue.EndPush();
+    if (stop) return;
+  }
+}
+
+}  // namespace afs
@@ -0,0 +1,97 @@
+#ifndef DATA_LOADER_H_
+#define DATA_LOADER_H_
+
+#include <armadillo>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "datasets/augmentation.h"
+#include "datasets/dataset.h"
+#include "utils/spsc_queue.h"
+
+namespace afs {
+
+// A minibatch assembled by the DataLoader. The buffers are reused from one
+// batch to the next.
+struct Batch {
+  size_t index = 0;
+  size_t size = 0;
+  std::vector<arma::cube> inputs;
+  std::vector<arma::vec> targets;
+};
+
+// Prepares the minibatches of a Dataset on background threads while the
+// previous ones are trained on.
+//
+// Worker w assembles batches w, w + num_workers, ... into its own lock-free
+// queue of `prefetch_depth` batches, and Next() takes them from the queues
+// in turn, so batches come out in dataset order. With augmentation enabled,
+// the workers also transform the raw uint8 images before converting them.
+//
+// Usage, once per epoch:
+//   loader.Start(train_data);
+//   while (Batch *batch = loader.Next()) {
+//     for (size_t i = 0; i < batch->size; ++i)
+//       ... batch->inputs[i], batch->targets[i] ...
+//   }
+class DataLoader {
+ public:
+  // With `drop_last`, a final batch smaller than `batch_size` is skipped.
+  DataLoader(size_t batch_size, size_t num_workers = 2,
+             size_t prefetch_depth = 2, bool drop_last = true);
+  ~DataLoader();
+
+  DataLoader(const DataLoader &) = delete;
+  DataLoader &operator=(const DataLoader &) = delete;
+
+  // Randomly transform the samples of the following epochs, which must be
+  // uint8 images. Each worker draws from its own random stream, seeded from
+  // `seed` and the worker index, so runs with the same number of workers
+  // see the same images. Any epoch in progress is abandoned.
+  void SetAugmentation(const AugmentationOptions &options, uint64_t seed = 0);
+
+  // Start producing the batches of `dataset`, in its current order. Any
+  // epoch in progress is abandoned.
+  void Start(const Dataset &dataset);
+
+  // The next batch, or null at the end of the epoch. The batch stays valid
+  // until the following call.
+  Batch *Next();
+
+  size_t NumBatches() const { return num_batches; }
+
+  // Seconds Next() spent waiting for the workers since Start(). Close to
+  // zero when data preparation is hidden behind training.
+  double GetWaitSeconds() const { return wait_seconds; }
+
+ private:
+  void Run(size_t worker_index);
+  void Stop();
+
+  size_t batch_size;
+  size_t num_workers;
+  size_t prefetch_depth;
+  bool drop_last;
+
+  Augmentation augmentation;
+  // Random stream of each worker.
+  std::vector<std::mt19937_64> rngs;
+
+  Dataset dataset;
+  size_t num_batches = 0;
+  size_t next_batch = 0;
+  // Queue holding the batch returned by the last Next(), if any.
+  SpscQueue<Batch> *current = nullptr;
+  double wait_seconds = 0.0;
+
+  std::vector<std::unique_ptr<SpscQueue<Batch>>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<bool> stop{false};
+};
+
+}  // namespace afs
+
+#endif
@@ -0,0 +1,353 @@
+#ifndef DATASET_H_
+#define DATASET_H_
+
+#include <algorithm>
+#include <armadillo>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace afs {
+
+// A dataset whose samples are stored back to back in uint8 or float
+// buffers. Samples are converted to doubles and normalized only when they are
+// read, so the full dataset stays as compact as its raw form.
+//
+// Image samples are stored as [channels][rows][cols], row by row, like the
+// MNIST and CIFAR-10 files. Tabular samples use rows = channels = 1.
+//
+// The storage is one or more chunks of samples, e.g. one per file, which may
+// point straight into memory-mapped files. Samples of a chunk are `stride`
+// values apart, so records that interleave labels and pixels are read in
+// place.
+//
+// The storage is shared and never modified: copies, subsets, shuffles and
+// splits of a dataset are views that only hold a permutation of sample
+// indices.
+class Dataset {
+ public:
+  enum class DataType { kUInt8, kFloat32 };
+
+  Dataset()
+      : data_type(DataType::kUInt8),
+        first(0),
+        num_samples(0),
+        rows(0),
+        cols(0),
+        channels(0),
+        num_classes(0),
+        target_size(0),
+        scale(1.0),
+        offset(0.0),
+        l2_normalize(false) {}
+
+  // `data` must hold num_samples * rows * cols * channels values. It may be
+  // an aliasing pointer into a memory-mapped file.
+  Dataset(std::shared_ptr<const uint8_t> data, size_t num_samples, size_t rows,
+          size_t cols, size_t channels)
+      : Dataset(DataType::kUInt8, rows, cols, channels) {
+    Chunk chunk;
+    chunk.uint8_data = data;
+    AddChunk(chunk, num_samples);
+  }
+
+  // Samples may be `stride` values apart, e.g. the feature columns of a
+  // row-major table; 0 means back to back.
+  Dataset(std::shared_ptr<const float> data, size_t num_samples, size_t rows,
+          size_t cols, size_t channels, size_t stride = 0)
+      : Dataset(DataType::kFloat32, rows, cols, channels) {
+    Chunk chunk;
+    chunk.float_data = data;
+    chunk.stride = stride;
+    AddChunk(chunk, num_samples);
+  }
+
+  // Empty uint8 dataset, filled with AddRecords().
+  Dataset(size_t rows, size_t cols, size_t channels)
+      : Dataset(DataType::kUInt8, rows, cols, channels) {}
+
+  // Append `num_records` records of `record_size` bytes, each holding a
+  // one-byte label at `label_offset` and the pixels at `pixel_offset`, as in
+  // the CIFAR-10 binary files. Targets are the one-hot encoded labels.
+  void AddRecords(std::shared_ptr<const uint8_t> records, size_t num_records,
+                  size_t record_size, size_t label_offset, size_t pixel_offset,
+                  size_t num_classes) {
+    assert(data_type == DataType::kUInt8 && first == 0 && !indices);
+    assert(pixel_offset + SampleSize() <= record_size);
+    Chunk chunk;
+    chunk.uint8_data =
+        std::shared_ptr<const uint8_t>(records, records.get() + pixel_offset);
+    chunk.labels =
+        std::shared_ptr<const uint8_t>(records, records.get() + label_offset);
+    chunk.stride = record_size;
+    chunk.label_stride = record_size;
+    AddChunk(chunk, num_records);
+    this->num_classes = num_classes;
+    this->target_size = num_classes;
+  }
+
+  // Class labels, one per sample. Targets are returned one-hot encoded.
+  void SetLabels(std::shared_ptr<const uint8_t> labels, size_t num_classes) {
+    assert(chunks.size() == 1);
+    chunks[0].labels = labels;
+    chunks[0].label_stride = 1;
+    chunks[0].targets.reset();
+    this->num_classes = num_classes;
+    this->target_size = num_classes;
+  }
+
+  // Real-valued targets, `target_size` values per sample, `stride` values
+  // apart (0 means back to back).
+  void SetTargets(std::shared_ptr<const float> targets, size_t target_size,
+                  size_t stride = 0) {
+    assert(chunks.size() == 1);
+    chunks[0].targets = targets;
+    chunks[0].label_stride = stride == 0 ? target_size : stride;
+    chunks[0].labels.reset();
+    this->num_classes = 0;
+    this->target_size = target_size;
+  }
+
+  // Samples are read as raw * scale + offset, then scaled to unit L2 norm if
+  // `l2_normalize` is set.
+  void SetNormalization(double scale, double offset = 0.0,
+                        bool l2_normalize = false) {
+    this->scale = scale;
+    this->offset = offset;
+    this->l2_normalize = l2_normalize;
+  }
+
+  // View over samples [first, first + count).
+  Dataset Subset(size_t first, size_t count) const {
+    assert(first + count <= num_samples);
+    Dataset subset = *this;
+    subset.first = this->first + first;
+    subset.num_samples = count;
+    return subset;
+  }
+
+  // Split into the first `ratio` of the samples and the rest.
+  void Split(double ratio, Dataset &first_part, Dataset &second_part) const {
+    assert(ratio <= 1 && ratio >= 0);
+    const size_t num_first = num_samples * ratio;
+    first_part = Subset(0, num_first);
+    second_part = Subset(num_first, num_samples - num_first);
+  }
+
+  // Reorder the samples of this view. Only the index permutation is touched,
+  // so reshuffling every epoch is cheap.
+  void Shuffle(std::mt19937_64 &rng) {
+    std::vector<size_t> *shuffled = new std::vector<size_t>(num_samples);
+    for (size_t i = 0; i < num_samples; ++i) (*shuffled)[i] = StorageIndex(i);
+    std::shuffle(shuffled->begin(), shuffled->end(), rng);
+    indices.reset(shuffled);
+    first = 0;
+  }
+
+  void Shuffle(uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    Shuffle(rng);
+  }
+
+  // View over `count` samples drawn without replacement, e.g. to evaluate
+  // on part of a large validation set.
+  Dataset Sample(size_t count, std::mt19937_64 &rng) const {
+    Dataset sample = *this;
+    sample.Shuffle(rng);
+    sample.num_samples = std::min(count, num_samples);
+    return sample;
+  }
+
+  size_t Size() const { return num_samples; }
+  size_t Rows() const { return rows; }
+  size_t Cols() const { return cols; }
+  size_t Channels() const { return channels; }
+  size_t SampleSize() const { return rows * cols * channels; }
+  size_t TargetSize() const { return target_size; }
+  size_t NumClasses() const { return num_classes; }
+  bool HasTargets() const {
+    return !chunks.empty() && (chunks[0].labels || chunks[0].targets);
+  }
+  DataType GetDataType() const { return data_type; }
+  double GetScale() const { return scale; }
+  double GetOffset() const { return offset; }
+  bool GetL2Normalize() const { return l2_normalize; }
+
+  // Zero-copy views of the raw storage of sample i.
+  const uint8_t *GetRawUInt8(size_t i) const {
+    assert(data_type == DataType::kUInt8 && i < num_samples);
+    size_t index;
+    const Chunk &chunk = Locate(i, index);
+    return chunk.uint8_data.get() + index * chunk.stride;
+  }
+
+  const float *GetRawFloat(size_t i) const {
+    assert(data_type == DataType::kFloat32 && i < num_samples);
+    size_t index;
+    const Chunk &chunk = Locate(i, index);
+    return chunk.float_data.get() + index * chunk.stride;
+  }
+
+  uint8_t GetLabel(size_t i) const {
+    assert(num_classes > 0 && i < num_samples);
+    size_t index;
+    const Chunk &chunk = Locate(i, index);
+    return chunk.labels.get()[index * chunk.label_stride];
+  }
+
+  // Read sample i as a rows x cols x channels cube. `out` is only
+  // reallocated when its shape differs.
+  void GetSample(size_t i, arma::cube &out) const {
+    if (data_type == DataType::kUInt8) {
+      ReadSample(GetRawUInt8(i), out);
+    } else {
+      out.set_size(rows, cols, channels);
+      ToCube(GetRawFloat(i), out);
+      if (l2_normalize) Normalize(out.memptr(), out.n_elem);
+    }
+  }
+
+  // Convert uint8 values stored like the samples of this dataset, e.g. an
+  // augmented copy of one, with the normalization of the dataset.
+  void ReadSample(const uint8_t *raw, arma::cube &out) const {
+    out.set_size(rows, cols, channels);
+    ToCube(raw, out);
+    if (l2_normalize) Normalize(out.memptr(), out.n_elem);
+  }
+
+  // Read sample i as a flat vector, in storage order.
+  void GetSample(size_t i, arma::vec &out) const {
+    out.set_size(SampleSize());
+    ReadFlat(i, out.memptr());
+  }
+
+  void GetTarget(size_t i, arma::vec &out) const {
+    assert(HasTargets());
+    if (num_classes > 0) {
+      out.zeros(num_classes);
+      out(GetLabel(i)) = 1.0;
+    } else {
+      size_t index;
+      const Chunk &chunk = Locate(i, index);
+      out.set_size(target_size);
+      const float *target = chunk.targets.get() + index * chunk.label_stride;
+      for (size_t j = 0; j < target_size; ++j) out(j) = target[j];
+    }
+  }
+
+  // Read samples first_sample ... first_sample + count - 1 into the
+  // columns of `samples` (and `targets`), reusing the caller's buffers.
+  void GetBatch(size_t first_sample, size_t count, arma::mat &samples,
+                arma::mat &batch_targets) const {
+    assert(first_sample + count <= num_samples);
+    samples.set_size(SampleSize(), count);
+    batch_targets.set_size(target_size, count);
+#pragma omp parallel for
+    for (size_t j = 0; j < count; ++j) {
+      ReadFlat(first_sample + j, samples.colptr(j));
+      if (HasTargets()) {
+        arma::vec target(batch_targets.colptr(j), target_size, false, true);
+        GetTarget(first_sample + j, target);
+      }
+    }
+  }
+
+ private:
+  // A run of samples stored `stride` values apart, with their labels or
+  // targets `label_stride` values apart.
+  struct Chunk {
+    std::shared_ptr<const uint8_t> uint8_data;
+    std::shared_ptr<const float> float_data;
+    std::shared_ptr<const uint8_t> labels;
+    std::shared_ptr<const float> targets;
+    size_t stride = 0;
+    size_t label_stride = 1;
+  };
+
+  DataType data_type;
+  std::vector<Chunk> chunks;
+  // Storage index one past the last sample of each chunk.
+  std::vector<size_t> chunk_ends;
+
+  // Storage index of each sample of the view, from `first` on. Null while
+  // the view is still in storage order.
+  std::shared_ptr<const std::vector<size_t>> indices;
+  size_t first;
+  size_t num_samples;
+  size_t rows;
+  size_t cols;
+  size_t channels;
+  size_t num_classes;
+  size_t target_size;
+
+  double scale;
+  double offset;
+  bool l2_normalize;
+
+  Dataset(DataType data_type, size_t rows, size_t cols, size_t channels)
+      : Dataset() {
+    this->data_type = data_type;
+    this->rows = rows;
+    this->cols = cols;
+    this->channels = channels;
+  }
+
+  void AddChunk(Chunk chunk, size_t num_chunk_samples) {
+    if (chunk.stride == 0) chunk.stride = SampleSize();
+    chunks.push_back(chunk);
+    chunk_ends.push_back(num_samples + num_chunk_samples);
+    num_samples += num_chunk_samples;
+  }
+
+  size_t StorageIndex(size_t i) const {
+    return indices ? (*indices)[first + i] : first + i;
+  }
+
+  // The chunk holding sample i of the view, and its index in that chunk.
+  const Chunk &Locate(size_t i, size_t &index) const {
+    index = StorageIndex(i);
+    if (chunks.size() == 1) return chunks[0];
+    size_t c = std::upper_bound(chunk_ends.begin(), chunk_ends.end(), index) -
+               chunk_ends.begin();
+    if (c > 0) index -= chunk_ends[c - 1];
+    return chunks[c];
+  }
+
+  // Convert from [channels][rows][cols] to the column-major cube layout.
+  template <typename T>
+  void ToCube(const T *raw, arma::cube &out) const {
+    double *values = out.memptr();
+    for (size_t s = 0; s < channels; ++s)
+      for (size_t r = 0; r < rows; ++r)
+        for (size_t c = 0; c < cols; ++c)
+          values[(s * cols + c) * rows + r] =
+              raw[(s * rows + r) * cols + c] * scale + offset;
+  }
+
+  void ReadFlat(size_t i, double *out) const {
+    const size_t size = SampleSize();
+    if (data_type == DataType::kUInt8) {
+      const uint8_t *raw = GetRawUInt8(i);
+      for (size_t j = 0; j < size; ++j) out[j] = raw[j] * scale + offset;
+    } else {
+      const float *raw = GetRawFloat(i);
+      for (size_t j = 0; j < size; ++j) out[j] = raw[j] * scale + offset;
+    }
+    if (l2_normalize) Normalize(out, size);
+  }
+
+  static void Normalize(double *values, size_t size) {
+    double norm = 0.0;
+    for (size_t j = 0; j < size; ++j) norm += values[j] * values[j];
+    norm = std::sqrt(norm);
+    if (norm == 0.0) return;
+    for (size_t j = 0; j < size; ++j) values[j] /= norm;
+  }
+};
+
+}  // namespace afs
+
+#endif
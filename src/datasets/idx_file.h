@@ -0,0 +1,63 @@
+#ifndef IDX_FILE_H_
+#define IDX_FILE_H_
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "utils/mapped_file.h"
+
+namespace afs {
+
+// Memory-mapped IDX file of unsigned bytes, the format of the original MNIST
+// distribution (http://yann.lecun.com/exdb/mnist/), e.g.
+// train-images-idx3-ubyte (n x 28 x 28) or train-labels-idx1-ubyte (n).
+class IdxFile {
+ public:
+  bool Open(const std::string &path) {
+    dims.clear();
+    if (!file.Open(path)) return false;
+
+    // Magic number: two zero bytes, the data type (0x08 = unsigned byte) and
+    // the number of dimensions, then one big endian uint32 per dimension.
+    const uint8_t *data = file.Data();
+    bool valid = file.Size() >= 4 && data[0] == 0 && data[1] == 0 &&
+                 data[2] == 0x08 && file.Size() >= 4 + 4 * (size_t)data[3];
+    if (valid) {
+      header_size = 4 + 4 * (size_t)data[3];
+      // The values must fit in the rest of the file. Dividing instead of
+      // multiplying keeps crafted dimensions from overflowing the count.
+      const size_t available = file.Size() - header_size;
+      size_t num_values = 1;
+      for (size_t i = 0; valid && i < data[3]; ++i) {
+        const uint8_t *p = data + 4 + 4 * i;
+        uint32_t dim = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+                       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+        dims.push_back(dim);
+        valid = dim == 0 || num_values <= available / dim;
+        num_values *= dim;
+      }
+    }
+    if (!valid) {
+      std::cerr << "Invalid IDX file: " << path << std::endl;
+      file.Close();
+      dims.clear();
+      return false;
+    }
+    return true;
+  }
+
+  size_t NumDims() const { return dims.size(); }
+  size_t Dim(size_t i) const { return dims[i]; }
+  const uint8_t *Data() const { return file.Data() + header_size; }
+
+ private:
+  MappedFile file;
+  std::vector<size_t> dims;
+  size_t header_size = 0;
+};
+
+}  // namespace afs
+
+#endif
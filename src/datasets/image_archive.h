@@ -0,0 +1,132 @@
+#ifndef IMAGE_ARCHIVE_H_
+#define IMAGE_ARCHIVE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "utils/mapped_file.h"
+
+namespace afs {
+
+// Compact binary image dataset (*.afsimg), used to cache datasets that are
+// slow to parse, loaded through mmap.
+//
+// Layout:
+//   ImageArchiveHeader                          64 bytes
+//   pixels: uint8[num_samples][channels][rows][cols], 64-byte aligned
+//   labels: uint8[num_samples] (if any), 64-byte aligned
+class ImageArchive {
+ public:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t has_labels;
+    uint64_t num_samples;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t channels;
+    uint32_t reserved0;
+    uint64_t pixels_offset;
+    uint64_t labels_offset;
+    uint64_t reserved1;
+  };
+  static_assert(sizeof(Header) == 64, "Unexpected header size");
+
+  // Write an archive. `labels` may be null. Returns false on I/O errors.
+  static bool Write(const std::string &path, size_t num_samples, size_t rows,
+                    size_t cols, size_t channels, const uint8_t *pixels,
+                    const uint8_t *labels) {
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(header.magic));
+    header.version = kVersion;
+    header.has_labels = labels != nullptr;
+    header.num_samples = num_samples;
+    header.rows = rows;
+    header.cols = cols;
+    header.channels = channels;
+    const size_t pixels_size = num_samples * rows * cols * channels;
+    header.pixels_offset = sizeof(Header);
+    header.labels_offset = AlignUp(header.pixels_offset + pixels_size);
+
+    std::string tmp_path = path + ".tmp";
+    std::FILE *file = std::fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr) {
+      std::cerr << "Error opening file: " << tmp_path << std::endl;
+      return false;
+    }
+    static const char kPadding[64] = {};
+    size_t padding = header.labels_offset - header.pixels_offset - pixels_size;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(pixels, 1, pixels_size, file) == pixels_size;
+    if (labels != nullptr) {
+      ok = ok && std::fwrite(kPadding, 1, padding, file) == padding &&
+           std::fwrite(labels, 1, num_samples, file) == num_samples;
+    }
+    ok = (std::fclose(file) == 0) && ok;
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      std::cerr << "Error writing file: " << path << std::endl;
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  bool Open(const std::string &path) {
+    header = nullptr;
+    if (!file.Open(path)) return false;
+    const Header *h = reinterpret_cast<const Header *>(file.Data());
+    const size_t size = file.Size();
+    bool valid = size >= sizeof(Header) &&
+                 std::memcmp(h->magic, kMagic, sizeof(h->magic)) == 0 &&
+                 h->version == kVersion && h->pixels_offset <= size &&
+                 (uint64_t)h->rows * h->cols * h->channels > 0 &&
+                 h->num_samples <= (size - h->pixels_offset) /
+                                       ((uint64_t)h->rows * h->cols * h->channels);
+    if (valid && h->has_labels) {
+      valid = h->labels_offset <= size &&
+              h->num_samples <= size - h->labels_offset;
+    }
+    if (!valid) {
+      std::cerr << "Invalid image archive: " << path << std::endl;
+      file.Close();
+      return false;
+    }
+    header = h;
+    return true;
+  }
+
+  size_t NumSamples() const { return header->num_samples; }
+  size_t Rows() const { return header->rows; }
+  size_t Cols() const { return header->cols; }
+  size_t Channels() const { return header->channels; }
+  size_t SampleSize() const { return Rows() * Cols() * Channels(); }
+  bool HasLabels() const { return header->has_labels; }
+
+  // Pixels of sample i, channel by channel, each channel row by row.
+  const uint8_t *GetPixels(size_t i) const {
+    return file.Data() + header->pixels_offset + i * SampleSize();
+  }
+  uint8_t GetLabel(size_t i) const {
+    return file.Data()[header->labels_offset + i];
+  }
+  const uint8_t *GetLabels() const {
+    return file.Data() + header->labels_offset;
+  }
+
+ private:
+  static constexpr char kMagic[8] = {'A', 'F', 'S', 'I', 'M', 'A', 'G', 'E'};
+  static constexpr uint32_t kVersion = 1;
+
+  static uint64_t AlignUp(uint64_t value) { return (value + 63) / 64 * 64; }
+
+  MappedFile file;
+  const Header *header = nullptr;
+};
+
+}  // namespace afs
+
+#endif
@@ -1,119 +1,241 @@
 #ifndef MNIST_H_
 #define MNIST_H_
 
+#include <unistd.h>
+
 #include <armadillo>
 #include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "datasets/dataset.h"
+#include "datasets/idx_file.h"
+#include "datasets/image_archive.h"
+#include "io/csv_parser.h"
+
+// MNIST dataset. Each split is read from, in order of preference:
+//   - <split>.afsimg, a binary cache of a previous run, through mmap
+//   - the IDX files of the original distribution
+//     (train-images-idx3-ubyte / train-labels-idx1-ubyte,
+//      t10k-images-idx3-ubyte / t10k-labels-idx1-ubyte)
+//   - the Kaggle CSV files (train.csv / test.csv)
+// and the cache is created the first time, so that only the first run pays
+// for parsing. A cache that is not 28 x 28 x 1, has labels out of range or
+// lacks the training labels is rebuilt. If the cache cannot be written, e.g.
+// in a read-only data folder, the parsed data is used from memory.
 class MNISTData {
  public:
   MNISTData(const std::string data_dir, double split_ratio = 0.9,
-            size_t max_n_train_samples = 0, bool use_train_for_val = false) {
+            size_t max_n_train_samples = 0, bool use_train_for_val = false,
+            uint64_t seed = 0) {
     assert(split_ratio <= 1 && split_ratio >= 0);
     this->data_dir = data_dir;
-    train_file = data_dir + "/train.csv";
-    test_file = data_dir + "/test.csv";
-
-    arma::mat train_data_raw;
-
-    train_data_raw.load(train_file, arma::csv_ascii);
-    train_data_raw = train_data_raw.submat(1, 0, train_data_raw.n_rows - 1,
-                                           train_data_raw.n_cols - 1);
-
-    std::vector<arma::cube> train_data_all;
-    std::vector<arma::vec> train_labels_all;
-    for (size_t idx = 0; idx < train_data_raw.n_rows; ++idx) {
-      int label = (int)(train_data_raw.row(idx)(0));
-      arma::cube img(28, 28, 1, arma::fill::zeros);
-      for (size_t r = 0; r < 28; ++r)
-        img.slice(0).row(r) =
-            train_data_raw.row(idx).subvec(28 * r + 1, 28 * r + 28);
-      img.slice(0) = arma::normalise(img.slice(0));
-      train_data_all.push_back(img);
-      arma::vec labelvec(10, arma::fill::zeros);
-      labelvec(label) += 1.0;
-      train_labels_all.push_back(labelvec);
-
-      if (max_n_train_samples != 0 &&
-          max_n_train_samples <= train_data_all.size())
-        break;
-    }
 
-    int num_examples = train_data_all.size();
-
-    // Shuffle the data
-    std::vector<arma::cube> train_data_all_shuffled;
-    std::vector<arma::vec> train_labels_all_shuffled;
-    std::vector<int> indexes;
-    indexes.reserve(train_data_all.size());
-    for (int i = 0; i < train_data_all.size(); ++i) indexes.push_back(i);
-    std::random_shuffle(indexes.begin(), indexes.end());
-    for (int i = 0; i < train_data_all.size(); ++i) {
-      train_data_all_shuffled.push_back(train_data_all[indexes[i]]);
-      train_labels_all_shuffled.push_back(train_labels_all[indexes[i]]);
+    // All splits are views over the mapped cache files, or over the parsed
+    // data if they could not be written; only their sample indices are
+    // shuffled and split.
+    Split train;
+    if (!LoadSplit("train", "train", true, train)) exit(1);
+    if (!train.labels) {
+      std::cerr << "MNIST training labels are missing" << std::endl;
+      exit(1);
     }
-    train_data_all = train_data_all_shuffled;
-    train_labels_all = train_labels_all_shuffled;
 
-    // Split train_data_all and train_labels_all into train and validation
-    // parts.
+    size_t num_examples = train.num_samples;
+    if (max_n_train_samples != 0 && max_n_train_samples < num_examples)
+      num_examples = max_n_train_samples;
+
+    afs::Dataset train_all(train.pixels, num_examples, 28, 28, 1);
+    train_all.SetLabels(train.labels, 10);
+    train_all.SetNormalization(1.0 / 255.0);
+    train_all.Shuffle(seed);
+
+    // Split train_all into train and validation parts.
     if (!use_train_for_val) {
-      train_data = std::vector<arma::cube>(
-          train_data_all.begin(),
-          train_data_all.begin() + num_examples * split_ratio);
-      train_labels = std::vector<arma::vec>(
-          train_labels_all.begin(),
-          train_labels_all.begin() + num_examples * split_ratio);
-
-      validation_data = std::vector<arma::cube>(
-          train_data_all.begin() + num_examples * split_ratio,
-          train_data_all.end());
-      validation_labels = std::vector<arma::vec>(
-          train_labels_all.begin() + num_examples * split_ratio,
-          train_labels_all.end());
+      train_all.Split(split_ratio, train_data, validation_data);
     } else {
-      train_data = train_data_all;
-      train_labels = train_labels_all;
-      validation_data = train_data_all;
-      validation_labels = train_labels_all;
+      train_data = train_all;
+      validation_data = train_all;
     }
 
-    arma::mat test_data_raw;
-    test_data_raw.load(test_file, arma::csv_ascii);
-    test_data_raw = test_data_raw.submat(1, 0, test_data_raw.n_rows - 1,
-                                         test_data_raw.n_cols - 1);
-    for (size_t idx = 0; idx < test_data_raw.n_rows; ++idx) {
-      arma::cube img(28, 28, 1, arma::fill::zeros);
-      for (size_t r = 0; r < 28; ++r)
-        img.slice(0).row(r) =
-            test_data_raw.row(idx).subvec(28 * r, 28 * r + 27);
-      img.slice(0) /= 255.0;
-      test_data.push_back(img);
-    }
+    Split test;
+    if (!LoadSplit("test", "t10k", false, test)) exit(1);
+    test_data = afs::Dataset(test.pixels, test.num_samples, 28, 28, 1);
+    if (test.labels) test_data.SetLabels(test.labels, 10);
+    test_data.SetNormalization(1.0 / 255.0);
   }
 
-  std::vector<arma::cube> getTrainData() { return train_data; }
-
-  std::vector<arma::cube> getValidationData() { return validation_data; }
+  // Samples with one-hot labels, as 28 x 28 x 1 cubes scaled to [0, 1].
+  const afs::Dataset &getTrainData() const { return train_data; }
 
-  std::vector<arma::cube> getTestData() { return test_data; }
+  const afs::Dataset &getValidationData() const { return validation_data; }
 
-  std::vector<arma::vec> getTrainLabels() { return train_labels; }
-
-  std::vector<arma::vec> getValidationLabels() { return validation_labels; }
+  // Labeled only when loaded from the IDX files.
+  const afs::Dataset &getTestData() const { return test_data; }
 
  private:
+  static const size_t kImageSize = 28 * 28;
+
   std::string data_dir;
-  std::string train_file;
-  std::string test_file;
 
-  std::vector<arma::cube> train_data;
-  std::vector<arma::cube> validation_data;
-  std::vector<arma::cube> test_data;
+  afs::Dataset train_data;
+  afs::Dataset validation_data;
+  afs::Dataset test_data;
+
+  static bool FileExists(const std::string &path) {
+    return access(path.c_str(), R_OK) == 0;
+  }
+
+  // Pixels and labels of a split. The pointers keep the mapped file or
+  // buffer they point into alive.
+  struct Split {
+    std::shared_ptr<const uint8_t> pixels;
+    // Null without labels.
+    std::shared_ptr<const uint8_t> labels;
+    size_t num_samples = 0;
+  };
+
+  static bool ValidLabels(const uint8_t *labels, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      if (labels[i] >= 10) return false;
+    }
+    return true;
+  }
+
+  // Write the parsed split to `cache_file` and use the mapped cache. Returns
+  // false if the cache cannot be written or read back.
+  static bool WriteCache(const std::string &cache_file, size_t num_samples,
+                         const uint8_t *pixels, const uint8_t *labels,
+                         Split &split) {
+    if (!afs::ImageArchive::Write(cache_file, num_samples, 28, 28, 1, pixels,
+                                  labels)) {
+      return false;
+    }
+    auto archive = std::make_shared<afs::ImageArchive>();
+    if (!archive->Open(cache_file)) return false;
+    split.pixels = std::shared_ptr<const uint8_t>(archive,
+                                                  archive->GetPixels(0));
+    if (archive->HasLabels()) {
+      split.labels = std::shared_ptr<const uint8_t>(archive,
+                                                    archive->GetLabels());
+    }
+    split.num_samples = archive->NumSamples();
+    return true;
+  }
 
-  std::vector<arma::vec> train_labels;
-  std::vector<arma::vec> validation_labels;
+  // Load <split>.afsimg, creating it from the IDX (<idx_prefix>-*-idx*-ubyte)
+  // or CSV (<split>.csv) files if needed.
+  bool LoadSplit(const std::string &split_name, const std::string &idx_prefix,
+                 bool csv_has_labels, Split &split) {
+    const std::string cache_file = data_dir + "/" + split_name + ".afsimg";
+    auto archive = std::make_shared<afs::ImageArchive>();
+    if (FileExists(cache_file) && archive->Open(cache_file)) {
+      // A cache left by another dataset or version is rebuilt, like one that
+      // cannot be read.
+      if (archive->Rows() == 28 && archive->Cols() == 28 &&
+          archive->Channels() == 1 &&
+          (archive->HasLabels()
+               ? ValidLabels(archive->GetLabels(), archive->NumSamples())
+               : !csv_has_labels)) {
+        split.pixels = std::shared_ptr<const uint8_t>(archive,
+                                                      archive->GetPixels(0));
+        if (archive->HasLabels()) {
+          split.labels = std::shared_ptr<const uint8_t>(archive,
+                                                        archive->GetLabels());
+        }
+        split.num_samples = archive->NumSamples();
+        return true;
+      }
+      std::cerr << "Ignoring the MNIST cache " << cache_file
+                << " with unexpected shape or labels, rebuilding it"
+                << std::endl;
+      archive.reset();
+    }
+
+    const std::string idx_images =
+        data_dir + "/" + idx_prefix + "-images-idx3-ubyte";
+    const std::string idx_labels =
+        data_dir + "/" + idx_prefix + "-labels-idx1-ubyte";
+    const std::string csv_file = data_dir + "/" + split_name + ".csv";
+
+    if (FileExists(idx_images)) {
+      auto images = std::make_shared<afs::IdxFile>();
+      auto labels = std::make_shared<afs::IdxFile>();
+      if (!images->Open(idx_images)) return false;
+      bool has_labels = FileExists(idx_labels) && labels->Open(idx_labels);
+      if (images->NumDims() != 3 || images->Dim(1) != 28 ||
+          images->Dim(2) != 28 ||
+          (has_labels && (labels->NumDims() != 1 ||
+                          labels->Dim(0) != images->Dim(0)))) {
+        std::cerr << "Unexpected MNIST shape in " << idx_images << std::endl;
+        return false;
+      }
+      const size_t num_samples = images->Dim(0);
+      if (has_labels && !ValidLabels(labels->Data(), num_samples)) {
+        std::cerr << "MNIST labels out of range in " << idx_labels
+                  << std::endl;
+        return false;
+      }
+      if (WriteCache(cache_file, num_samples, images->Data(),
+                     has_labels ? labels->Data() : nullptr, split)) {
+        return true;
+      }
+      // Use the mapped IDX files directly.
+      split.pixels = std::shared_ptr<const uint8_t>(images, images->Data());
+      if (has_labels) {
+        split.labels = std::shared_ptr<const uint8_t>(labels, labels->Data());
+      }
+      split.num_samples = num_samples;
+    } else {
+      std::vector<float> raw;
+      afs::CsvOptions options;
+      options.header = afs::CsvOptions::Header::kPresent;
+      afs::CsvParser parser(options);
+      const size_t first_pixel = csv_has_labels ? 1 : 0;
+      if (!parser.Parse(csv_file, raw)) return false;
+      if (parser.NumCols() != first_pixel + kImageSize) {
+        std::cerr << "Unexpected MNIST shape in " << csv_file << std::endl;
+        return false;
+      }
+      const size_t num_samples = parser.NumRows();
+      const size_t num_cols = parser.NumCols();
+      auto pixels = std::make_shared<std::vector<uint8_t>>(num_samples *
+                                                           kImageSize);
+      auto labels = std::make_shared<std::vector<uint8_t>>(num_samples);
+      for (size_t i = 0; i < num_samples; ++i) {
+        for (size_t j = 0; j < num_cols; ++j) {
+          const float value = raw[i * num_cols + j];
+          const bool is_label = j < first_pixel;
+          if (!(value >= 0.0f && value <= (is_label ? 9.0f : 255.0f))) {
+            std::cerr << "MNIST value out of range in " << csv_file
+                      << ", row " << i + 1 << ": " << value << std::endl;
+            return false;
+          }
+          if (is_label) {
+            (*labels)[i] = value;
+          } else {
+            (*pixels)[i * kImageSize + j - first_pixel] = value;
+          }
+        }
+      }
+      if (WriteCache(cache_file, num_samples, pixels->data(),
+                     csv_has_labels ? labels->data() : nullptr, split)) {
+        return true;
+      }
+      // Use the parsed values from memory.
+      split.pixels = std::shared_ptr<const uint8_t>(pixels, pixels->data());
+      if (csv_has_labels) {
+        split.labels = std::shared_ptr<const uint8_t>(labels, labels->data());
+      }
+      split.num_samples = num_samples;
+    }
+    std::cerr << "Warning: could not write the MNIST cache " << cache_file
+              << ", using the data without caching it" << std::endl;
+    return true;
+  }
 };
 
-#endif
\ No newline at end of file
+#endif
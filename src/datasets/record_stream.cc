@@ -0,0 +1,195 @@
+#include "record_stream.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+#include "utils/alloc_profiler.h"
+#include "utils/trace.h"
+
+namespace afs {
+
+RecordStream::RecordStream(const std::vector<std::string> &shards,
+                           size_t shuffle_buffer_size, uint64_t seed,
+                           bool strict)
+    : shards(shards),
+      shuffle_buffer_size(shuffle_buffer_size),
+      rng(seed),
+      strict(strict) {
+  Reset();
+}
+
+void RecordStream::Reset() {
+  buffer.clear();
+  current.reset();
+  prefetched.reset();
+  next_record = 0;
+  next_shard = 0;
+  num_batches = 0;
+  failed = false;
+
+  order.resize(shards.size());
+  std::iota(order.begin(), order.end(), 0);
+  if (shuffle_buffer_size > 0) std::shuffle(order.begin(), order.end(), rng);
+}
+
+bool RecordStream::Next(arma::cube &input, arma::vec &target) {
+  const size_t capacity = std::max<size_t>(shuffle_buffer_size, 1);
+  Entry entry;
+  while (buffer.size() < capacity && Fetch(entry)) buffer.push_back(entry);
+  if (buffer.empty()) return false;
+
+  const size_t j = shuffle_buffer_size > 0 ? rng() % buffer.size() : 0;
+  Decode(buffer[j], input, target);
+  buffer[j] = buffer.back();
+  buffer.pop_back();
+  return true;
+}
+
+size_t RecordStream::NextBatch(Batch &batch, size_t batch_size) {
+  AFS_TRACE_SCOPE("RecordStream::NextBatch");
+  AFS_ALLOC_SCOPE("RecordStream", this, kData);
+  if (batch.inputs.size() < batch_size) {
+    batch.inputs.resize(batch_size);
+    batch.targets.resize(batch_size);
+  }
+  batch.size = 0;
+  while (batch.size < batch_size &&
+         Next(batch.inputs[batch.size], batch.targets[batch.size])) {
+    ++batch.size;
+  }
+  batch.index = num_batches++;
+  return batch.size;
+}
+
+bool RecordStream::Fetch(Entry &entry) {
+  while (true) {
+    while (!current || next_record == current->NumRecords()) {
+      if (!OpenNextShard()) return false;
+    }
+    entry.shard = current;
+    entry.data = current->GetRecord(next_record, entry.size);
+    if (ValidRecord(entry)) {
+      ++next_record;
+      return true;
+    }
+    // A short record or an out-of-range label means the shard is corrupt or
+    // was not written for this schema; treat it like a shard that cannot be
+    // opened.
+    std::cerr << (strict ? "Invalid record "
+                         : "Skipping shard at invalid record ")
+              << next_record << " of " << current_path << std::endl;
+    failed = strict;
+    current.reset();
+  }
+}
+
+bool RecordStream::ValidRecord(const Entry &entry) const {
+  const RecordSchema &schema = entry.shard->GetSchema();
+  if (entry.size < schema.TargetBytes() + schema.SampleBytes()) return false;
+  return schema.num_classes == 0 || entry.data[0] < schema.num_classes;
+}
+
+bool RecordStream::OpenNextShard() {
+  current.reset();
+  while (next_shard < order.size() && !failed) {
+    const std::string &path = shards[order[next_shard++]];
+    std::shared_ptr<RecordReader> reader = prefetched;
+    prefetched.reset();
+    if (!reader) {
+      reader = std::make_shared<RecordReader>();
+      if (!reader->Open(path)) {
+        failed = strict;
+        continue;
+      }
+    }
+
+    const RecordSchema &shard_schema = reader->GetSchema();
+    if (has_schema && (shard_schema.SampleBytes() != schema.SampleBytes() ||
+                       shard_schema.num_classes != schema.num_classes ||
+                       shard_schema.target_size != schema.target_size)) {
+      std::cerr << (strict ? "Shard with a different schema: "
+                           : "Skipping shard with a different schema: ")
+                << path << std::endl;
+      failed = strict;
+      continue;
+    }
+    schema = shard_schema;
+    has_schema = true;
+
+    current = reader;
+    current_path = path;
+    next_record = 0;
+    current->Advise(MADV_SEQUENTIAL);
+
+    // Read the following shard ahead while this one is consumed.
+    if (next_shard < order.size()) {
+      std::shared_ptr<RecordReader> next = std::make_shared<RecordReader>();
+      if (next->Open(shards[order[next_shard]])) {
+        next->Advise(MADV_WILLNEED);
+        prefetched = next;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+void RecordStream::Decode(const Entry &entry, arma::cube &input,
+                          arma::vec &target) const {
+  const RecordSchema &schema = entry.shard->GetSchema();
+  // Checked by Fetch().
+  assert(ValidRecord(entry));
+
+  const uint8_t *data = entry.data;
+  if (schema.num_classes > 0) {
+    target.zeros(schema.num_classes);
+    target(data[0]) = 1.0;
+  } else {
+    target.set_size(schema.target_size);
+    for (size_t j = 0; j < schema.target_size; ++j) {
+      float value;
+      std::memcpy(&value, data + j * sizeof(float), sizeof(float));
+      target(j) = value;
+    }
+  }
+  data += schema.TargetBytes();
+
+  // Convert from [channels][rows][cols] to the column-major cube layout.
+  const size_t rows = schema.rows;
+  const size_t cols = schema.cols;
+  input.set_size(rows, cols, schema.channels);
+  double *values = input.memptr();
+  for (size_t s = 0; s < schema.channels; ++s) {
+    for (size_t r = 0; r < rows; ++r) {
+      for (size_t c = 0; c < cols; ++c) {
+        const size_t index = (s * rows + r) * cols + c;
+        double raw;
+        if (schema.data_type == RecordDataType::kUInt8) {
+          raw = data[index];
+        } else {
+          float value;
+          std::memcpy(&value, data + index * sizeof(float), sizeof(float));
+          raw = value;
+        }
+        values[(s * cols + c) * rows + r] = raw * schema.scale + schema.offset;
+      }
+    }
+  }
+
+  if (schema.l2_normalize) {
+    double norm = 0.0;
+    for (size_t j = 0; j < input.n_elem; ++j) norm += values[j] * values[j];
+    norm = std::sqrt(norm);
+    if (norm > 0.0) {
+      for (size_t j = 0; j < input.n_elem; ++j) values[j] /= norm;
+    }
+  }
+}
+
+}  // namespace afs
@@ -0,0 +1,89 @@
+#ifndef RECORD_STREAM_H_
+#define RECORD_STREAM_H_
+
+#include <armadillo>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "datasets/data_loader.h"
+#include "io/record_file.h"
+
+namespace afs {
+
+// Streams the samples of a sharded *.afsrec dataset, so that datasets
+// larger than memory can be trained on.
+//
+// Shards are read sequentially through mmap, and the next shard is read
+// ahead while the current one is consumed. Samples go through a bounded
+// shuffle buffer: each sample returned is drawn at random from the next
+// `shuffle_buffer_size` ones, and the shard order is shuffled every epoch.
+// Only the shards with samples in the buffer stay mapped.
+class RecordStream {
+ public:
+  // With shuffle_buffer_size = 0, samples come out in storage order.
+  // Shards that cannot be opened or have a different schema are skipped
+  // with a message, and so is the rest of a shard from its first record that
+  // is shorter than the schema or has a label out of range. With `strict`,
+  // the epoch ends at the first such shard instead and Failed() returns
+  // true.
+  RecordStream(const std::vector<std::string> &shards,
+               size_t shuffle_buffer_size = 0, uint64_t seed = 0,
+               bool strict = false);
+
+  // Restart from the beginning, for a new epoch.
+  void Reset();
+
+  // The next sample as a rows x cols x channels cube and its target
+  // (one-hot for class labels). Returns false at the end of the epoch.
+  bool Next(arma::cube &input, arma::vec &target);
+
+  // Fill `batch` with up to `batch_size` samples. Returns the number of
+  // samples read, 0 at the end of the epoch.
+  size_t NextBatch(Batch &batch, size_t batch_size);
+
+  // Schema of the shards, valid once the first shard is open.
+  const RecordSchema &GetSchema() const { return schema; }
+
+  // In strict mode, whether the current epoch stopped at a bad shard or
+  // record.
+  bool Failed() const { return failed; }
+
+ private:
+  struct Entry {
+    std::shared_ptr<RecordReader> shard;
+    const uint8_t *data;
+    size_t size;
+  };
+
+  bool Fetch(Entry &entry);
+  // Whether the record holds a whole sample with a valid label.
+  bool ValidRecord(const Entry &entry) const;
+  bool OpenNextShard();
+  void Decode(const Entry &entry, arma::cube &input, arma::vec &target) const;
+
+  std::vector<std::string> shards;
+  size_t shuffle_buffer_size;
+  std::mt19937_64 rng;
+  bool strict;
+  bool failed = false;
+
+  // Shard order of the current epoch, and the next shard to open.
+  std::vector<size_t> order;
+  size_t next_shard = 0;
+  std::shared_ptr<RecordReader> current;
+  std::string current_path;
+  size_t next_record = 0;
+  // The shard after the current one, already opened and read ahead.
+  std::shared_ptr<RecordReader> prefetched;
+
+  RecordSchema schema;
+  bool has_schema = false;
+  std::vector<Entry> buffer;
+  size_t num_batches = 0;
+};
+
+}  // namespace afs
+
+#endif
@@ -0,0 +1,124 @@
+#include "background_validator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace afs {
+
+BackgroundValidator::BackgroundValidator(const Dataset &dataset,
+                                         size_t num_classes,
+                                         LossFunction loss,
+                                         size_t num_threads)
+    : dataset(dataset),
+      num_classes(num_classes),
+      loss(std::move(loss)),
+      num_threads(num_threads) {
+  if (this->num_threads == 0) {
+    this->num_threads =
+        std::max<size_t>(1, std::thread::hardware_concurrency() / 2);
+  }
+  worker = std::thread(&BackgroundValidator::Run, this);
+}
+
+BackgroundValidator::~BackgroundValidator() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  condition.notify_all();
+  worker.join();
+}
+
+InferenceModel &BackgroundValidator::GetBuffer() {
+  {
+    // The worker evaluates at most one buffer at a time, so the other one is
+    // free once the pending snapshot has been picked up.
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return !pending; });
+  }
+  buffers[fill_index].Clear();
+  return buffers[fill_index];
+}
+
+void BackgroundValidator::Submit(size_t step) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = true;
+    pending_index = fill_index;
+    pending_step = step;
+  }
+  fill_index = 1 - fill_index;
+  condition.notify_all();
+}
+
+bool BackgroundValidator::Poll(ValidationResult &result) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (results.empty()) return false;
+  result = std::move(results.front());
+  results.pop_front();
+  return true;
+}
+
+void BackgroundValidator::Wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  condition.wait(lock, [this] { return !pending && !evaluating; });
+}
+
+void BackgroundValidator::Run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    condition.wait(lock, [this] { return pending || stop; });
+    if (!pending) return;
+
+    int index = pending_index;
+    ValidationResult result;
+    result.step = pending_step;
+    pending = false;
+    evaluating = true;
+    // Wake up a GetBuffer() waiting for the other buffer.
+    condition.notify_all();
+
+    lock.unlock();
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    result.metrics = Evaluate(buffers[index]);
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    result.seconds = elapsed.count();
+    lock.lock();
+
+    evaluating = false;
+    results.push_back(std::move(result));
+    condition.notify_all();
+  }
+}
+
+RunningMetrics BackgroundValidator::Evaluate(
+    const InferenceModel &model) const {
+  RunningMetrics metrics(num_classes);
+  const size_t size = dataset.Size();
+  // The model is only read, so each thread only needs its own activations.
+  // This team belongs to the worker thread and is separate from the one
+  // training uses.
+  #pragma omp parallel num_threads(num_threads)
+  {
+    InferenceModel::Scratch scratch;
+    arma::cube sample;
+    arma::vec target, prediction;
+    RunningMetrics thread_metrics(num_classes);
+    #pragma omp for schedule(dynamic, 64) nowait
+    for (size_t i = 0; i < size; ++i) {
+      dataset.GetSample(i, sample);
+      dataset.GetTarget(i, target);
+      model.Predict(sample, prediction, scratch);
+      thread_metrics.Add(prediction, target, loss(prediction, target));
+    }
+    #pragma omp critical(afs_background_validator)
+    metrics.Merge(thread_metrics);
+  }
+  return metrics;
+}
+
+}  // namespace afs
@@ -0,0 +1,108 @@
+#ifndef BACKGROUND_VALIDATOR_H_
+#define BACKGROUND_VALIDATOR_H_
+
+#include <armadillo>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "datasets/dataset.h"
+#include "inference/inference_model.h"
+#include "utils/running_metrics.h"
+
+namespace afs {
+
+// The metrics of one snapshot on the validation set.
+struct ValidationResult {
+  // As given to Submit(), e.g. the epoch or step the snapshot was taken at.
+  size_t step = 0;
+  RunningMetrics metrics;
+  // Wall time of the evaluation.
+  double seconds = 0.0;
+};
+
+// Evaluates snapshots of a network on a validation set on background threads
+// while training continues.
+//
+// At an epoch boundary the trainer copies the layers into one of two
+// InferenceModel buffers and submits it. The copy is not touched by training,
+// so the next epoch can start right away while a worker thread evaluates the
+// snapshot with a team of `num_threads` OpenMP threads. The results are
+// queued and collected with Poll() whenever the trainer gets to it.
+//
+// If a snapshot is still waiting for the worker, GetBuffer() blocks until it
+// is picked up, so that every submitted snapshot gets evaluated. This only
+// happens when validation takes longer than the interval between snapshots.
+//
+// Usage:
+//   BackgroundValidator validator(validation_data, 10, loss);
+//   ... at the end of each epoch:
+//   InferenceModel &snapshot = validator.GetBuffer();
+//   snapshot.Add(layer1);
+//   ...
+//   validator.Submit(epoch);
+//   ... once per batch, and after Wait() at the end:
+//   ValidationResult result;
+//   while (validator.Poll(result)) ... result.metrics ...
+class BackgroundValidator {
+ public:
+  // Loss of one prediction given its target.
+  typedef std::function<double(const arma::vec &prediction,
+                               const arma::vec &target)>
+      LossFunction;
+
+  // `dataset` must outlive the validator and not change while it is
+  // evaluated. Predictions count as correct when their largest entry is the
+  // one of the target, see RunningMetrics. The threads evaluating compete
+  // with training for the cores: by default, half of them are used.
+  BackgroundValidator(const Dataset &dataset, size_t num_classes,
+                      LossFunction loss, size_t num_threads = 0);
+  // Waits for the submitted snapshots to be evaluated.
+  ~BackgroundValidator();
+
+  BackgroundValidator(const BackgroundValidator &) = delete;
+  BackgroundValidator &operator=(const BackgroundValidator &) = delete;
+
+  // The free buffer, cleared. Fill it, then call Submit().
+  InferenceModel &GetBuffer();
+
+  // Queue the filled buffer to be evaluated. `step` is passed through to the
+  // result.
+  void Submit(size_t step);
+
+  // Take the oldest result not taken yet. Returns false if there is none.
+  bool Poll(ValidationResult &result);
+
+  // Block until all submitted snapshots are evaluated.
+  void Wait();
+
+ private:
+  void Run();
+  RunningMetrics Evaluate(const InferenceModel &model) const;
+
+  const Dataset &dataset;
+  size_t num_classes;
+  LossFunction loss;
+  size_t num_threads;
+
+  InferenceModel buffers[2];
+  // Buffer filled by the trainer. The other one may be in use by the worker.
+  int fill_index = 0;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool pending = false;
+  bool evaluating = false;
+  bool stop = false;
+  int pending_index = 0;
+  size_t pending_step = 0;
+  std::deque<ValidationResult> results;
+
+  std::thread worker;
+};
+
+}  // namespace afs
+
+#endif
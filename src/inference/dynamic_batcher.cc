@@ -0,0 +1,108 @@
+#include "dynamic_batcher.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace afs {
+
+DynamicBatcher::DynamicBatcher(const InferenceModel &model,
+                               size_t max_batch_size, long max_wait_us,
+                               InferenceCache *cache)
+    : model(model),
+      cache(cache),
+      max_batch_size(max_batch_size),
+      max_wait(max_wait_us) {
+  assert(max_batch_size > 0);
+  worker = std::thread(&DynamicBatcher::Run, this);
+}
+
+DynamicBatcher::~DynamicBatcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  condition.notify_all();
+  worker.join();
+}
+
+std::future<arma::vec> DynamicBatcher::Submit(arma::cube input) {
+  if (cache != nullptr) {
+    Clock::time_point arrival = Clock::now();
+    arma::vec output;
+    if (cache->Lookup(InferenceCache::HashInput(input), output)) {
+      std::promise<arma::vec> result;
+      result.set_value(std::move(output));
+      std::chrono::duration<double, std::micro> elapsed =
+          Clock::now() - arrival;
+      latency.Record(elapsed.count());
+      return result.get_future();
+    }
+  }
+
+  Request request;
+  request.input = std::move(input);
+  request.arrival = Clock::now();
+  std::future<arma::vec> result = request.result.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(std::move(request));
+  }
+  condition.notify_one();
+  return result;
+}
+
+double DynamicBatcher::GetAverageBatchSize() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return num_batches > 0 ? (double)num_requests / num_batches : 0.0;
+}
+
+void DynamicBatcher::Run() {
+  std::vector<Request> batch;
+  std::vector<arma::cube> inputs;
+  std::vector<arma::vec> outputs;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this] { return stop || !queue.empty(); });
+      if (queue.empty()) return;
+
+      // Wait for the batch to fill up, but no longer than the latency budget
+      // of the oldest request.
+      Clock::time_point deadline = queue.front().arrival + max_wait;
+      condition.wait_until(lock, deadline, [this] {
+        return stop || queue.size() >= max_batch_size;
+      });
+
+      size_t batch_size = std::min(queue.size(), max_batch_size);
+      batch.clear();
+      for (size_t i = 0; i < batch_size; ++i) {
+        batch.push_back(std::move(queue.front()));
+        queue.pop_front();
+      }
+      ++num_batches;
+      num_requests += batch_size;
+    }
+
+    inputs.resize(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+      inputs[i] = std::move(batch[i].input);
+    }
+    if (cache != nullptr) {
+      // The requests were counted by the lookup in Submit().
+      cache->PredictBatch(model, inputs, outputs, false);
+    } else {
+      model.PredictBatch(inputs, outputs);
+    }
+
+    Clock::time_point done = Clock::now();
+    for (size_t i = 0; i < batch.size(); ++i) {
+      batch[i].result.set_value(std::move(outputs[i]));
+      std::chrono::duration<double, std::micro> elapsed =
+          done - batch[i].arrival;
+      latency.Record(elapsed.count());
+    }
+  }
+}
+
+}  // namespace afs
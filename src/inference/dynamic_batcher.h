@@ -0,0 +1,75 @@
+#ifndef DYNAMIC_BATCHER_H_
+#define DYNAMIC_BATCHER_H_
+
+#include <armadillo>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "inference/inference_cache.h"
+#include "inference/inference_model.h"
+#include "utils/latency_recorder.h"
+
+namespace afs {
+
+// Coalesces concurrent prediction requests into minibatches.
+//
+// A batch is run as soon as `max_batch_size` requests are queued, or when
+// the oldest queued request has waited `max_wait_us` microseconds. Batches
+// are taken by one worker thread, and the samples of a batch are predicted
+// in parallel.
+//
+// With a cache, hits are answered in Submit() without queueing, and
+// duplicates inside a batch are computed once.
+class DynamicBatcher {
+ public:
+  DynamicBatcher(const InferenceModel &model, size_t max_batch_size,
+                 long max_wait_us, InferenceCache *cache = nullptr);
+  ~DynamicBatcher();
+
+  DynamicBatcher(const DynamicBatcher &) = delete;
+  DynamicBatcher &operator=(const DynamicBatcher &) = delete;
+
+  // Queue one input. Can be called from any thread.
+  std::future<arma::vec> Submit(arma::cube input);
+
+  // Request latency (queueing + compute) and throughput.
+  LatencyRecorder &GetLatency() { return latency; }
+  // Average number of requests per executed batch.
+  double GetAverageBatchSize();
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Request {
+    arma::cube input;
+    std::promise<arma::vec> result;
+    Clock::time_point arrival;
+  };
+
+  void Run();
+
+  const InferenceModel &model;
+  InferenceCache *cache;
+  size_t max_batch_size;
+  std::chrono::microseconds max_wait;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<Request> queue;
+  bool stop = false;
+
+  size_t num_batches = 0;
+  size_t num_requests = 0;
+
+  LatencyRecorder latency;
+  std::thread worker;
+};
+
+}  // namespace afs
+
+#endif
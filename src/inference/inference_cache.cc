@@ -0,0 +1,150 @@
+#include "inference_cache.h"
+
+#include "utils/hash.h"
+
+namespace afs {
+
+namespace {
+
+// Rough per-entry overhead of the list node, the hash map node and the
+// armadillo object on top of the output values.
+const size_t kEntryOverhead = 128;
+
+}  // namespace
+
+InferenceCache::InferenceCache(size_t max_bytes) : max_bytes(max_bytes) {}
+
+uint64_t InferenceCache::HashInput(const arma::cube &input) {
+  return Hash::Compute(input.memptr(), input.n_elem * sizeof(double));
+}
+
+bool InferenceCache::Lookup(uint64_t key, arma::vec &output) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = index.find(key);
+  if (it == index.end()) {
+    ++misses;
+    return false;
+  }
+  ++hits;
+  entries.splice(entries.begin(), entries, it->second);
+  output = it->second->output;
+  return true;
+}
+
+void InferenceCache::Insert(uint64_t key, const arma::vec &output) {
+  std::lock_guard<std::mutex> lock(mutex);
+  InsertLocked(key, output);
+}
+
+void InferenceCache::InsertLocked(uint64_t key, const arma::vec &output) {
+  size_t num_bytes = kEntryOverhead + output.n_elem * sizeof(double);
+  if (num_bytes > max_bytes) return;
+
+  auto it = index.find(key);
+  if (it != index.end()) {
+    used_bytes -= it->second->num_bytes;
+    entries.erase(it->second);
+    index.erase(it);
+  }
+
+  while (used_bytes + num_bytes > max_bytes && !entries.empty()) {
+    used_bytes -= entries.back().num_bytes;
+    index.erase(entries.back().key);
+    entries.pop_back();
+    ++evictions;
+  }
+
+  entries.push_front({key, output, num_bytes});
+  index[key] = entries.begin();
+  used_bytes += num_bytes;
+}
+
+void InferenceCache::Predict(const InferenceModel &model,
+                             const arma::cube &input, arma::vec &output) {
+  uint64_t key = HashInput(input);
+  if (Lookup(key, output)) return;
+  model.Predict(input, output);
+  Insert(key, output);
+}
+
+void InferenceCache::PredictBatch(const InferenceModel &model,
+                                  const std::vector<arma::cube> &inputs,
+                                  std::vector<arma::vec> &outputs,
+                                  bool count_lookups) {
+  outputs.resize(inputs.size());
+
+  // Resolve hits and collapse duplicates: each distinct missing input is
+  // computed once and copied to all its positions.
+  std::vector<uint64_t> keys(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) keys[i] = HashInput(inputs[i]);
+
+  std::unordered_map<uint64_t, size_t> miss_slot;
+  std::vector<size_t> slot_of(inputs.size(), SIZE_MAX);
+  std::vector<arma::cube> miss_inputs;
+  std::vector<uint64_t> miss_keys;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      auto pending = miss_slot.find(keys[i]);
+      if (pending != miss_slot.end()) {
+        // Duplicate of an input already scheduled in this batch.
+        if (count_lookups) ++hits;
+        slot_of[i] = pending->second;
+        continue;
+      }
+      auto it = index.find(keys[i]);
+      if (it != index.end()) {
+        if (count_lookups) ++hits;
+        entries.splice(entries.begin(), entries, it->second);
+        outputs[i] = it->second->output;
+        continue;
+      }
+      if (count_lookups) ++misses;
+      slot_of[i] = miss_inputs.size();
+      miss_slot[keys[i]] = miss_inputs.size();
+      miss_inputs.push_back(inputs[i]);
+      miss_keys.push_back(keys[i]);
+    }
+  }
+
+  if (miss_inputs.empty()) return;
+
+  std::vector<arma::vec> miss_outputs;
+  model.PredictBatch(miss_inputs, miss_outputs);
+
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (slot_of[i] != SIZE_MAX) outputs[i] = miss_outputs[slot_of[i]];
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (size_t j = 0; j < miss_outputs.size(); ++j) {
+    InsertLocked(miss_keys[j], miss_outputs[j]);
+  }
+}
+
+size_t InferenceCache::GetHits() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return hits;
+}
+
+size_t InferenceCache::GetMisses() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return misses;
+}
+
+size_t InferenceCache::GetEvictions() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return evictions;
+}
+
+size_t InferenceCache::GetMemoryUsage() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return used_bytes;
+}
+
+size_t InferenceCache::Size() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return entries.size();
+}
+
+}  // namespace afs
@@ -0,0 +1,70 @@
+#ifndef INFERENCE_CACHE_H_
+#define INFERENCE_CACHE_H_
+
+#include <armadillo>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "inference/inference_model.h"
+
+namespace afs {
+
+// Bounded LRU cache of model outputs, keyed by a 64-bit hash of the input
+// values. Inputs are not stored, so two different inputs with the same hash
+// would share an entry; with a 64-bit hash this is negligible for caches of
+// practical size. Thread-safe.
+class InferenceCache {
+ public:
+  // `max_bytes` caps the estimated memory used by the cached entries.
+  explicit InferenceCache(size_t max_bytes);
+
+  static uint64_t HashInput(const arma::cube &input);
+
+  bool Lookup(uint64_t key, arma::vec &output);
+  void Insert(uint64_t key, const arma::vec &output);
+
+  // Predict through the cache.
+  void Predict(const InferenceModel &model, const arma::cube &input,
+               arma::vec &output);
+  // Predict a batch through the cache. Inputs that are duplicates of each
+  // other are computed once, and only the misses are sent to the model.
+  // Pass `count_lookups = false` if the inputs were already counted by an
+  // earlier Lookup().
+  void PredictBatch(const InferenceModel &model,
+                    const std::vector<arma::cube> &inputs,
+                    std::vector<arma::vec> &outputs,
+                    bool count_lookups = true);
+
+  size_t GetHits();
+  size_t GetMisses();
+  size_t GetEvictions();
+  size_t GetMemoryUsage();
+  size_t Size();
+
+ private:
+  struct Entry {
+    uint64_t key;
+    arma::vec output;
+    size_t num_bytes;
+  };
+
+  void InsertLocked(uint64_t key, const arma::vec &output);
+
+  size_t max_bytes;
+  size_t used_bytes = 0;
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t evictions = 0;
+
+  // Most recently used entry first.
+  std::list<Entry> entries;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+  std::mutex mutex;
+};
+
+}  // namespace afs
+
+#endif
@@ -0,0 +1,264 @@
+#include "inference_model.h"
+
+#include <cassert>
+#include <iostream>
+#include <utility>
+
+#include "utils/data_transformer.h"
+
+namespace afs {
+
+bool InferenceModel::Load(const std::string &checkpoint_path) {
+  std::shared_ptr<Checkpoint> loaded = std::make_shared<Checkpoint>();
+  if (!loaded->Load(checkpoint_path)) return false;
+  const Checkpoint &checkpoint = *loaded;
+
+  layers.clear();
+  this->checkpoint = loaded;
+  // The layers are constructed in place and never move afterwards, so the
+  // views of the blobs stay bound to the mapping.
+  layers.reserve(checkpoint.NumLayers());
+
+  // Track the activation shape through the network to find the input and
+  // output sizes, and check that each layer takes the output of the one
+  // before. Layers on 3D data after one on 3D data need the same shape,
+  // other layers the same number of values.
+  bool input_known = false;
+  bool is_cube = false;
+  size_t height = 0, width = 0, depth = 0;
+  bool shapes_match = true;
+  auto set_input = [&](size_t h, size_t w, size_t d, bool cube) {
+    if (!input_known) {
+      input_height = h;
+      input_width = w;
+      input_depth = d;
+      input_known = true;
+    } else if (cube && is_cube) {
+      shapes_match = shapes_match && h == height && w == width && d == depth;
+    } else {
+      shapes_match = shapes_match && h * w * d == height * width * depth;
+    }
+    is_cube = cube;
+  };
+
+  for (size_t i = 0; i < checkpoint.NumLayers(); ++i) {
+    const LayerRecord &record = checkpoint.GetLayer(i);
+    switch (checkpoint.GetLayerType(i)) {
+      case LayerType::kConv2D:
+        set_input(record.shape[0], record.shape[1], record.shape[2], true);
+        layers.emplace_back(std::in_place_type<Conv2D>, record.shape[0],
+                            record.shape[1], record.shape[2], record.shape[3],
+                            record.shape[4], record.shape[5], record.shape[6],
+                            record.shape[7], checkpoint.GetBlob(i, 0));
+        height = (record.shape[0] - record.shape[3]) / record.shape[6] + 1;
+        width = (record.shape[1] - record.shape[4]) / record.shape[5] + 1;
+        depth = record.shape[7];
+        break;
+      case LayerType::kDense:
+        set_input(record.shape[0], 1, 1, false);
+        layers.emplace_back(std::in_place_type<Dense>, record.shape[0],
+                            record.shape[1], checkpoint.GetBlob(i, 0),
+                            checkpoint.GetBlob(i, 1));
+        height = record.shape[1];
+        width = depth = 1;
+        break;
+      case LayerType::kMaxPooling:
+        set_input(record.shape[0], record.shape[1], record.shape[2], true);
+        layers.emplace_back(checkpoint.MakeMaxPooling(i));
+        height = (record.shape[0] - record.shape[3]) / record.shape[5] + 1;
+        width = (record.shape[1] - record.shape[4]) / record.shape[6] + 1;
+        depth = record.shape[2];
+        break;
+      case LayerType::kReLU:
+        set_input(record.shape[0], record.shape[1], record.shape[2], true);
+        layers.emplace_back(checkpoint.MakeReLU(i));
+        height = record.shape[0];
+        width = record.shape[1];
+        depth = record.shape[2];
+        break;
+      case LayerType::kSigmoid:
+        set_input(record.shape[0], 1, 1, false);
+        layers.emplace_back(checkpoint.MakeSigmoid(i));
+        height = record.shape[0];
+        width = depth = 1;
+        break;
+      case LayerType::kSoftmax:
+        set_input(record.shape[0], 1, 1, false);
+        layers.emplace_back(checkpoint.MakeSoftmax(i));
+        height = record.shape[0];
+        width = depth = 1;
+        break;
+      case LayerType::kDropout:
+        layers.emplace_back(checkpoint.MakeDropout(i));
+        break;
+      default:
+        std::cerr << "Unsupported layer type " << record.type << " in "
+                  << checkpoint_path << std::endl;
+        Clear();
+        return false;
+    }
+    if (!shapes_match) {
+      std::cerr << "Layer " << i << " of " << checkpoint_path
+                << " does not take the output of the previous layer"
+                << std::endl;
+      Clear();
+      return false;
+    }
+  }
+
+  if (!input_known) {
+    std::cerr << "No layer with a known input shape in " << checkpoint_path
+              << std::endl;
+    Clear();
+    return false;
+  }
+  output_size = height * width * depth;
+  return true;
+}
+
+void InferenceModel::Add(const Conv2D &layer) {
+  const size_t height = (layer.GetInputHeight() - layer.GetFilterHeight()) /
+                            layer.GetVerticalStride() + 1;
+  const size_t width = (layer.GetInputWidth() - layer.GetFilterWidth()) /
+                           layer.GetHorizontalStride() + 1;
+  AddShape(layer.GetInputHeight(), layer.GetInputWidth(),
+           layer.GetInputDepth(), height * width * layer.GetNumFilters());
+  layers.emplace_back(layer);
+}
+
+void InferenceModel::Add(const Dense &layer) {
+  AddShape(layer.GetNumInputs(), 1, 1, layer.GetNumOutputs());
+  layers.emplace_back(layer);
+}
+
+void InferenceModel::Add(const MaxPooling &layer) {
+  const size_t height =
+      (layer.GetInputHeight() - layer.GetPoolingWindowHeight()) /
+          layer.GetVerticalStride() + 1;
+  const size_t width =
+      (layer.GetInputWidth() - layer.GetPoolingWindowWidth()) /
+          layer.GetHorizontalStride() + 1;
+  AddShape(layer.GetInputHeight(), layer.GetInputWidth(),
+           layer.GetInputDepth(), height * width * layer.GetInputDepth());
+  layers.emplace_back(layer);
+}
+
+void InferenceModel::Add(const ReLU &layer) {
+  AddShape(layer.GetInputHeight(), layer.GetInputWidth(),
+           layer.GetInputDepth(),
+           layer.GetInputHeight() * layer.GetInputWidth() *
+               layer.GetInputDepth());
+  layers.emplace_back(layer);
+}
+
+void InferenceModel::Add(const Sigmoid &layer) {
+  AddShape(layer.GetNumInputs(), 1, 1, layer.GetNumInputs());
+  layers.emplace_back(layer);
+}
+
+void InferenceModel::Add(const Softmax &layer) {
+  AddShape(layer.GetNumInputs(), 1, 1, layer.GetNumInputs());
+  layers.emplace_back(layer);
+}
+
+void InferenceModel::Add(const Dropout &layer) { layers.emplace_back(layer); }
+
+void InferenceModel::Clear() {
+  layers.clear();
+  checkpoint.reset();
+  input_height = input_width = input_depth = 0;
+  output_size = 0;
+}
+
+void InferenceModel::AddShape(size_t input_height, size_t input_width,
+                              size_t input_depth, size_t output_size) {
+  if (GetInputSize() == 0) {
+    this->input_height = input_height;
+    this->input_width = input_width;
+    this->input_depth = input_depth;
+  }
+  this->output_size = output_size;
+}
+
+void InferenceModel::Predict(const arma::cube &input, arma::vec &output,
+                             Scratch &scratch) const {
+  assert(input.n_elem == GetInputSize());
+  arma::cube &cube_activation = scratch.cube_activation;
+  arma::cube &cube_buffer = scratch.cube_buffer;
+  arma::vec &vec_activation = scratch.vec_activation;
+  arma::vec &vec_buffer = scratch.vec_buffer;
+  cube_activation = input;
+  bool is_cube = true;
+
+  // Convert the current activation to the representation the next layer
+  // expects.
+  auto as_cube = [&](size_t h, size_t w, size_t d) {
+    if (!is_cube) {
+      cube_activation = DataTransformer::VecToCube(vec_activation, h, w, d);
+      is_cube = true;
+    }
+  };
+  auto as_vec = [&]() {
+    if (is_cube) {
+      vec_activation = arma::vectorise(cube_activation);
+      is_cube = false;
+    }
+  };
+
+  for (const Layer &layer : layers) {
+    if (const Conv2D *conv = std::get_if<Conv2D>(&layer)) {
+      as_cube(conv->GetInputHeight(), conv->GetInputWidth(),
+              conv->GetInputDepth());
+      conv->Predict(cube_activation, cube_buffer);
+      std::swap(cube_activation, cube_buffer);
+    } else if (const MaxPooling *pool = std::get_if<MaxPooling>(&layer)) {
+      as_cube(pool->GetInputHeight(), pool->GetInputWidth(),
+              pool->GetInputDepth());
+      pool->Predict(cube_activation, cube_buffer);
+      std::swap(cube_activation, cube_buffer);
+    } else if (const ReLU *relu = std::get_if<ReLU>(&layer)) {
+      as_cube(relu->GetInputHeight(), relu->GetInputWidth(),
+              relu->GetInputDepth());
+      relu->Predict(cube_activation, cube_buffer);
+      std::swap(cube_activation, cube_buffer);
+    } else if (const Dense *dense = std::get_if<Dense>(&layer)) {
+      as_vec();
+      dense->Predict(vec_activation, vec_buffer);
+      std::swap(vec_activation, vec_buffer);
+    } else if (const Sigmoid *sigmoid = std::get_if<Sigmoid>(&layer)) {
+      as_vec();
+      sigmoid->Predict(vec_activation, vec_buffer);
+      std::swap(vec_activation, vec_buffer);
+    } else if (const Softmax *softmax = std::get_if<Softmax>(&layer)) {
+      as_vec();
+      softmax->Predict(vec_activation, vec_buffer);
+      std::swap(vec_activation, vec_buffer);
+    }
+    // Dropout is the identity at test time.
+  }
+
+  as_vec();
+  output = vec_activation;
+}
+
+void InferenceModel::Predict(const arma::cube &input,
+                             arma::vec &output) const {
+  Scratch scratch;
+  Predict(input, output, scratch);
+}
+
+void InferenceModel::PredictBatch(const std::vector<arma::cube> &inputs,
+                                  std::vector<arma::vec> &outputs) const {
+  outputs.resize(inputs.size());
+  // A single input is left to the parallel loops inside the layers.
+  #pragma omp parallel if (inputs.size() > 1)
+  {
+    Scratch scratch;
+    #pragma omp for schedule(dynamic)
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      Predict(inputs[i], outputs[i], scratch);
+    }
+  }
+}
+
+}  // namespace afs
@@ -0,0 +1,108 @@
+#ifndef INFERENCE_MODEL_H_
+#define INFERENCE_MODEL_H_
+
+#include <armadillo>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "io/checkpoint.h"
+#include "layers/conv2d.h"
+#include "layers/dense.h"
+#include "layers/dropout.h"
+#include "layers/max_pooling.h"
+#include "layers/relu.h"
+#include "layers/sigmoid.h"
+#include "layers/softmax.h"
+
+namespace afs {
+
+// A network loaded from a checkpoint, or copied from live layers, ready for
+// prediction.
+//
+// Inputs are given as cubes of GetInputHeight() x GetInputWidth() x
+// GetInputDepth(); a network starting with a Dense layer takes an
+// n x 1 x 1 cube. Dropout layers run in test mode.
+//
+// Once loaded, the model is only read: predictions run the layers'
+// Predict() and keep their intermediate activations in caller-provided
+// scratch, so one model can serve any number of threads at once.
+//
+// Load() keeps the checkpoint mapped for the lifetime of the model and binds
+// the convolution filters and dense weights and biases as read-only views
+// of its blobs. No parameter is copied or initialized, so loading takes the
+// same time whatever the size of the model, and all processes serving the
+// same file share the physical pages of its parameters.
+class InferenceModel {
+ public:
+  // Intermediate activations of one prediction. Layers on 3D data use the
+  // cubes, the others the vectors. Reusing a Scratch avoids reallocating
+  // them; threads predicting concurrently need one each.
+  struct Scratch {
+    arma::cube cube_activation;
+    arma::cube cube_buffer;
+    arma::vec vec_activation;
+    arma::vec vec_buffer;
+  };
+
+  InferenceModel() = default;
+  // Not copyable: assigning layers viewing a mapping would write into it.
+  InferenceModel(const InferenceModel &) = delete;
+  InferenceModel &operator=(const InferenceModel &) = delete;
+  InferenceModel(InferenceModel &&) = default;
+  InferenceModel &operator=(InferenceModel &&) = default;
+
+  bool Load(const std::string &checkpoint_path);
+
+  // Build the model from copies of the given layers, in forward order,
+  // instead of loading it. The copies do not change when training goes on
+  // updating the originals, so this takes a snapshot of a live network.
+  void Add(const Conv2D &layer);
+  void Add(const Dense &layer);
+  void Add(const MaxPooling &layer);
+  void Add(const ReLU &layer);
+  void Add(const Sigmoid &layer);
+  void Add(const Softmax &layer);
+  void Add(const Dropout &layer);
+  // Remove all layers.
+  void Clear();
+
+  void Predict(const arma::cube &input, arma::vec &output,
+               Scratch &scratch) const;
+  void Predict(const arma::cube &input, arma::vec &output) const;
+  // Predict the inputs in parallel, one sample per OpenMP thread at a time.
+  void PredictBatch(const std::vector<arma::cube> &inputs,
+                    std::vector<arma::vec> &outputs) const;
+
+  size_t GetInputHeight() const { return input_height; }
+  size_t GetInputWidth() const { return input_width; }
+  size_t GetInputDepth() const { return input_depth; }
+  size_t GetInputSize() const {
+    return input_height * input_width * input_depth;
+  }
+  size_t GetOutputSize() const { return output_size; }
+  size_t NumLayers() const { return layers.size(); }
+
+ private:
+  typedef std::variant<Conv2D, Dense, MaxPooling, ReLU, Sigmoid, Softmax,
+                       Dropout>
+      Layer;
+
+  // Record the shapes of a layer added after the current last one.
+  void AddShape(size_t input_height, size_t input_width, size_t input_depth,
+                size_t output_size);
+
+  // The loaded checkpoint, whose blobs the loaded Conv2D and Dense layers
+  // view. Declared first so that it is unmapped after the layers are gone.
+  std::shared_ptr<const Checkpoint> checkpoint;
+  std::vector<Layer> layers;
+  size_t input_height = 0;
+  size_t input_width = 0;
+  size_t input_depth = 0;
+  size_t output_size = 0;
+};
+
+}  // namespace afs
+
+#endif
@@ -0,0 +1,104 @@
+#include "async_checkpointer.h"
+
+namespace afs {
+
+AsyncCheckpointer::AsyncCheckpointer(size_t every_n_batches,
+                                     double every_n_seconds)
+    : every_n_batches(every_n_batches),
+      every_n_seconds(every_n_seconds),
+      last_save(std::chrono::steady_clock::now()) {
+  worker = std::thread(&AsyncCheckpointer::Run, this);
+}
+
+AsyncCheckpointer::~AsyncCheckpointer() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  condition.notify_all();
+  worker.join();
+}
+
+bool AsyncCheckpointer::ShouldSave() {
+  ++batches_since_save;
+  bool due = every_n_batches > 0 && batches_since_save >= every_n_batches;
+  if (!due && every_n_seconds > 0) {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - last_save;
+    due = elapsed.count() >= every_n_seconds;
+  }
+  if (!due) return false;
+
+  {
+    // A snapshot is still waiting for the worker: both buffers are busy.
+    // Try again on the next batch.
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending) return false;
+  }
+
+  batches_since_save = 0;
+  last_save = std::chrono::steady_clock::now();
+  return true;
+}
+
+CheckpointWriter &AsyncCheckpointer::GetBuffer() {
+  buffers[fill_index].Clear();
+  return buffers[fill_index];
+}
+
+void AsyncCheckpointer::Submit(const std::string &path) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = true;
+    pending_index = fill_index;
+    pending_path = path;
+  }
+  // The worker writes at most one buffer at a time, and no new snapshot is
+  // taken while one is pending, so the other buffer is free once the
+  // pending one has been picked up.
+  fill_index = 1 - fill_index;
+  condition.notify_all();
+}
+
+void AsyncCheckpointer::Wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  condition.wait(lock, [this] { return !pending && !writing; });
+}
+
+size_t AsyncCheckpointer::GetNumWritten() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return num_written;
+}
+
+size_t AsyncCheckpointer::GetNumFailed() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return num_failed;
+}
+
+void AsyncCheckpointer::Run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    condition.wait(lock, [this] { return pending || stop; });
+    if (!pending) return;
+
+    int index = pending_index;
+    std::string path = pending_path;
+    pending = false;
+    writing = true;
+
+    lock.unlock();
+    bool ok = buffers[index].Write(path, true);
+    lock.lock();
+
+    writing = false;
+    if (ok) {
+      ++num_written;
+    } else {
+      ++num_failed;
+    }
+    condition.notify_all();
+  }
+}
+
+}  // namespace afs
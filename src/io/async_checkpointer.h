@@ -0,0 +1,83 @@
+#ifndef ASYNC_CHECKPOINTER_H_
+#define ASYNC_CHECKPOINTER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "io/checkpoint.h"
+
+namespace afs {
+
+// Writes checkpoints on a background thread while training continues.
+//
+// The trainer only copies the parameters into one of two CheckpointWriter
+// buffers; writing and fsync-ing the file happen on the worker thread. If
+// both buffers are busy when a snapshot is due, the snapshot is postponed
+// instead of stalling training.
+//
+// Usage, once per batch:
+//   if (checkpointer.ShouldSave()) {
+//     CheckpointWriter &snapshot = checkpointer.GetBuffer();
+//     snapshot.Add(layer1);
+//     ...
+//     snapshot.SetOptimizerState(optimizer);
+//     checkpointer.Submit("model.afsm");
+//   }
+class AsyncCheckpointer {
+ public:
+  // Save every `every_n_batches` batches and/or every `every_n_seconds`
+  // seconds. A value of 0 disables that trigger.
+  AsyncCheckpointer(size_t every_n_batches, double every_n_seconds = 0);
+  // Waits for the submitted snapshots to be written.
+  ~AsyncCheckpointer();
+
+  AsyncCheckpointer(const AsyncCheckpointer &) = delete;
+  AsyncCheckpointer &operator=(const AsyncCheckpointer &) = delete;
+
+  // Count one batch and return true if a snapshot is due and a buffer is
+  // free to take it.
+  bool ShouldSave();
+
+  // The free buffer, cleared. Fill it, then call Submit().
+  CheckpointWriter &GetBuffer();
+
+  // Queue the filled buffer to be written to `path`.
+  void Submit(const std::string &path);
+
+  // Block until all submitted snapshots are on disk.
+  void Wait();
+
+  size_t GetNumWritten();
+  size_t GetNumFailed();
+
+ private:
+  void Run();
+
+  size_t every_n_batches;
+  double every_n_seconds;
+  size_t batches_since_save = 0;
+  std::chrono::steady_clock::time_point last_save;
+
+  CheckpointWriter buffers[2];
+  // Buffer filled by the trainer. The other one may be in use by the worker.
+  int fill_index = 0;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool pending = false;
+  bool writing = false;
+  bool stop = false;
+  int pending_index = 0;
+  std::string pending_path;
+  size_t num_written = 0;
+  size_t num_failed = 0;
+
+  std::thread worker;
+};
+
+}  // namespace afs
+
+#endif
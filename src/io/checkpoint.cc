@@ -0,0 +1,457 @@
+#include "checkpoint.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The checkpoint format is little endian only"
+#endif
+
+namespace afs {
+
+namespace {
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Product of the first `n` entries of `shape`, or 0 if it overflows.
+uint64_t ShapeProduct(const uint64_t *shape, size_t n) {
+  uint64_t product = 1;
+  for (size_t i = 0; i < n; ++i) {
+    if (shape[i] != 0 && product > UINT64_MAX / shape[i]) return 0;
+    product *= shape[i];
+  }
+  return product;
+}
+
+bool AllPositive(const uint64_t *shape, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    if (shape[i] == 0) return false;
+  }
+  return true;
+}
+
+// Check that a layer record describes a layer that can be built: known
+// type, positive sizes and strides, windows that fit in the input, and
+// blobs holding exactly the values the layer reads. Sets `error` otherwise.
+bool ValidateRecord(const LayerRecord &record, std::string &error) {
+  const uint64_t *shape = record.shape;
+  // Number of values of each blob the layer type reads.
+  std::vector<uint64_t> blob_counts;
+  bool valid = true;
+  switch (static_cast<LayerType>(record.type)) {
+    case LayerType::kConv2D: {
+      valid = AllPositive(shape, 8) && shape[3] <= shape[0] &&
+              shape[4] <= shape[1];
+      // Filter height x width x input depth, times the number of filters.
+      const uint64_t filters[] = {shape[2], shape[3], shape[4], shape[7]};
+      blob_counts = {ShapeProduct(filters, 4)};
+      break;
+    }
+    case LayerType::kDense:
+      valid = AllPositive(shape, 2);
+      blob_counts = {ShapeProduct(shape, 2), shape[1]};
+      break;
+    case LayerType::kMaxPooling:
+      valid = AllPositive(shape, 7) && shape[3] <= shape[0] &&
+              shape[4] <= shape[1];
+      break;
+    case LayerType::kReLU:
+      valid = AllPositive(shape, 3);
+      break;
+    case LayerType::kSigmoid:
+    case LayerType::kSoftmax:
+      valid = AllPositive(shape, 1);
+      break;
+    case LayerType::kDropout:
+      valid = record.scalar > 0.0 && record.scalar <= 1.0;
+      break;
+    default:
+      error = "unknown layer type " + std::to_string(record.type);
+      return false;
+  }
+  if (!valid) {
+    error = "invalid shape for layer type " + std::to_string(record.type);
+    return false;
+  }
+  if (record.num_blobs != blob_counts.size()) {
+    error = "layer type " + std::to_string(record.type) + " has " +
+            std::to_string(record.num_blobs) + " blobs, expected " +
+            std::to_string(blob_counts.size());
+    return false;
+  }
+  for (size_t b = 0; b < blob_counts.size(); ++b) {
+    if (blob_counts[b] == 0 || record.blobs[b].count != blob_counts[b]) {
+      error = "blob " + std::to_string(b) + " has " +
+              std::to_string(record.blobs[b].count) +
+              " values, the shape needs " + std::to_string(blob_counts[b]);
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+constexpr char CheckpointWriter::kMagic[8];
+
+LayerRecord CheckpointWriter::NewRecord(LayerType type) {
+  LayerRecord record;
+  std::memset(&record, 0, sizeof(record));
+  record.type = static_cast<uint32_t>(type);
+  return record;
+}
+
+std::vector<double> &CheckpointWriter::NextBlob() {
+  if (num_blobs == blobs.size()) blobs.emplace_back();
+  return blobs[num_blobs++];
+}
+
+void CheckpointWriter::AddBlob(LayerRecord &record, const double *data,
+                               size_t count) {
+  assert(record.num_blobs < 2);
+  // The offset is only known when the file is written.
+  record.blobs[record.num_blobs].count = count;
+  record.num_blobs++;
+  NextBlob().assign(data, data + count);
+}
+
+void CheckpointWriter::Add(const Conv2D &layer) {
+  LayerRecord record = NewRecord(LayerType::kConv2D);
+  record.shape[0] = layer.GetInputHeight();
+  record.shape[1] = layer.GetInputWidth();
+  record.shape[2] = layer.GetInputDepth();
+  record.shape[3] = layer.GetFilterHeight();
+  record.shape[4] = layer.GetFilterWidth();
+  record.shape[5] = layer.GetHorizontalStride();
+  record.shape[6] = layer.GetVerticalStride();
+  record.shape[7] = layer.GetNumFilters();
+
+  size_t filter_size =
+      layer.GetFilterHeight() * layer.GetFilterWidth() * layer.GetInputDepth();
+  record.blobs[0].count = filter_size * layer.GetNumFilters();
+  record.num_blobs = 1;
+  std::vector<double> &filters = NextBlob();
+  filters.resize(record.blobs[0].count);
+  for (size_t i = 0; i < layer.GetNumFilters(); ++i) {
+    std::memcpy(filters.data() + i * filter_size, layer.GetFilter(i).memptr(),
+                filter_size * sizeof(double));
+  }
+  records.push_back(record);
+}
+
+void CheckpointWriter::Add(const Dense &layer) {
+  LayerRecord record = NewRecord(LayerType::kDense);
+  record.shape[0] = layer.GetNumInputs();
+  record.shape[1] = layer.GetNumOutputs();
+  AddBlob(record, layer.GetWeights().memptr(), layer.GetWeights().n_elem);
+  AddBlob(record, layer.GetBiases().memptr(), layer.GetBiases().n_elem);
+  records.push_back(record);
+}
+
+void CheckpointWriter::Add(const MaxPooling &layer) {
+  LayerRecord record = NewRecord(LayerType::kMaxPooling);
+  record.shape[0] = layer.GetInputHeight();
+  record.shape[1] = layer.GetInputWidth();
+  record.shape[2] = layer.GetInputDepth();
+  record.shape[3] = layer.GetPoolingWindowHeight();
+  record.shape[4] = layer.GetPoolingWindowWidth();
+  record.shape[5] = layer.GetVerticalStride();
+  record.shape[6] = layer.GetHorizontalStride();
+  records.push_back(record);
+}
+
+void CheckpointWriter::Add(const ReLU &layer) {
+  LayerRecord record = NewRecord(LayerType::kReLU);
+  record.shape[0] = layer.GetInputHeight();
+  record.shape[1] = layer.GetInputWidth();
+  record.shape[2] = layer.GetInputDepth();
+  records.push_back(record);
+}
+
+void CheckpointWriter::Add(const Sigmoid &layer) {
+  LayerRecord record = NewRecord(LayerType::kSigmoid);
+  record.shape[0] = layer.GetNumInputs();
+  records.push_back(record);
+}
+
+void CheckpointWriter::Add(const Softmax &layer) {
+  LayerRecord record = NewRecord(LayerType::kSoftmax);
+  record.shape[0] = layer.GetNumInputs();
+  records.push_back(record);
+}
+
+void CheckpointWriter::Add(const Dropout &layer) {
+  LayerRecord record = NewRecord(LayerType::kDropout);
+  record.scalar = layer.GetKeepProp();
+  records.push_back(record);
+}
+
+void CheckpointWriter::SetOptimizerState(const Optimizer &optimizer) {
+  optimizer.GetState(optimizer_state);
+}
+
+void CheckpointWriter::Clear() {
+  records.clear();
+  num_blobs = 0;
+  optimizer_state.clear();
+}
+
+bool CheckpointWriter::Write(const std::string &path, bool sync) const {
+  CheckpointHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMagic, sizeof(header.magic));
+  header.version = kVersion;
+  header.dtype = static_cast<uint32_t>(DataType::kFloat64);
+  header.num_layers = records.size();
+  header.layer_table_offset = sizeof(CheckpointHeader);
+
+  // Assign the blob offsets.
+  std::vector<LayerRecord> table = records;
+  uint64_t offset = AlignUp(
+      header.layer_table_offset + table.size() * sizeof(LayerRecord),
+      kBlobAlignment);
+  for (LayerRecord &record : table) {
+    for (size_t b = 0; b < record.num_blobs; ++b) {
+      record.blobs[b].offset = offset;
+      offset = AlignUp(offset + record.blobs[b].count * sizeof(double),
+                       kBlobAlignment);
+    }
+  }
+  if (!optimizer_state.empty()) {
+    header.optimizer_state.offset = offset;
+    header.optimizer_state.count = optimizer_state.size();
+    offset = AlignUp(offset + optimizer_state.size() * sizeof(double),
+                     kBlobAlignment);
+  }
+  header.file_size = offset;
+
+  std::string tmp_path = path + ".tmp";
+  std::FILE *file = std::fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Error opening file: " << tmp_path << std::endl;
+    return false;
+  }
+
+  static const char kPadding[kBlobAlignment] = {};
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+  if (!table.empty()) {
+    ok = ok && std::fwrite(table.data(), sizeof(LayerRecord), table.size(),
+                           file) == table.size();
+  }
+  uint64_t written = sizeof(header) + table.size() * sizeof(LayerRecord);
+  size_t blob_idx = 0;
+  for (const LayerRecord &record : table) {
+    for (size_t b = 0; b < record.num_blobs && ok; ++b) {
+      const std::vector<double> &blob = blobs[blob_idx++];
+      size_t padding = record.blobs[b].offset - written;
+      ok = ok && std::fwrite(kPadding, 1, padding, file) == padding;
+      ok = ok && std::fwrite(blob.data(), sizeof(double), blob.size(), file) ==
+                     blob.size();
+      written = record.blobs[b].offset + blob.size() * sizeof(double);
+    }
+  }
+  if (ok && !optimizer_state.empty()) {
+    size_t padding = header.optimizer_state.offset - written;
+    ok = std::fwrite(kPadding, 1, padding, file) == padding;
+    ok = ok && std::fwrite(optimizer_state.data(), sizeof(double),
+                           optimizer_state.size(),
+                           file) == optimizer_state.size();
+    written = header.optimizer_state.offset +
+              optimizer_state.size() * sizeof(double);
+  }
+  size_t padding = header.file_size - written;
+  ok = ok && std::fwrite(kPadding, 1, padding, file) == padding;
+  if (sync) {
+    ok = ok && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+  }
+  ok = (std::fclose(file) == 0) && ok;
+
+  if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << "Error writing checkpoint: " << path << std::endl;
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+
+  if (sync) {
+    // Make the rename itself durable.
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int dir_fd = open(dir.c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+      fsync(dir_fd);
+      close(dir_fd);
+    }
+  }
+  return true;
+}
+
+bool Checkpoint::Load(const std::string &path) {
+  header = nullptr;
+  layers = nullptr;
+  num_layers = 0;
+  if (!file.Open(path)) return false;
+
+  const uint8_t *data = file.Data();
+  const size_t size = file.Size();
+  const CheckpointHeader *header =
+      reinterpret_cast<const CheckpointHeader *>(data);
+  auto blob_in_file = [&](const BlobRef &blob) {
+    return blob.offset % CheckpointWriter::kBlobAlignment == 0 &&
+           blob.offset <= size &&
+           blob.count <= (size - blob.offset) / sizeof(double);
+  };
+  bool valid =
+      size >= sizeof(CheckpointHeader) &&
+      std::memcmp(header->magic, CheckpointWriter::kMagic,
+                  sizeof(header->magic)) == 0 &&
+      header->version == CheckpointWriter::kVersion &&
+      header->dtype == static_cast<uint32_t>(DataType::kFloat64) &&
+      header->file_size == size &&
+      header->layer_table_offset % alignof(LayerRecord) == 0 &&
+      header->layer_table_offset <= size &&
+      header->num_layers <=
+          (size - header->layer_table_offset) / sizeof(LayerRecord) &&
+      (header->optimizer_state.count == 0 ||
+       blob_in_file(header->optimizer_state));
+  if (!valid) {
+    std::cerr << "Invalid checkpoint file: " << path << std::endl;
+    file.Close();
+    return false;
+  }
+
+  const LayerRecord *table = reinterpret_cast<const LayerRecord *>(
+      data + header->layer_table_offset);
+  for (size_t i = 0; i < header->num_layers; ++i) {
+    std::string error;
+    valid = ValidateRecord(table[i], error);
+    for (size_t b = 0; valid && b < table[i].num_blobs; ++b) {
+      valid = blob_in_file(table[i].blobs[b]);
+      if (!valid) error = "parameter blob outside of the file";
+    }
+    if (!valid) {
+      std::cerr << "Invalid checkpoint file: " << path << ": layer " << i
+                << ": " << error << std::endl;
+      file.Close();
+      return false;
+    }
+  }
+
+  this->header = header;
+  layers = table;
+  num_layers = header->num_layers;
+  return true;
+}
+
+const LayerRecord &Checkpoint::GetLayer(size_t i) const {
+  assert(i < num_layers);
+  return layers[i];
+}
+
+const double *Checkpoint::GetBlob(size_t layer, size_t blob) const {
+  const LayerRecord &record = GetLayer(layer);
+  assert(blob < record.num_blobs);
+  return reinterpret_cast<const double *>(file.Data() +
+                                          record.blobs[blob].offset);
+}
+
+Conv2D Checkpoint::MakeConv2D(size_t i) const {
+  const LayerRecord &record = GetLayer(i);
+  assert(record.type == static_cast<uint32_t>(LayerType::kConv2D));
+  Conv2D layer(record.shape[0], record.shape[1], record.shape[2],
+               record.shape[3], record.shape[4], record.shape[5],
+               record.shape[6], record.shape[7]);
+  Restore(i, layer);
+  return layer;
+}
+
+Dense Checkpoint::MakeDense(size_t i) const {
+  const LayerRecord &record = GetLayer(i);
+  assert(record.type == static_cast<uint32_t>(LayerType::kDense));
+  Dense layer(record.shape[0], record.shape[1]);
+  Restore(i, layer);
+  return layer;
+}
+
+MaxPooling Checkpoint::MakeMaxPooling(size_t i) const {
+  const LayerRecord &record = GetLayer(i);
+  assert(record.type == static_cast<uint32_t>(LayerType::kMaxPooling));
+  return MaxPooling(record.shape[0], record.shape[1], record.shape[2],
+                    record.shape[3], record.shape[4], record.shape[5],
+                    record.shape[6]);
+}
+
+ReLU Checkpoint::MakeReLU(size_t i) const {
+  const LayerRecord &record = GetLayer(i);
+  assert(record.type == static_cast<uint32_t>(LayerType::kReLU));
+  return ReLU(record.shape[0], record.shape[1], record.shape[2]);
+}
+
+Sigmoid Checkpoint::MakeSigmoid(size_t i) const {
+  const LayerRecord &record = GetLayer(i);
+  assert(record.type == static_cast<uint32_t>(LayerType::kSigmoid));
+  return Sigmoid(record.shape[0]);
+}
+
+Softmax Checkpoint::MakeSoftmax(size_t i) const {
+  const LayerRecord &record = GetLayer(i);
+  assert(record.type == static_cast<uint32_t>(LayerType::kSoftmax));
+  return Softmax(record.shape[0]);
+}
+
+Dropout Checkpoint::MakeDropout(size_t i) const {
+  const LayerRecord &record = GetLayer(i);
+  assert(record.type == static_cast<uint32_t>(LayerType::kDropout));
+  return Dropout(record.scalar);
+}
+
+void Checkpoint::Restore(size_t i, Conv2D &layer) const {
+  const LayerRecord &record = GetLayer(i);
+  assert(record.type == static_cast<uint32_t>(LayerType::kConv2D));
+  assert(record.shape[3] == layer.GetFilterHeight() &&
+         record.shape[4] == layer.GetFilterWidth() &&
+         record.shape[2] == layer.GetInputDepth() &&
+         record.shape[7] == layer.GetNumFilters());
+
+  // Read-only views over the mapping; SetFilters() copies out of them.
+  double *data = const_cast<double *>(GetBlob(i, 0));
+  size_t filter_size = record.shape[3] * record.shape[4] * record.shape[2];
+  std::vector<arma::cube> filters;
+  filters.reserve(record.shape[7]);
+  for (size_t f = 0; f < record.shape[7]; ++f) {
+    filters.emplace_back(data + f * filter_size, record.shape[3],
+                         record.shape[4], record.shape[2], false, true);
+  }
+  layer.SetFilters(filters);
+}
+
+void Checkpoint::Restore(size_t i, Dense &layer) const {
+  const LayerRecord &record = GetLayer(i);
+  assert(record.type == static_cast<uint32_t>(LayerType::kDense));
+  assert(record.shape[0] == layer.GetNumInputs() &&
+         record.shape[1] == layer.GetNumOutputs());
+
+  // Read-only views over the mapping; the setters copy out of them.
+  layer.SetWeights(arma::mat(const_cast<double *>(GetBlob(i, 0)),
+                             record.shape[1], record.shape[0], false, true));
+  layer.SetBiases(arma::vec(const_cast<double *>(GetBlob(i, 1)),
+                            record.shape[1], false, true));
+}
+
+bool Checkpoint::RestoreOptimizer(Optimizer &optimizer) const {
+  if (header == nullptr || header->optimizer_state.count == 0) return false;
+  optimizer.SetState(reinterpret_cast<const double *>(
+                         file.Data() + header->optimizer_state.offset),
+                     header->optimizer_state.count);
+  return true;
+}
+
+}  // namespace afs
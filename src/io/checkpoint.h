@@ -0,0 +1,179 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "layers/conv2d.h"
+#include "layers/dense.h"
+#include "layers/dropout.h"
+#include "layers/max_pooling.h"
+#include "layers/relu.h"
+#include "layers/sigmoid.h"
+#include "layers/softmax.h"
+#include "optimizers/optimizer.h"
+#include "utils/mapped_file.h"
+
+namespace afs {
+
+// Binary model checkpoint (*.afsm).
+//
+// Layout, all integers little endian:
+//   CheckpointHeader                      64 bytes
+//   LayerRecord[num_layers]               128 bytes each
+//   parameter blobs                       each starts on a 64-byte boundary
+//   optimizer state blob (optional)       starts on a 64-byte boundary
+//
+// A blob is a column-major array of `count` values of the header's data
+// type, laid out exactly like the armadillo object it came from. Since the
+// blobs are aligned, they can be read in place from a mapped file without
+// parsing, and all processes mapping the same file share their pages.
+
+enum class LayerType : uint32_t {
+  kConv2D = 1,
+  kDense = 2,
+  kMaxPooling = 3,
+  kReLU = 4,
+  kSigmoid = 5,
+  kSoftmax = 6,
+  kDropout = 7,
+};
+
+enum class DataType : uint32_t {
+  kFloat64 = 1,
+};
+
+struct BlobRef {
+  uint64_t offset;  // In bytes, from the start of the file.
+  uint64_t count;   // Number of values.
+};
+
+struct CheckpointHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t dtype;
+  uint64_t num_layers;
+  uint64_t layer_table_offset;
+  uint64_t file_size;
+  // Optimizer::GetState() of the optimizer training the network. Zero count
+  // if the checkpoint holds only the network.
+  BlobRef optimizer_state;
+  uint64_t reserved[1];
+};
+
+// Layer description. Meaning of `shape` by layer type:
+//   kConv2D:     input height, width, depth, filter height, width,
+//                horizontal stride, vertical stride, number of filters
+//   kDense:      number of inputs, number of outputs
+//   kMaxPooling: input height, width, depth, window height, width,
+//                vertical stride, horizontal stride
+//   kReLU:       input height, width, depth
+//   kSigmoid,
+//   kSoftmax:    number of inputs
+//   kDropout:    none, `scalar` holds the keep probability
+// Blobs: kConv2D has one blob with all filters back to back, kDense has the
+// weights (num_outputs x num_inputs) followed by the biases.
+struct LayerRecord {
+  uint32_t type;
+  uint32_t num_blobs;
+  uint64_t shape[8];
+  double scalar;
+  BlobRef blobs[2];
+  uint64_t reserved[2];
+};
+
+static_assert(sizeof(CheckpointHeader) == 64, "Unexpected header size");
+static_assert(sizeof(LayerRecord) == 128, "Unexpected layer record size");
+
+// Collects the layers of a network, in forward order, and writes them to a
+// checkpoint file.
+class CheckpointWriter {
+ public:
+  static constexpr char kMagic[8] = {'A', 'F', 'S', 'M', 'O', 'D', 'E', 'L'};
+  static constexpr uint32_t kVersion = 1;
+  static constexpr size_t kBlobAlignment = 64;
+
+  void Add(const Conv2D &layer);
+  void Add(const Dense &layer);
+  void Add(const MaxPooling &layer);
+  void Add(const ReLU &layer);
+  void Add(const Sigmoid &layer);
+  void Add(const Softmax &layer);
+  void Add(const Dropout &layer);
+
+  // Also store the state of the optimizer, to be able to resume training.
+  void SetOptimizerState(const Optimizer &optimizer);
+
+  // Write to `path + ".tmp"` and rename it over `path`, so that readers
+  // never see a partially written file. With `sync`, the data is flushed to
+  // disk before returning. Returns false on I/O errors.
+  bool Write(const std::string &path, bool sync = false) const;
+
+  // Remove all layers. The blob buffers are kept, so that filling the
+  // writer again with the same network does not allocate.
+  void Clear();
+  size_t NumLayers() const { return records.size(); }
+
+ private:
+  LayerRecord NewRecord(LayerType type);
+  std::vector<double> &NextBlob();
+  void AddBlob(LayerRecord &record, const double *data, size_t count);
+
+  std::vector<LayerRecord> records;
+  // Blob data, in the same order as the blob references in `records`. Only
+  // the first `num_blobs` entries are in use.
+  std::vector<std::vector<double>> blobs;
+  size_t num_blobs = 0;
+  std::vector<double> optimizer_state;
+};
+
+// Read-only view of a checkpoint file. The file is memory-mapped and
+// GetBlob() returns pointers straight into the mapping. Load() validates the
+// header and every layer record, including that the blobs hold the number of
+// values their layer's shape needs, so the Make*() and Restore() calls
+// below never read outside the mapping.
+class Checkpoint {
+ public:
+  bool Load(const std::string &path);
+
+  size_t NumLayers() const { return num_layers; }
+  const LayerRecord &GetLayer(size_t i) const;
+  LayerType GetLayerType(size_t i) const {
+    return static_cast<LayerType>(GetLayer(i).type);
+  }
+
+  // Pointer to the values of a parameter blob. Valid while this object
+  // lives. The memory is read-only.
+  const double *GetBlob(size_t layer, size_t blob) const;
+
+  // Create trainable layers with the stored configuration. They own a copy
+  // of the parameters; InferenceModel::Load() binds views of the blobs
+  // instead.
+  Conv2D MakeConv2D(size_t i) const;
+  Dense MakeDense(size_t i) const;
+  MaxPooling MakeMaxPooling(size_t i) const;
+  ReLU MakeReLU(size_t i) const;
+  Sigmoid MakeSigmoid(size_t i) const;
+  Softmax MakeSoftmax(size_t i) const;
+  Dropout MakeDropout(size_t i) const;
+
+  // Copy the stored parameters into an existing layer of the same shape,
+  // e.g. to resume training.
+  void Restore(size_t i, Conv2D &layer) const;
+  void Restore(size_t i, Dense &layer) const;
+
+  // Restore the optimizer state, if the checkpoint has one. Returns false
+  // otherwise.
+  bool RestoreOptimizer(Optimizer &optimizer) const;
+
+ private:
+  MappedFile file;
+  const CheckpointHeader *header = nullptr;
+  const LayerRecord *layers = nullptr;
+  size_t num_layers = 0;
+};
+
+}  // namespace afs
+
+#endif
@@ -0,0 +1,295 @@
+#include "csv_parser.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+
+#include "utils/mapped_file.h"
+
+namespace afs {
+
+namespace {
+
+// Size of the chunks parsed in parallel.
+const size_t kChunkSize = 1 << 22;
+
+// Find the end of the line starting at `begin`, without the line break, and
+// return the start of the next line.
+const char *NextLine(const char *begin, const char *end,
+                     const char *&line_end) {
+  const char *newline =
+      static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+  if (newline == nullptr) {
+    line_end = end;
+    return end;
+  }
+  line_end = newline;
+  if (line_end > begin && line_end[-1] == '\r') --line_end;
+  return newline + 1;
+}
+
+bool IsBlank(const char *begin, const char *end) {
+  for (const char *p = begin; p < end; ++p) {
+    if (*p != ' ') return false;
+  }
+  return true;
+}
+
+// Parse one numeric field at `p` and skip the spaces around it.
+bool ParseField(const char *&p, const char *end, float &value) {
+  while (p < end && *p == ' ') ++p;
+  // std::from_chars does not accept a leading '+'.
+  if (p < end && *p == '+') ++p;
+  std::from_chars_result result = std::from_chars(p, end, value);
+  if (result.ec != std::errc()) return false;
+  p = result.ptr;
+  while (p < end && *p == ' ') ++p;
+  return true;
+}
+
+std::vector<std::string> SplitHeader(const char *begin, const char *end,
+                                     char delimiter) {
+  std::vector<std::string> names;
+  const char *field = begin;
+  for (const char *p = begin; p <= end; ++p) {
+    if (p < end && *p != delimiter) continue;
+    const char *first = field;
+    const char *last = p;
+    while (first < last && (*first == ' ' || *first == '"')) ++first;
+    while (last > first && (last[-1] == ' ' || last[-1] == '"')) --last;
+    names.emplace_back(first, last);
+    field = p + 1;
+  }
+  return names;
+}
+
+// Parse the `num_cols` fields of the line [begin, end) into out[0],
+// out[stride], ... Returns false if the line does not hold exactly
+// `num_cols` numeric fields.
+bool ParseRow(const char *begin, const char *end, size_t num_cols,
+              char delimiter, float *out, size_t stride) {
+  const char *field = begin;
+  for (size_t col = 0; col < num_cols; ++col) {
+    float value;
+    if (!ParseField(field, end, value)) return false;
+    out[col * stride] = value;
+    if (col + 1 < num_cols && (field == end || *field++ != delimiter)) {
+      return false;
+    }
+  }
+  return field == end;
+}
+
+// Skip the leading blank lines, then detect the delimiter and header as
+// set in `options`. Returns the start of the data rows, or null if the file
+// is blank.
+const char *ReadPreamble(const char *begin, const char *end,
+                         const CsvOptions &options, char &delimiter,
+                         std::vector<std::string> &header) {
+  // First non-blank line.
+  const char *line = begin;
+  const char *line_end = begin;
+  const char *next = begin;
+  while (next < end) {
+    line = next;
+    next = NextLine(line, end, line_end);
+    if (!IsBlank(line, line_end)) break;
+  }
+  if (IsBlank(line, line_end)) return nullptr;
+
+  delimiter = options.delimiter;
+  if (delimiter == 0) {
+    const char candidates[] = {',', ';', '\t'};
+    size_t best_count = 0;
+    delimiter = ',';
+    for (char candidate : candidates) {
+      size_t count = std::count(line, line_end, candidate);
+      if (count > best_count) {
+        best_count = count;
+        delimiter = candidate;
+      }
+    }
+  }
+
+  bool has_header = options.header == CsvOptions::Header::kPresent;
+  if (options.header == CsvOptions::Header::kAuto) {
+    const char *p = line;
+    float value;
+    has_header = !ParseField(p, line_end, value) ||
+                 (p < line_end && *p != delimiter);
+  }
+  if (has_header) {
+    header = SplitHeader(line, line_end, delimiter);
+    line = next;
+  }
+  return line;
+}
+
+}  // namespace
+
+bool CsvParser::Parse(const std::string &path, std::vector<float> &values) {
+  num_rows = 0;
+  num_cols = 0;
+  header.clear();
+  values.clear();
+
+  MappedFile file;
+  if (!file.Open(path)) return false;
+  file.Advise(MADV_WILLNEED);
+  const char *begin = reinterpret_cast<const char *>(file.Data());
+  const char *end = begin + file.Size();
+
+  const char *data_begin = ReadPreamble(begin, end, options, delimiter,
+                                        header);
+  if (data_begin == nullptr) {
+    std::cerr << "Empty CSV file: " << path << std::endl;
+    return false;
+  }
+
+  // The number of columns is given by the first data row.
+  const char *line = data_begin;
+  const char *line_end;
+  while (line < end) {
+    const char *after = NextLine(line, end, line_end);
+    if (!IsBlank(line, line_end)) {
+      num_cols = std::count(line, line_end, delimiter) + 1;
+      break;
+    }
+    line = after;
+  }
+  if (num_cols == 0) return true;
+
+  // Cut the data into chunks that end at line boundaries.
+  std::vector<const char *> chunk_begins;
+  for (const char *p = data_begin; p < end;) {
+    chunk_begins.push_back(p);
+    if (static_cast<size_t>(end - p) <= kChunkSize) break;
+    const char *ignored;
+    p = NextLine(p + kChunkSize, end, ignored);
+  }
+  const size_t num_chunks = chunk_begins.size();
+  chunk_begins.push_back(end);
+
+  // Pass 1: count the rows of each chunk.
+  std::vector<size_t> chunk_rows(num_chunks + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+  for (size_t c = 0; c < num_chunks; ++c) {
+    size_t rows = 0;
+    const char *line_end;
+    for (const char *p = chunk_begins[c]; p < chunk_begins[c + 1];) {
+      const char *line = p;
+      p = NextLine(line, chunk_begins[c + 1], line_end);
+      if (!IsBlank(line, line_end)) ++rows;
+    }
+    chunk_rows[c + 1] = rows;
+  }
+  for (size_t c = 0; c < num_chunks; ++c) chunk_rows[c + 1] += chunk_rows[c];
+  num_rows = chunk_rows[num_chunks];
+  values.resize(num_rows * num_cols);
+
+  // Pass 2: parse each chunk into its rows.
+  const size_t rows = num_rows;
+  const size_t cols = num_cols;
+  const char delim = delimiter;
+  const bool column_major = options.column_major;
+  float *output = values.data();
+  std::vector<size_t> bad_rows(num_chunks, rows);
+#pragma omp parallel for schedule(dynamic)
+  for (size_t c = 0; c < num_chunks; ++c) {
+    size_t row = chunk_rows[c];
+    const char *line_end;
+    for (const char *p = chunk_begins[c]; p < chunk_begins[c + 1];) {
+      const char *line = p;
+      p = NextLine(line, chunk_begins[c + 1], line_end);
+      if (IsBlank(line, line_end)) continue;
+
+      const bool ok =
+          column_major
+              ? ParseRow(line, line_end, cols, delim, output + row, rows)
+              : ParseRow(line, line_end, cols, delim, output + row * cols, 1);
+      if (!ok) {
+        bad_rows[c] = row;
+        break;
+      }
+      ++row;
+    }
+  }
+
+  for (size_t c = 0; c < num_chunks; ++c) {
+    if (bad_rows[c] != rows) {
+      std::cerr << "Malformed CSV row " << bad_rows[c] + 1 << " in " << path
+                << ": expected " << cols << " numeric fields" << std::endl;
+      values.clear();
+      num_rows = 0;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CsvReader::Open(const std::string &path) {
+  this->path = path;
+  next = end = nullptr;
+  num_cols = 0;
+  num_rows_read = 0;
+  header.clear();
+
+  if (!file.Open(path)) return false;
+  file.Advise(MADV_SEQUENTIAL);
+  const char *begin = reinterpret_cast<const char *>(file.Data());
+  end = begin + file.Size();
+  next = ReadPreamble(begin, end, options, delimiter, header);
+  if (next == nullptr) {
+    std::cerr << "Empty CSV file: " << path << std::endl;
+    file.Close();
+    end = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool CsvReader::ReadRows(size_t max_rows, std::vector<float> &values,
+                         size_t &num_rows) {
+  num_rows = 0;
+  line_begins.clear();
+  line_ends.clear();
+  const char *line_end;
+  while (next < end && line_begins.size() < max_rows) {
+    const char *line = next;
+    next = NextLine(line, end, line_end);
+    if (IsBlank(line, line_end)) continue;
+    line_begins.push_back(line);
+    line_ends.push_back(line_end);
+  }
+  if (line_begins.empty()) return true;
+  if (num_cols == 0) {
+    num_cols = std::count(line_begins[0], line_ends[0], delimiter) + 1;
+  }
+
+  const size_t rows = line_begins.size();
+  const size_t cols = num_cols;
+  values.resize(rows * cols);
+  float *output = values.data();
+  size_t bad_row = rows;
+#pragma omp parallel for schedule(dynamic, 256) reduction(min : bad_row)
+  for (size_t row = 0; row < rows; ++row) {
+    if (!ParseRow(line_begins[row], line_ends[row], cols, delimiter,
+                  output + row * cols, 1)) {
+      bad_row = std::min(bad_row, row);
+    }
+  }
+  if (bad_row != rows) {
+    std::cerr << "Malformed CSV row " << num_rows_read + bad_row + 1 << " in "
+              << path << ": expected " << cols << " numeric fields"
+              << std::endl;
+    return false;
+  }
+  num_rows = rows;
+  num_rows_read += rows;
+  return true;
+}
+
+}  // namespace afs
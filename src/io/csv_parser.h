@@ -0,0 +1,105 @@
+#ifndef CSV_PARSER_H_
+#define CSV_PARSER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "utils/mapped_file.h"
+
+namespace afs {
+
+// Options of CsvParser. A zero delimiter is detected from the first line
+// (',', ';' or tab), and kAuto treats the first line as a header when its
+// first field is not a number.
+struct CsvOptions {
+  enum class Header { kAuto, kNone, kPresent };
+
+  char delimiter = 0;
+  Header header = Header::kAuto;
+  // Store the values column by column instead of row by row.
+  bool column_major = false;
+};
+
+// Parser for large CSV files of numeric values.
+//
+// The file is memory-mapped and cut into chunks at line boundaries. Chunks
+// are parsed in parallel, straight into their final place in the output:
+// a first pass counts the rows of each chunk, a second one converts the
+// fields with std::from_chars. Lines are found with memchr, which the C
+// library implements with SIMD instructions. Quoted fields are only
+// supported in the header.
+class CsvParser {
+ public:
+  explicit CsvParser(const CsvOptions &options = CsvOptions())
+      : options(options) {}
+
+  // Parse `path` into `values` (num_rows * num_cols floats). Returns false
+  // and prints the reason if the file cannot be read or a row does not have
+  // num_cols numeric fields.
+  bool Parse(const std::string &path, std::vector<float> &values);
+
+  size_t NumRows() const { return num_rows; }
+  size_t NumCols() const { return num_cols; }
+  char GetDelimiter() const { return delimiter; }
+  // Column names, empty without a header.
+  const std::vector<std::string> &GetHeader() const { return header; }
+
+ private:
+  CsvOptions options;
+  char delimiter = 0;
+  size_t num_rows = 0;
+  size_t num_cols = 0;
+  std::vector<std::string> header;
+};
+
+// Reads a CSV file like CsvParser, but a block of rows at a time, for files
+// too large to hold in memory once parsed. The file is memory-mapped and
+// read sequentially; the rows of a block are parsed in parallel.
+//
+//   CsvReader reader;
+//   if (!reader.Open(path)) ...
+//   size_t num_rows;
+//   while (reader.ReadRows(10000, values, num_rows) && num_rows > 0) {
+//     ... num_rows * reader.NumCols() values, row by row ...
+//   }
+class CsvReader {
+ public:
+  explicit CsvReader(const CsvOptions &options = CsvOptions())
+      : options(options) {}
+
+  bool Open(const std::string &path);
+
+  // Parse the next `max_rows` rows at most into `values`, row by row even
+  // with `column_major`, and set `num_rows` to the number read, 0 at the end
+  // of the file. Returns false and prints the reason if a row does not have
+  // NumCols() numeric fields.
+  bool ReadRows(size_t max_rows, std::vector<float> &values,
+                size_t &num_rows);
+
+  // Given by the first data row, 0 for a file without data.
+  size_t NumCols() const { return num_cols; }
+  // Data rows read so far.
+  size_t NumRowsRead() const { return num_rows_read; }
+  char GetDelimiter() const { return delimiter; }
+  const std::vector<std::string> &GetHeader() const { return header; }
+
+ private:
+  CsvOptions options;
+  std::string path;
+  MappedFile file;
+  // Unread part of the file.
+  const char *next = nullptr;
+  const char *end = nullptr;
+  char delimiter = 0;
+  size_t num_cols = 0;
+  size_t num_rows_read = 0;
+  std::vector<std::string> header;
+  // Bounds of the lines of the current block.
+  std::vector<const char *> line_begins;
+  std::vector<const char *> line_ends;
+};
+
+}  // namespace afs
+
+#endif
@@ -0,0 +1,174 @@
+#include "record_file.h"
+
+#include <glob.h>
+
+#include <cstring>
+#include <iostream>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The record format is little endian only"
+#endif
+
+namespace afs {
+
+namespace {
+
+const char kMagic[8] = {'A', 'F', 'S', 'R', 'E', 'C', 'R', 'D'};
+const uint32_t kVersion = 1;
+const uint64_t kDataOffset = 64;
+
+}  // namespace
+
+RecordWriter::~RecordWriter() {
+  if (file != nullptr) Close();
+}
+
+bool RecordWriter::Open(const std::string &path, const RecordSchema &schema) {
+  if (file != nullptr) Close();
+  this->path = path;
+  this->schema = schema;
+  offsets.clear();
+  end_offset = kDataOffset;
+  ok = true;
+
+  std::string tmp_path = path + ".tmp";
+  file = std::fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Error opening file: " << tmp_path << std::endl;
+    return false;
+  }
+  // The header is written last, once the index offset is known.
+  static const char kPadding[kDataOffset] = {};
+  ok = std::fwrite(kPadding, kDataOffset, 1, file) == 1;
+  return ok;
+}
+
+bool RecordWriter::Append(const void *data, size_t size) {
+  if (file == nullptr) return false;
+  offsets.push_back(end_offset);
+  end_offset += size;
+  ok = ok && (size == 0 || std::fwrite(data, size, 1, file) == 1);
+  return ok;
+}
+
+bool RecordWriter::Close() {
+  if (file == nullptr) return false;
+
+  RecordFileHeader header = RecordFileHeader();
+  std::memcpy(header.magic, kMagic, sizeof(header.magic));
+  header.version = kVersion;
+  header.num_records = offsets.size();
+  header.index_offset = (end_offset + 7) / 8 * 8;
+  header.schema = schema;
+
+  static const char kPadding[8] = {};
+  offsets.push_back(end_offset);
+  const size_t padding = header.index_offset - end_offset;
+  ok = ok && (padding == 0 || std::fwrite(kPadding, padding, 1, file) == 1);
+  ok = ok && std::fwrite(offsets.data(), sizeof(uint64_t), offsets.size(),
+                         file) == offsets.size();
+  ok = ok && std::fseek(file, 0, SEEK_SET) == 0;
+  ok = ok && std::fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = std::fclose(file) == 0 && ok;
+  file = nullptr;
+  offsets.clear();
+
+  std::string tmp_path = path + ".tmp";
+  if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << "Error writing file: " << path << std::endl;
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool RecordReader::Open(const std::string &path) {
+  // Forget the previous shard first, so that a failed Open() leaves no
+  // records behind.
+  schema = RecordSchema();
+  num_records = 0;
+  index = nullptr;
+  if (!file.Open(path)) return false;
+
+  const RecordFileHeader *header =
+      reinterpret_cast<const RecordFileHeader *>(file.Data());
+  const uint64_t size = file.Size();
+  bool valid = size >= kDataOffset &&
+               std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 &&
+               header->version == kVersion &&
+               header->index_offset % 8 == 0 &&
+               header->index_offset <= size &&
+               header->num_records <
+                   (size - header->index_offset) / sizeof(uint64_t);
+  if (valid) {
+    index = reinterpret_cast<const uint64_t *>(file.Data() +
+                                               header->index_offset);
+    // Offsets must be increasing and stay in the record area.
+    valid = index[0] >= kDataOffset;
+    for (size_t i = 0; valid && i < header->num_records; ++i) {
+      valid = index[i] <= index[i + 1];
+    }
+    valid = valid && index[header->num_records] <= header->index_offset;
+  }
+  if (!valid) {
+    std::cerr << "Invalid record file: " << path << std::endl;
+    file.Close();
+    index = nullptr;
+    return false;
+  }
+
+  schema = header->schema;
+  num_records = header->num_records;
+  return true;
+}
+
+std::string RecordReader::ShardName(const std::string &prefix, size_t index,
+                                    size_t count) {
+  char suffix[64];
+  std::snprintf(suffix, sizeof(suffix), "-%05zu-of-%05zu.afsrec", index,
+                count);
+  return prefix + suffix;
+}
+
+std::vector<std::string> RecordReader::ListShards(const std::string &prefix) {
+  std::vector<std::string> shards;
+  glob_t matches;
+  std::string pattern = prefix + "-[0-9]*-of-[0-9]*.afsrec";
+  if (glob(pattern.c_str(), 0, nullptr, &matches) != 0) {
+    globfree(&matches);
+    return shards;
+  }
+
+  // All shards must come from the same set: one count N, and each index
+  // below N exactly once. Otherwise a stale shard of an earlier conversion,
+  // or a missing one, would silently change the dataset.
+  bool valid = true;
+  size_t count = 0;
+  for (size_t i = 0; valid && i < matches.gl_pathc; ++i) {
+    const std::string name = matches.gl_pathv[i];
+    size_t shard_index, shard_count;
+    int end = 0;
+    valid = std::sscanf(name.c_str() + prefix.size(), "-%zu-of-%zu.afsrec%n",
+                        &shard_index, &shard_count, &end) == 2 &&
+            prefix.size() + end == name.size() &&
+            (i == 0 || shard_count == count) && shard_index < shard_count &&
+            shard_count == matches.gl_pathc;
+    if (!valid) break;
+    if (i == 0) {
+      count = shard_count;
+      shards.resize(count);
+    }
+    valid = shards[shard_index].empty();
+    shards[shard_index] = name;
+  }
+  globfree(&matches);
+
+  if (!valid) {
+    std::cerr << "Shards of " << prefix << " do not form one complete set "
+              << "<prefix>-<index>-of-<count>.afsrec" << std::endl;
+    shards.clear();
+  }
+  return shards;
+}
+
+}  // namespace afs
@@ -0,0 +1,122 @@
+#ifndef RECORD_FILE_H_
+#define RECORD_FILE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "utils/mapped_file.h"
+
+namespace afs {
+
+// Sharded record container (*.afsrec) for datasets that do not fit in
+// memory. A dataset is split into shards named
+// <prefix>-<index>-of-<count>.afsrec, each read through mmap.
+//
+// Layout of a shard, little endian:
+//   RecordFileHeader                            64 bytes
+//   records, back to back (fixed or variable length)
+//   index: uint64[num_records + 1] record offsets, 8-byte aligned
+//
+// Sample records hold the target followed by the sample, as described by the
+// schema in the header:
+//   - target: one label byte if num_classes > 0, else target_size float32
+//   - sample: rows * cols * channels uint8 or float32 values, stored as
+//     [channels][rows][cols]
+
+enum class RecordDataType : uint32_t { kUInt8 = 1, kFloat32 = 2 };
+
+struct RecordSchema {
+  RecordDataType data_type = RecordDataType::kUInt8;
+  uint32_t rows = 0;
+  uint32_t cols = 0;
+  uint32_t channels = 0;
+  uint32_t num_classes = 0;
+  uint32_t target_size = 0;
+  // Normalization applied when a sample is decoded, as in Dataset.
+  uint32_t l2_normalize = 0;
+  float scale = 1.0f;
+  float offset = 0.0f;
+
+  size_t SampleSize() const { return (size_t)rows * cols * channels; }
+  size_t SampleBytes() const {
+    return SampleSize() *
+           (data_type == RecordDataType::kUInt8 ? 1 : sizeof(float));
+  }
+  size_t TargetBytes() const {
+    return num_classes > 0 ? 1 : target_size * sizeof(float);
+  }
+};
+
+struct RecordFileHeader {
+  char magic[8];
+  uint32_t version;
+  RecordSchema schema;
+  uint64_t num_records;
+  uint64_t index_offset;
+};
+static_assert(sizeof(RecordSchema) == 36, "Unexpected schema size");
+static_assert(sizeof(RecordFileHeader) == 64, "Unexpected header size");
+
+// Writes one shard. Records are appended through a buffered stream; the
+// index and header are written by Close().
+class RecordWriter {
+ public:
+  RecordWriter() {}
+  ~RecordWriter();
+
+  RecordWriter(const RecordWriter &) = delete;
+  RecordWriter &operator=(const RecordWriter &) = delete;
+
+  bool Open(const std::string &path, const RecordSchema &schema);
+  bool Append(const void *data, size_t size);
+  // Write the index and move the shard into place. Returns false on I/O
+  // errors.
+  bool Close();
+
+  size_t NumRecords() const { return offsets.size(); }
+
+ private:
+  std::string path;
+  std::FILE *file = nullptr;
+  RecordSchema schema;
+  std::vector<uint64_t> offsets;
+  uint64_t end_offset = 0;
+  bool ok = true;
+};
+
+class RecordReader {
+ public:
+  bool Open(const std::string &path);
+
+  size_t NumRecords() const { return num_records; }
+  const RecordSchema &GetSchema() const { return schema; }
+
+  // Zero-copy view of record i.
+  const uint8_t *GetRecord(size_t i, size_t &size) const {
+    size = index[i + 1] - index[i];
+    return file.Data() + index[i];
+  }
+
+  // Hint the kernel about the upcoming access pattern, e.g. MADV_WILLNEED
+  // to read the shard ahead, or MADV_SEQUENTIAL.
+  void Advise(int advice) const { file.Advise(advice); }
+
+  // Shards written for `prefix`, in order. Empty if there are none, or,
+  // with a message, if they do not all have the same count N or are not
+  // exactly the N shards of that count.
+  static std::vector<std::string> ListShards(const std::string &prefix);
+  static std::string ShardName(const std::string &prefix, size_t index,
+                               size_t count);
+
+ private:
+  MappedFile file;
+  RecordSchema schema;
+  size_t num_records = 0;
+  const uint64_t *index = nullptr;
+};
+
+}  // namespace afs
+
+#endif
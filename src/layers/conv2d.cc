@@ -1,6 +1,8 @@
 #include "conv2d.h"
 #include "utils/weight_initializer.h"
 #include "utils/random_generator.h"
+#include "utils/alloc_profiler.h"
+#include "utils/trace.h"
 
 namespace afs {
 
@@ -28,10 +30,46 @@ Conv2D::Conv2D(size_t input_height, size_t input_width, size_t input_depth,
     });
   }
 
+  accumulated_grad_filters.resize(num_filters);
   ResetGradient();
 }
 
+Conv2D::Conv2D(size_t input_height, size_t input_width, size_t input_depth,
+               size_t filter_height, size_t filter_width,
+               size_t horizontal_stride, size_t vertical_stride,
+               size_t num_filters, const double *filters_data)
+    : input_height(input_height),
+      input_width(input_width),
+      input_depth(input_depth),
+      filter_height(filter_height),
+      filter_width(filter_width),
+      horizontal_stride(horizontal_stride),
+      vertical_stride(vertical_stride),
+      num_filters(num_filters) {
+  // Strict views: armadillo never reallocates or copies them. The memory is
+  // only read, so dropping const is safe.
+  double *data = const_cast<double *>(filters_data);
+  const size_t filter_size = filter_height * filter_width * input_depth;
+  filters.reserve(num_filters);
+  for (size_t i = 0; i < num_filters; ++i) {
+    filters.emplace_back(data + i * filter_size, filter_height, filter_width,
+                         input_depth, false, true);
+  }
+}
+
 void Conv2D::Forward(arma::cube &input, arma::cube &output) {
+  AFS_TRACE_SCOPE("Conv2D::Forward");
+  AFS_ALLOC_SCOPE("Conv2D", this, kForward);
+  Predict(input, output);
+
+  // Store the input and output. This will be needed by the backward pass.
+  this->input = input;
+  this->output = output;
+}
+
+void Conv2D::Predict(const arma::cube &input, arma::cube &output) const {
+  AFS_TRACE_SCOPE("Conv2D::Predict");
+  AFS_ALLOC_SCOPE("Conv2D", this, kForward);
   // The filter dimensions and strides must satisfy some contraints for
   // the convolution operation to be well defined
   assert((input_height - filter_height) % vertical_stride == 0);
@@ -42,9 +80,11 @@ void Conv2D::Forward(arma::cube &input, arma::cube &output) {
                        (input_width - filter_width) / horizontal_stride + 1,
                        num_filters);
 
-  // Perform convolution for each filter
+  // Perform convolution for each filter. Each filter is traced on the thread
+  // that computes it, which shows how the OpenMP threads share the work.
   #pragma omp parallel for
   for (size_t i = 0; i < num_filters; ++i) {
+    AFS_TRACE_SCOPE("Conv2D::Forward/filter");
     #pragma omp parallel for
     for (size_t j = 0; j <= input_height - filter_height; j += vertical_stride) {
       #pragma omp parallel for
@@ -62,13 +102,11 @@ void Conv2D::Forward(arma::cube &input, arma::cube &output) {
       }
     }
   }
-
-  // Store the input and output. This will be needed by the backward pass.
-  this->input = input;
-  this->output = output;
 }
 
 void Conv2D::Backward(arma::cube &upstream_gradient) {
+  AFS_TRACE_SCOPE("Conv2D::Backward");
+  AFS_ALLOC_SCOPE("Conv2D", this, kBackward);
   // Upstream gradient must have same dimensions as the output.
   assert(upstream_gradient.n_slices == num_filters);
   assert(upstream_gradient.n_rows == output.n_rows);
@@ -106,6 +144,7 @@ void Conv2D::Backward(arma::cube &upstream_gradient) {
   // Compute the gradient wrt filters.
   #pragma omp parallel for
   for (size_t i = 0; i < num_filters; ++i) {
+    AFS_TRACE_SCOPE("Conv2D::Backward/filter");
     for (size_t j = 0; j < output.n_rows; ++j) {
       for (size_t k = 0; k < output.n_cols; ++k) {
         arma::cube tmp(arma::size(filters[i]), arma::fill::zeros);
@@ -126,6 +165,8 @@ void Conv2D::Backward(arma::cube &upstream_gradient) {
 }
 
 void Conv2D::UpdateFilterWeights(size_t batch_size, double learning_rate) {
+  AFS_TRACE_SCOPE("Conv2D::UpdateFilterWeights");
+  AFS_ALLOC_SCOPE("Conv2D", this, kUpdate);
 
   #pragma omp parallel for
   for (size_t i = 0; i < num_filters; ++i) {
@@ -135,18 +176,55 @@ void Conv2D::UpdateFilterWeights(size_t batch_size, double learning_rate) {
   ResetGradient();
 }
 
+void Conv2D::RegisterParameters(ParameterStore &store) {
+  for (size_t i = 0; i < num_filters; ++i) {
+    store.Register(filters[i], accumulated_grad_filters[i]);
+  }
+}
+
 void Conv2D::ResetGradient() {
-  accumulated_grad_filters.clear();
-  accumulated_grad_filters.resize(num_filters);
+  // Zero in place: the accumulated gradients may be views into a
+  // ParameterStore.
   #pragma omp parallel for
   for (size_t i = 0; i < num_filters; ++i) {
-    accumulated_grad_filters[i] = arma::zeros(filter_height, filter_width, input_depth);
+    accumulated_grad_filters[i].zeros(filter_height, filter_width, input_depth);
+  }
+  accumulated_grad_input.zeros(input_height, input_width, input_depth);
+}
+
+void Conv2D::SetFilters(const std::vector<arma::cube> &filters) {
+  assert(filters.size() == num_filters);
+  // Assign element-wise so that filters bound to a ParameterStore stay bound.
+  for (size_t i = 0; i < num_filters; ++i) {
+    assert(arma::size(filters[i]) == arma::size(this->filters[i]));
+    this->filters[i] = filters[i];
   }
-  accumulated_grad_input = arma::zeros(input_height, input_width, input_depth);
 }
 
 std::vector<arma::cube> Conv2D::GetFilters() { return this->filters; }
 arma::cube Conv2D::GetGradientWrtInput() { return grad_input; }
 std::vector<arma::cube> Conv2D::GetGradientWrtFilters() { return grad_filters; }
 
+LayerCost Conv2D::GetCost() const {
+  const double input_size =
+      static_cast<double>(input_height) * input_width * input_depth;
+  const double output_size =
+      static_cast<double>((input_height - filter_height) / vertical_stride + 1) *
+      ((input_width - filter_width) / horizontal_stride + 1) * num_filters;
+  const double filter_size =
+      static_cast<double>(filter_height) * filter_width * input_depth;
+  const double num_weights = filter_size * num_filters;
+
+  LayerCost cost;
+  // One multiply-add per filter value and output value.
+  cost.forward_flops = 2 * output_size * filter_size;
+  cost.forward_bytes = sizeof(double) * (input_size + num_weights + output_size);
+  // Gradients wrt the input and wrt the filters.
+  cost.backward_flops = 2 * cost.forward_flops;
+  cost.backward_bytes =
+      sizeof(double) * (2 * input_size + 2 * num_weights + output_size);
+  cost.num_parameters = num_weights;
+  return cost;
+}
+
 }  // namespace afs
@@ -7,6 +7,9 @@
 #include <iostream>
 #include <vector>
 
+#include "layers/layer_cost.h"
+#include "optimizers/parameter_store.h"
+
 namespace afs {
 
 class Conv2D {
@@ -34,14 +37,44 @@ class Conv2D {
          size_t filter_height, size_t filter_width, size_t horizontal_stride,
          size_t vertical_stride, size_t num_filters,
          const std::string& weight_initializer = "he");
+  // Inference-only layer over `num_filters` filters of filter_height x
+  // filter_width x input_depth values stored back to back at `filters_data`,
+  // e.g. in a mapped checkpoint. The filters are read-only views of that
+  // memory: nothing is initialized, copied or allocated for gradients, so
+  // only Predict() may be called. `filters_data` must outlive the layer;
+  // copies of the layer own their filters.
+  Conv2D(size_t input_height, size_t input_width, size_t input_depth,
+         size_t filter_height, size_t filter_width, size_t horizontal_stride,
+         size_t vertical_stride, size_t num_filters,
+         const double* filters_data);
   void Forward(arma::cube& input, arma::cube& output);
+  // Forward pass without keeping anything for the backward pass.
+  void Predict(const arma::cube& input, arma::cube& output) const;
   void Backward(arma::cube& upstream_gradient);
   void UpdateFilterWeights(size_t batch_size, double learning_rate);
 
+  // Move the filters and their accumulated gradients into `store`. Use this
+  // instead of UpdateFilterWeights() to train with an Optimizer.
+  void RegisterParameters(ParameterStore& store);
+
   std::vector<arma::cube> GetFilters();
+  const arma::cube& GetFilter(size_t i) const { return filters[i]; }
+  void SetFilters(const std::vector<arma::cube>& filters);
   arma::cube GetGradientWrtInput();
   std::vector<arma::cube> GetGradientWrtFilters();
 
+  size_t GetInputHeight() const { return input_height; }
+  size_t GetInputWidth() const { return input_width; }
+  size_t GetInputDepth() const { return input_depth; }
+  size_t GetFilterHeight() const { return filter_height; }
+  size_t GetFilterWidth() const { return filter_width; }
+  size_t GetHorizontalStride() const { return horizontal_stride; }
+  size_t GetVerticalStride() const { return vertical_stride; }
+  size_t GetNumFilters() const { return num_filters; }
+
+  // Analytic FLOPs and bytes of one sample, see LayerCost.
+  LayerCost GetCost() const;
+
  private:
   void ResetGradient();
 };
@@ -2,6 +2,8 @@
 
 #include "utils/weight_initializer.h"
 #include "utils/data_transformer.h"
+#include "utils/alloc_profiler.h"
+#include "utils/trace.h"
 
 namespace afs {
 
@@ -19,20 +21,47 @@ Dense::Dense(size_t num_inputs, size_t num_outputs, const std::string &weight_in
   ResetGradient();
 }
 
+Dense::Dense(size_t num_inputs, size_t num_outputs, const double *weights_data,
+             const double *biases_data)
+    : num_inputs(num_inputs),
+      num_outputs(num_outputs),
+      // Strict views: armadillo never reallocates or copies them. The memory
+      // is only read, so dropping const is safe.
+      weights(const_cast<double *>(weights_data), num_outputs, num_inputs,
+              false, true),
+      biases(const_cast<double *>(biases_data), num_outputs, false, true) {}
+
 void Dense::Forward(const arma::cube& input, arma::vec& output) {
   arma::vec input_vec = DataTransformer::FlattenCube(input);
   Dense::Forward(input_vec, output);
 }
 
 void Dense::Forward(const arma::vec& input, arma::vec& output) {
-  output = (weights * input) + biases;
+  AFS_TRACE_SCOPE("Dense::Forward");
+  AFS_ALLOC_SCOPE("Dense", this, kForward);
+  Predict(input, output);
 
   // Save input, output for calculating gradient
   this->input = input;
   this->output = output;
 }
 
+void Dense::Predict(const arma::cube& input, arma::vec& output) const {
+  // View the cube as the vector FlattenCube() would return, without copying.
+  const arma::vec input_vec(const_cast<double*>(input.memptr()), input.n_elem,
+                            false, true);
+  Predict(input_vec, output);
+}
+
+void Dense::Predict(const arma::vec& input, arma::vec& output) const {
+  AFS_TRACE_SCOPE("Dense::Predict");
+  AFS_ALLOC_SCOPE("Dense", this, kForward);
+  output = (weights * input) + biases;
+}
+
 void Dense::Backward(arma::vec& upstream_gradient) {
+  AFS_TRACE_SCOPE("Dense::Backward");
+  AFS_ALLOC_SCOPE("Dense", this, kBackward);
   // Calculate input gradient
   grad_input = arma::zeros(num_inputs);
 
@@ -56,15 +85,49 @@ void Dense::Backward(arma::vec& upstream_gradient) {
 }
 
 void Dense::UpdateWeightsAndBiases(size_t batch_size, double learning_rate) {
+  AFS_TRACE_SCOPE("Dense::UpdateWeightsAndBiases");
+  AFS_ALLOC_SCOPE("Dense", this, kUpdate);
   weights = weights - learning_rate * (accumulated_grad_weights / batch_size);
   biases = biases - learning_rate * (accumulated_grad_biases / batch_size);
   ResetGradient();
 }
 
+void Dense::SetWeights(const arma::mat& weights) {
+  assert(weights.n_rows == num_outputs && weights.n_cols == num_inputs);
+  this->weights = weights;
+}
+
+void Dense::SetBiases(const arma::vec& biases) {
+  assert(biases.n_elem == num_outputs);
+  this->biases = biases;
+}
+
+LayerCost Dense::GetCost() const {
+  const double num_weights = static_cast<double>(num_inputs) * num_outputs;
+
+  LayerCost cost;
+  cost.forward_flops = 2 * num_weights + num_outputs;
+  cost.forward_bytes =
+      sizeof(double) * (num_weights + num_inputs + 2 * num_outputs);
+  // Gradients wrt the input, the weights and the biases.
+  cost.backward_flops = 4 * num_weights + num_outputs;
+  cost.backward_bytes =
+      sizeof(double) * (2 * num_weights + 2 * num_inputs + 2 * num_outputs);
+  cost.num_parameters = num_weights + num_outputs;
+  return cost;
+}
+
+void Dense::RegisterParameters(ParameterStore &store) {
+  store.Register(weights, accumulated_grad_weights);
+  store.Register(biases, accumulated_grad_biases);
+}
+
 void Dense::ResetGradient() {
-  accumulated_grad_input = arma::zeros(num_inputs);
-  accumulated_grad_weights = arma::zeros(num_outputs, num_inputs);
-  accumulated_grad_biases = arma::zeros(num_outputs);
+  // Zero in place: the accumulated gradients may be views into a
+  // ParameterStore.
+  accumulated_grad_input.zeros(num_inputs);
+  accumulated_grad_weights.zeros(num_outputs, num_inputs);
+  accumulated_grad_biases.zeros(num_outputs);
 }
 
 }  // namespace afs
@@ -6,6 +6,9 @@
 #include <cmath>
 #include <vector>
 
+#include "layers/layer_cost.h"
+#include "optimizers/parameter_store.h"
+
 namespace afs {
 
 class Dense {
@@ -14,13 +17,39 @@ class Dense {
   // Construct dense (fully connected layer)
   Dense(size_t num_inputs, size_t num_outputs,
        const std::string &weight_initializer="xavier");
+  // Inference-only layer over the num_outputs x num_inputs column-major
+  // weights at `weights_data` and the num_outputs biases at `biases_data`,
+  // e.g. in a mapped checkpoint. The parameters are read-only views of that
+  // memory: nothing is initialized, copied or allocated for gradients, so
+  // only Predict() may be called. The memory must outlive the layer; copies
+  // of the layer own their parameters.
+  Dense(size_t num_inputs, size_t num_outputs, const double *weights_data,
+        const double *biases_data);
 
   void Forward(const arma::vec& input, arma::vec& output);
   void Forward(const arma::cube& input, arma::vec& output);
+  // Forward pass without keeping anything for the backward pass.
+  void Predict(const arma::vec& input, arma::vec& output) const;
+  void Predict(const arma::cube& input, arma::vec& output) const;
   void Backward(arma::vec& upstream_gradient);
   arma::vec GetGradientWrtInput() { return grad_input; }
+
+  size_t GetNumInputs() const { return num_inputs; }
+  size_t GetNumOutputs() const { return num_outputs; }
+  const arma::mat& GetWeights() const { return weights; }
+  const arma::vec& GetBiases() const { return biases; }
+  void SetWeights(const arma::mat& weights);
+  void SetBiases(const arma::vec& biases);
+
+  // Analytic FLOPs and bytes of one sample, see LayerCost.
+  LayerCost GetCost() const;
+
   void UpdateWeightsAndBiases(size_t batch_size, double learning_rate);
 
+  // Move the weights, biases and their accumulated gradients into `store`.
+  // Use this instead of UpdateWeightsAndBiases() to train with an Optimizer.
+  void RegisterParameters(ParameterStore &store);
+
  private:
   size_t num_inputs;
   size_t num_outputs;
@@ -2,6 +2,8 @@
 
 #include "utils/random_generator.h"
 #include "utils/data_transformer.h"
+#include "utils/alloc_profiler.h"
+#include "utils/trace.h"
 
 namespace afs {
 
@@ -26,6 +28,8 @@ void Dropout::Forward(const arma::cube& input, arma::cube& output,
 
 void Dropout::Forward(const arma::vec& input, arma::vec& output,
                       const DropoutMode mode) {
+  AFS_TRACE_SCOPE("Dropout::Forward");
+  AFS_ALLOC_SCOPE("Dropout", this, kForward);
   if (mode == DropoutMode::kTrain) {
     dropout_mask = arma::zeros(input.n_rows);
     dropout_mask = dropout_mask.imbue(
@@ -39,6 +43,8 @@ void Dropout::Forward(const arma::vec& input, arma::vec& output,
 }
 
 arma::vec Dropout::Backward(const arma::vec& upstream_gradient) {
+  AFS_TRACE_SCOPE("Dropout::Backward");
+  AFS_ALLOC_SCOPE("Dropout", this, kBackward);
   arma::vec grad_input = upstream_gradient % dropout_mask;
   return grad_input;
 }
@@ -53,4 +59,14 @@ arma::cube Dropout::Backward(const arma::cube& upstream_gradient) {
   return grad_input;
 }
 
+LayerCost Dropout::GetCost(size_t num_inputs) const {
+  LayerCost cost;
+  // Draw, compare and scale the mask, then multiply.
+  cost.forward_flops = 4.0 * num_inputs;
+  cost.forward_bytes = sizeof(double) * 3.0 * num_inputs;
+  cost.backward_flops = num_inputs;
+  cost.backward_bytes = sizeof(double) * 3.0 * num_inputs;
+  return cost;
+}
+
 }  // namespace afs
@@ -6,6 +6,8 @@
 #include <cmath>
 #include <vector>
 
+#include "layers/layer_cost.h"
+
 namespace afs {
 
 enum class DropoutMode {kTrain, kTest};
@@ -17,9 +19,21 @@ class Dropout {
 
   void Forward(const arma::vec& input, arma::vec& output, const DropoutMode mode = DropoutMode::kTrain);
   void Forward(const arma::cube& input, arma::cube& output, const DropoutMode mode = DropoutMode::kTrain);
+  // Test-time forward pass: the identity.
+  void Predict(const arma::vec& input, arma::vec& output) const {
+    output = input;
+  }
+  void Predict(const arma::cube& input, arma::cube& output) const {
+    output = input;
+  }
   arma::vec Backward(const arma::vec& upstream_gradient);
   arma::cube Backward(const arma::cube& upstream_gradient);
   arma::vec GetGradientWrtInput() { return grad_input; }
+  float GetKeepProp() const { return keep_prop; }
+
+  // Analytic FLOPs and bytes of one sample of `num_inputs` values, see
+  // LayerCost. The layer itself works on any input size.
+  LayerCost GetCost(size_t num_inputs) const;
 
  private:
   float keep_prop;
@@ -0,0 +1,93 @@
+#ifndef FIXED_DENSE_H_
+#define FIXED_DENSE_H_
+
+#include <armadillo>
+#include <string>
+
+#include "utils/weight_initializer.h"
+
+namespace afs {
+namespace fixed {
+
+// Dense (fully connected) layer with compile-time shape, for tiny networks.
+// All members are fixed-size armadillo objects living inside the layer, and
+// the loops have constant trip counts, so Forward() and Backward() are fully
+// inlined and never touch the heap.
+template <size_t In, size_t Out>
+class Dense {
+ public:
+  typedef arma::vec::fixed<In> Input;
+  typedef arma::vec::fixed<Out> Output;
+
+  explicit Dense(const std::string &weight_initializer = "xavier") {
+    WeightInitializer w_initializer(weight_initializer, In);
+    for (size_t i = 0; i < Out * In; ++i) {
+      weights[i] = w_initializer.GetRandomWeight();
+    }
+    biases.zeros();
+    ResetGradient();
+  }
+
+  void Forward(const Input &input, Output &output) {
+    for (size_t o = 0; o < Out; ++o) output[o] = biases[o];
+    // Weights are column-major: column i holds the weights of input i.
+    for (size_t i = 0; i < In; ++i) {
+      for (size_t o = 0; o < Out; ++o) {
+        output[o] += weights[i * Out + o] * input[i];
+      }
+    }
+
+    // Save input for calculating gradient
+    this->input = input;
+  }
+
+  void Backward(const Output &upstream_gradient) {
+    for (size_t i = 0; i < In; ++i) {
+      double sum = 0.0;
+      for (size_t o = 0; o < Out; ++o) {
+        sum += weights[i * Out + o] * upstream_gradient[o];
+        accumulated_grad_weights[i * Out + o] +=
+            upstream_gradient[o] * input[i];
+      }
+      grad_input[i] = sum;
+    }
+    for (size_t o = 0; o < Out; ++o) {
+      accumulated_grad_biases[o] += upstream_gradient[o];
+    }
+  }
+
+  const Input &GetGradientWrtInput() const { return grad_input; }
+
+  void UpdateWeightsAndBiases(size_t batch_size, double learning_rate) {
+    const double step = learning_rate / batch_size;
+    for (size_t i = 0; i < Out * In; ++i) {
+      weights[i] -= step * accumulated_grad_weights[i];
+    }
+    for (size_t o = 0; o < Out; ++o) {
+      biases[o] -= step * accumulated_grad_biases[o];
+    }
+    ResetGradient();
+  }
+
+  const arma::mat &GetWeights() const { return weights; }
+  const arma::vec &GetBiases() const { return biases; }
+
+ private:
+  arma::mat::fixed<Out, In> weights;
+  Output biases;
+
+  Input input;
+  Input grad_input;
+  arma::mat::fixed<Out, In> accumulated_grad_weights;
+  Output accumulated_grad_biases;
+
+  void ResetGradient() {
+    accumulated_grad_weights.zeros();
+    accumulated_grad_biases.zeros();
+  }
+};
+
+}  // namespace fixed
+}  // namespace afs
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef FIXED_RELU_H_
+#define FIXED_RELU_H_
+
+#include <armadillo>
+
+namespace afs {
+namespace fixed {
+
+// ReLU activation with compile-time size. See fixed::Dense.
+template <size_t N>
+class ReLU {
+ public:
+  typedef arma::vec::fixed<N> Vector;
+
+  void Forward(const Vector &input, Vector &output) {
+    // ReLU(x) = max(0, x)
+    for (size_t i = 0; i < N; ++i) output[i] = input[i] > 0 ? input[i] : 0.0;
+    this->input = input;
+  }
+
+  void Backward(const Vector &upstream_gradient) {
+    for (size_t i = 0; i < N; ++i) {
+      grad_input[i] = input[i] > 0 ? upstream_gradient[i] : 0.0;
+    }
+  }
+
+  const Vector &GetGradientWrtInput() const { return grad_input; }
+
+ private:
+  Vector input;
+  Vector grad_input;
+};
+
+}  // namespace fixed
+}  // namespace afs
+
+#endif
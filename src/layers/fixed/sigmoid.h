@@ -0,0 +1,39 @@
+#ifndef FIXED_SIGMOID_H_
+#define FIXED_SIGMOID_H_
+
+#include <armadillo>
+#include <cmath>
+
+namespace afs {
+namespace fixed {
+
+// Sigmoid activation with compile-time size. See fixed::Dense.
+template <size_t N>
+class Sigmoid {
+ public:
+  typedef arma::vec::fixed<N> Vector;
+
+  void Forward(const Vector &input, Vector &output) {
+    // Sigmoid(x) = 1 / 1 + e^(-x)
+    for (size_t i = 0; i < N; ++i) output[i] = 1.0 / (1.0 + std::exp(-input[i]));
+    this->output = output;
+  }
+
+  void Backward(const Vector &upstream_gradient) {
+    // Derivative of sigmoid = sigmoid * (1 - sigmoid)
+    for (size_t i = 0; i < N; ++i) {
+      grad_wrt_input[i] = output[i] * (1.0 - output[i]) * upstream_gradient[i];
+    }
+  }
+
+  const Vector &GetGradientWrtInput() const { return grad_wrt_input; }
+
+ private:
+  Vector output;
+  Vector grad_wrt_input;
+};
+
+}  // namespace fixed
+}  // namespace afs
+
+#endif
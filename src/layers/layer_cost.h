@@ -0,0 +1,32 @@
+#ifndef LAYER_COST_H_
+#define LAYER_COST_H_
+
+#include <cstddef>
+
+namespace afs {
+
+// Analytic cost of one sample through a layer of a given shape: the
+// floating-point operations of the computation itself, and the bytes of the
+// inputs, parameters, outputs and gradients it has to read or write at
+// least once. It does not depend on how the layer is implemented, so the
+// measured time against it tells how far the implementation is from the
+// hardware limits.
+struct LayerCost {
+  double forward_flops = 0.0;
+  double forward_bytes = 0.0;
+  double backward_flops = 0.0;
+  double backward_bytes = 0.0;
+  size_t num_parameters = 0;
+
+  // FLOPs per byte of the forward pass, the x axis of a roofline plot.
+  double ForwardIntensity() const {
+    return forward_bytes > 0.0 ? forward_flops / forward_bytes : 0.0;
+  }
+  double BackwardIntensity() const {
+    return backward_bytes > 0.0 ? backward_flops / backward_bytes : 0.0;
+  }
+};
+
+}  // namespace afs
+
+#endif
@@ -4,6 +4,9 @@
 #include <cassert>
 #include <iostream>
 
+#include "utils/alloc_profiler.h"
+#include "utils/trace.h"
+
 namespace afs {
 
 MaxPooling::MaxPooling(size_t input_height, size_t input_width,
@@ -19,6 +22,16 @@ MaxPooling::MaxPooling(size_t input_height, size_t input_width,
       horizontal_stride(horizontal_stride) {}
 
 void MaxPooling::Forward(arma::cube& input, arma::cube& output) {
+  AFS_TRACE_SCOPE("MaxPooling::Forward");
+  AFS_ALLOC_SCOPE("MaxPooling", this, kForward);
+  Predict(input, output);
+  this->input = input;
+  this->output = output;
+}
+
+void MaxPooling::Predict(const arma::cube& input, arma::cube& output) const {
+  AFS_TRACE_SCOPE("MaxPooling::Predict");
+  AFS_ALLOC_SCOPE("MaxPooling", this, kForward);
   assert((input_height - pooling_window_height) % vertical_stride == 0);
   assert((input_width - pooling_window_width) % horizontal_stride == 0);
   output = arma::zeros(
@@ -41,12 +54,11 @@ void MaxPooling::Forward(arma::cube& input, arma::cube& output) {
       }
     }
   }
-
-  this->input = input;
-  this->output = output;
 }
 
 void MaxPooling::Backward(arma::cube& upstream_gradient) {
+  AFS_TRACE_SCOPE("MaxPooling::Backward");
+  AFS_ALLOC_SCOPE("MaxPooling", this, kBackward);
   assert(upstream_gradient.n_rows == output.n_rows);
   assert(upstream_gradient.n_cols == output.n_cols);
   assert(upstream_gradient.n_slices == output.n_slices);
@@ -70,6 +82,26 @@ void MaxPooling::Backward(arma::cube& upstream_gradient) {
   }
 }
 
+LayerCost MaxPooling::GetCost() const {
+  const double input_size =
+      static_cast<double>(input_height) * input_width * input_depth;
+  const double output_size =
+      static_cast<double>((input_height - pooling_window_height) /
+                              vertical_stride + 1) *
+      ((input_width - pooling_window_width) / horizontal_stride + 1) *
+      input_depth;
+  const double window_size =
+      static_cast<double>(pooling_window_height) * pooling_window_width;
+
+  LayerCost cost;
+  // One comparison per value of each window, in both passes.
+  cost.forward_flops = output_size * window_size;
+  cost.forward_bytes = sizeof(double) * (input_size + output_size);
+  cost.backward_flops = output_size * window_size;
+  cost.backward_bytes = sizeof(double) * (2 * input_size + output_size);
+  return cost;
+}
+
 arma::cube MaxPooling::GetGradientWrtInput() { return grad_input; }
 
 }  // namespace afs
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include <cassert>
 #include <iostream>
 
+#include "layers/layer_cost.h"
+
 namespace afs
 {
 
@@ -31,10 +33,23 @@ namespace afs
                size_t vertical_stride, size_t horizontal_stride);
 
     void Forward(arma::cube &input, arma::cube &output);
+    // Forward pass without keeping anything for the backward pass.
+    void Predict(const arma::cube &input, arma::cube &output) const;
     void Backward(arma::cube &upstream_gradient);
 
     arma::cube GetGradientWrtInput();
 
+    size_t GetInputHeight() const { return input_height; }
+    size_t GetInputWidth() const { return input_width; }
+    size_t GetInputDepth() const { return input_depth; }
+    size_t GetPoolingWindowHeight() const { return pooling_window_height; }
+    size_t GetPoolingWindowWidth() const { return pooling_window_width; }
+    size_t GetVerticalStride() const { return vertical_stride; }
+    size_t GetHorizontalStride() const { return horizontal_stride; }
+
+    // Analytic FLOPs and bytes of one sample, see LayerCost.
+    LayerCost GetCost() const;
+
   };
 
 } // namespace afs
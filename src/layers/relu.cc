@@ -6,6 +6,9 @@
 #include <iostream>
 #include <vector>
 
+#include "utils/alloc_profiler.h"
+#include "utils/trace.h"
+
 namespace afs {
 
 ReLU::ReLU(size_t input_height, size_t input_width, size_t input_depth)
@@ -14,14 +17,24 @@ ReLU::ReLU(size_t input_height, size_t input_width, size_t input_depth)
       input_depth(input_depth) {}
 
 void ReLU::Forward(arma::cube& input, arma::cube& output) {
+  AFS_TRACE_SCOPE("ReLU::Forward");
+  AFS_ALLOC_SCOPE("ReLU", this, kForward);
+  Predict(input, output);
+  this->input = input;
+  this->output = output;
+}
+
+void ReLU::Predict(const arma::cube& input, arma::cube& output) const {
+  AFS_TRACE_SCOPE("ReLU::Predict");
+  AFS_ALLOC_SCOPE("ReLU", this, kForward);
   // ReLU(x) = max(0, x)
   output = arma::zeros(arma::size(input));
   output = arma::max(input, output);
-  this->input = input;
-  this->output = output;
 }
 
 void ReLU::Backward(arma::cube upstream_gradient) {
+  AFS_TRACE_SCOPE("ReLU::Backward");
+  AFS_ALLOC_SCOPE("ReLU", this, kBackward);
   // Derivative of ReLU = 0 if x = 0
   //                    = 1 if x > 0
   // dL/d(ReLU): upstream_gradient
@@ -31,6 +44,18 @@ void ReLU::Backward(arma::cube upstream_gradient) {
   grad_input = grad_input % upstream_gradient;
 }
 
+LayerCost ReLU::GetCost() const {
+  const double size =
+      static_cast<double>(input_height) * input_width * input_depth;
+
+  LayerCost cost;
+  cost.forward_flops = size;
+  cost.forward_bytes = sizeof(double) * 2 * size;
+  cost.backward_flops = size;
+  cost.backward_bytes = sizeof(double) * 3 * size;
+  return cost;
+}
+
 arma::cube ReLU::GetGradientWrtInput() { return grad_input; }
 
 }  // namespace afs
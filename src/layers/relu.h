@@ -7,6 +7,8 @@
 #include <iostream>
 #include <vector>
 
+#include "layers/layer_cost.h"
+
 namespace afs {
 
 class ReLU {
@@ -23,9 +25,18 @@ class ReLU {
  public:
   ReLU(size_t input_height, size_t input_width, size_t input_depth);
   void Forward(arma::cube& input, arma::cube& output);
+  // Forward pass without keeping anything for the backward pass.
+  void Predict(const arma::cube& input, arma::cube& output) const;
   void Backward(arma::cube upstream_gradient);
 
   arma::cube GetGradientWrtInput();
+
+  size_t GetInputHeight() const { return input_height; }
+  size_t GetInputWidth() const { return input_width; }
+  size_t GetInputDepth() const { return input_depth; }
+
+  // Analytic FLOPs and bytes of one sample, see LayerCost.
+  LayerCost GetCost() const;
 };
 
 }  // namespace afs
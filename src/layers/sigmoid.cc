@@ -3,25 +3,48 @@
 #include <armadillo>
 #include <iostream>
 
+#include "utils/alloc_profiler.h"
+#include "utils/trace.h"
+
 namespace afs {
 
 Sigmoid::Sigmoid(size_t num_inputs) : num_inputs(num_inputs) {}
 
 void Sigmoid::Forward(const arma::vec& input, arma::vec& output) {
-  // Sigmoid(x) = 1 / 1 + e^(-x)
-  output = 1.0 / (1 + arma::exp(-input));
+  AFS_TRACE_SCOPE("Sigmoid::Forward");
+  AFS_ALLOC_SCOPE("Sigmoid", this, kForward);
+  Predict(input, output);
 
   this->input = input;
   this->output = output;
 }
 
+void Sigmoid::Predict(const arma::vec& input, arma::vec& output) const {
+  AFS_TRACE_SCOPE("Sigmoid::Predict");
+  AFS_ALLOC_SCOPE("Sigmoid", this, kForward);
+  // Sigmoid(x) = 1 / 1 + e^(-x)
+  output = 1.0 / (1 + arma::exp(-input));
+}
+
 void Sigmoid::Backward(const arma::vec& upstream_gradient) {
+  AFS_TRACE_SCOPE("Sigmoid::Backward");
+  AFS_ALLOC_SCOPE("Sigmoid", this, kBackward);
   // Derivative of sigmoid = sigmoid * (1 - sigmoid)
   // dL/d(sigmoid): upstream_gradient
   // dL/dx = d(sigmoid)/dx * dL/d(sigmoid)
   grad_wrt_input = this->output % (1.0 - this->output) % upstream_gradient;
 }
 
+LayerCost Sigmoid::GetCost() const {
+  LayerCost cost;
+  // exp, add and divide per value, then two multiplies and a subtraction.
+  cost.forward_flops = 3.0 * num_inputs;
+  cost.forward_bytes = sizeof(double) * 2.0 * num_inputs;
+  cost.backward_flops = 3.0 * num_inputs;
+  cost.backward_bytes = sizeof(double) * 3.0 * num_inputs;
+  return cost;
+}
+
 arma::vec Sigmoid::GetGradientWrtInput() { return grad_wrt_input; }
 
 }  // namespace afs
\ No newline at end of file
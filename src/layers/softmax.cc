@@ -3,11 +3,25 @@
 #include <armadillo>
 #include <iostream>
 
+#include "utils/alloc_profiler.h"
+#include "utils/trace.h"
+
 namespace afs {
 
 Softmax::Softmax(size_t num_inputs) : num_inputs(num_inputs) {}
 
 void Softmax::Forward(const arma::vec& input, arma::vec& output) {
+  AFS_TRACE_SCOPE("Softmax::Forward");
+  AFS_ALLOC_SCOPE("Softmax", this, kForward);
+  Predict(input, output);
+
+  this->input = input;
+  this->output = output;
+}
+
+void Softmax::Predict(const arma::vec& input, arma::vec& output) const {
+  AFS_TRACE_SCOPE("Softmax::Predict");
+  AFS_ALLOC_SCOPE("Softmax", this, kForward);
   // Softmax function: https://cs231n.github.io/linear-classify/#softmax
   // This version is stable softmax: use `- arma::max(input)`
   // to limit the max value of input - arma::max(input) to 0, thus can prevent
@@ -15,18 +29,28 @@ void Softmax::Forward(const arma::vec& input, arma::vec& output) {
   arma::vec numerator = arma::exp(input - arma::max(input));
   double sum_exp = arma::accu(numerator);
   output = numerator / sum_exp;
-
-  this->input = input;
-  this->output = output;
 }
 
 void Softmax::Backward(const arma::vec& upstream_gradient) {
+  AFS_TRACE_SCOPE("Softmax::Backward");
+  AFS_ALLOC_SCOPE("Softmax", this, kBackward);
   // Simple Softmax: http://www.adeveloperdiary.com/data-science/deep-learning/neural-network-with-softmax-in-python/
   // TODO (vietanhdev): Stabled Softmax
   double sub = arma::dot(upstream_gradient, output);
   grad_wrt_input = (upstream_gradient - sub) % output;
 }
 
+LayerCost Softmax::GetCost() const {
+  LayerCost cost;
+  // Max, subtract, exp, sum and divide per value; dot product, subtract and
+  // multiply per value.
+  cost.forward_flops = 5.0 * num_inputs;
+  cost.forward_bytes = sizeof(double) * 2.0 * num_inputs;
+  cost.backward_flops = 4.0 * num_inputs;
+  cost.backward_bytes = sizeof(double) * 3.0 * num_inputs;
+  return cost;
+}
+
 arma::vec Softmax::GetGradientWrtInput() { return grad_wrt_input; }
 
 }  // namespace afs
@@ -4,6 +4,8 @@
 #include <armadillo>
 #include <iostream>
 
+#include "layers/layer_cost.h"
+
 namespace afs {
 
 class Softmax {
@@ -17,8 +19,15 @@ class Softmax {
  public:
   Softmax(size_t num_inputs);
   void Forward(const arma::vec& input, arma::vec& output);
+  // Forward pass without keeping anything for the backward pass.
+  void Predict(const arma::vec& input, arma::vec& output) const;
   void Backward(const arma::vec& upstream_gradient);
   arma::vec GetGradientWrtInput();
+
+  size_t GetNumInputs() const { return num_inputs; }
+
+  // Analytic FLOPs and bytes of one sample, see LayerCost.
+  LayerCost GetCost() const;
 };
 
 }  // namespace afs
@@ -29,11 +29,16 @@ class CrossEntropyLoss {
     this->actual_distribution = actual_distribution;
 
     // Compute the loss and cache that too.
-    this->loss =
-        -arma::dot(actual_distribution, arma::log(predicted_distribution));
+    this->loss = Evaluate(predicted_distribution, actual_distribution);
     return this->loss;
   }
 
+  // The loss alone, with nothing cached for the backward pass.
+  double Evaluate(const arma::vec& predicted_distribution,
+                  const arma::vec& actual_distribution) const {
+    return -arma::dot(actual_distribution, arma::log(predicted_distribution));
+  }
+
   void Backward() {
     gradient_wrt_predicted_distribution =
         -(actual_distribution % (1 / predicted_distribution));
@@ -0,0 +1,44 @@
+#ifndef FIXED_MSE_LOSS_H_
+#define FIXED_MSE_LOSS_H_
+
+#include <armadillo>
+
+namespace afs {
+namespace fixed {
+
+// MSELoss with compile-time size. Same loss and gradient as ::MSELoss,
+// without heap allocations.
+template <size_t N>
+class MSELoss {
+ public:
+  typedef arma::vec::fixed<N> Vector;
+
+  double Forward(const Vector &predicted_distribution,
+                 const Vector &actual_distribution) {
+    double loss = 0.0;
+    for (size_t i = 0; i < N; ++i) {
+      difference[i] = predicted_distribution[i] - actual_distribution[i];
+      loss += difference[i] * difference[i];
+    }
+    return loss;
+  }
+
+  void Backward() {
+    for (size_t i = 0; i < N; ++i) {
+      gradient_wrt_predicted_distribution[i] = N * 2 * difference[i];
+    }
+  }
+
+  const Vector &GetGradientWrtPredictedDistribution() const {
+    return gradient_wrt_predicted_distribution;
+  }
+
+ private:
+  Vector difference;
+  Vector gradient_wrt_predicted_distribution;
+};
+
+}  // namespace fixed
+}  // namespace afs
+
+#endif
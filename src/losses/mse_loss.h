@@ -25,10 +25,16 @@ class MSELoss {
     this->actual_distribution = actual_distribution;
 
     // Compute the loss and cache that too.
-    this->loss = arma::accu(square(actual_distribution - predicted_distribution));
+    this->loss = Evaluate(predicted_distribution, actual_distribution);
     return this->loss;
   }
 
+  // The loss alone, with nothing cached for the backward pass.
+  double Evaluate(const arma::vec& predicted_distribution,
+                  const arma::vec& actual_distribution) const {
+    return arma::accu(square(actual_distribution - predicted_distribution));
+  }
+
   void Backward() {
     int num_samples = this->predicted_distribution.n_rows;
     gradient_wrt_predicted_distribution = num_samples * 2 * (predicted_distribution - actual_distribution);
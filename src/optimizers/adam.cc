@@ -0,0 +1,91 @@
+#include "adam.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "utils/alloc_profiler.h"
+#include "utils/trace.h"
+
+namespace afs {
+
+Adam::Adam(double learning_rate, double beta1, double beta2, double epsilon,
+           double weight_decay)
+    : Optimizer(learning_rate),
+      beta1(beta1),
+      beta2(beta2),
+      epsilon(epsilon),
+      weight_decay(weight_decay) {
+  assert(beta1 >= 0 && beta1 < 1);
+  assert(beta2 >= 0 && beta2 < 1);
+}
+
+void Adam::Step(ParameterStore &store, size_t batch_size) {
+  AFS_TRACE_SCOPE("Adam::Step");
+  AFS_ALLOC_SCOPE("Adam", this, kUpdate);
+  assert(store.IsAllocated());
+  if (first_moment.Size() != store.Size()) {
+    first_moment.Resize(store.Size());
+    second_moment.Resize(store.Size());
+    num_steps = 0;
+  }
+  ++num_steps;
+
+  const long n = store.Size();
+  double *w = store.GetParameters();
+  double *grad = store.GetGradients();
+  double *m = first_moment.Data();
+  double *v = second_moment.Data();
+
+  // Fold the bias corrections into two scalars so that the loop body only
+  // needs one sqrt and one division per element.
+  const double scale = 1.0 / batch_size;
+  const double b1 = beta1;
+  const double b2 = beta2;
+  const double step_size =
+      learning_rate / (1.0 - std::pow(beta1, num_steps));
+  const double inv_sqrt_correction2 =
+      1.0 / std::sqrt(1.0 - std::pow(beta2, num_steps));
+  const double eps = epsilon;
+  const double l2 = weight_decay;
+  const double shrink = 1.0 - learning_rate * decoupled_weight_decay;
+
+  #pragma omp parallel for simd aligned(w, grad, m, v : 64)
+  for (long i = 0; i < n; ++i) {
+    const double g = grad[i] * scale + l2 * w[i];
+    const double m_new = b1 * m[i] + (1.0 - b1) * g;
+    const double v_new = b2 * v[i] + (1.0 - b2) * g * g;
+    m[i] = m_new;
+    v[i] = v_new;
+    w[i] = shrink * w[i] -
+           step_size * m_new / (std::sqrt(v_new) * inv_sqrt_correction2 + eps);
+    grad[i] = 0.0;
+  }
+}
+
+void Adam::GetState(std::vector<double> &state) const {
+  size_t n = first_moment.Size();
+  state.resize(1 + 2 * n);
+  state[0] = num_steps;
+  std::copy(first_moment.Data(), first_moment.Data() + n, state.begin() + 1);
+  std::copy(second_moment.Data(), second_moment.Data() + n,
+            state.begin() + 1 + n);
+}
+
+void Adam::SetState(const double *state, size_t count) {
+  assert(count % 2 == 1);
+  size_t n = count / 2;
+  first_moment.Resize(n);
+  second_moment.Resize(n);
+  num_steps = state[0];
+  std::copy(state + 1, state + 1 + n, first_moment.Data());
+  std::copy(state + 1 + n, state + 1 + 2 * n, second_moment.Data());
+}
+
+AdamW::AdamW(double learning_rate, double weight_decay, double beta1,
+             double beta2, double epsilon)
+    : Adam(learning_rate, beta1, beta2, epsilon, 0.0) {
+  decoupled_weight_decay = weight_decay;
+}
+
+}  // namespace afs
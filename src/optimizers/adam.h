@@ -0,0 +1,49 @@
+#ifndef ADAM_H_
+#define ADAM_H_
+
+#include "optimizers/optimizer.h"
+#include "utils/aligned_buffer.h"
+
+namespace afs {
+
+// Adam: https://arxiv.org/abs/1412.6980
+// `weight_decay` is classic L2 regularization, i.e. it is added to the
+// gradient before the moment estimates are updated.
+class Adam : public Optimizer {
+ public:
+  Adam(double learning_rate = 0.001, double beta1 = 0.9, double beta2 = 0.999,
+       double epsilon = 1e-8, double weight_decay = 0.0);
+
+  void Step(ParameterStore &store, size_t batch_size) override;
+
+  // The step count followed by the first and second moment estimates.
+  void GetState(std::vector<double> &state) const override;
+  void SetState(const double *state, size_t count) override;
+
+  size_t GetNumSteps() const { return num_steps; }
+
+ protected:
+  double beta1;
+  double beta2;
+  double epsilon;
+  double weight_decay;
+  // Weight decay applied directly to the weights, outside of the adaptive
+  // update. Only used by AdamW.
+  double decoupled_weight_decay = 0.0;
+
+  size_t num_steps = 0;
+  AlignedBuffer<double> first_moment;
+  AlignedBuffer<double> second_moment;
+};
+
+// AdamW: Adam with decoupled weight decay.
+// https://arxiv.org/abs/1711.05101
+class AdamW : public Adam {
+ public:
+  AdamW(double learning_rate = 0.001, double weight_decay = 0.01,
+        double beta1 = 0.9, double beta2 = 0.999, double epsilon = 1e-8);
+};
+
+}  // namespace afs
+
+#endif
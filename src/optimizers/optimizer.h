@@ -0,0 +1,37 @@
+#ifndef OPTIMIZER_H_
+#define OPTIMIZER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "optimizers/parameter_store.h"
+
+namespace afs {
+
+// Base class of the optimizers working on a ParameterStore. Step() applies
+// one update from the gradients accumulated over `batch_size` samples and
+// zeroes the gradients in the same pass over memory.
+class Optimizer {
+ public:
+  explicit Optimizer(double learning_rate) : learning_rate(learning_rate) {}
+  virtual ~Optimizer() {}
+
+  virtual void Step(ParameterStore &store, size_t batch_size) = 0;
+
+  // Internal state (moment estimates, step count...) as a flat array, so it
+  // can be saved in a checkpoint and restored to resume training.
+  virtual void GetState(std::vector<double> &state) const { state.clear(); }
+  virtual void SetState(const double *state, size_t count) {}
+
+  double GetLearningRate() const { return learning_rate; }
+  void SetLearningRate(double learning_rate) {
+    this->learning_rate = learning_rate;
+  }
+
+ protected:
+  double learning_rate;
+};
+
+}  // namespace afs
+
+#endif
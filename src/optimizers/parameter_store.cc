@@ -0,0 +1,91 @@
+#include "parameter_store.h"
+
+#include <cstring>
+#include <new>
+
+namespace afs {
+
+namespace {
+
+// Number of doubles in one 64-byte cache line. Slices are padded to a
+// multiple of it so that every view starts on an aligned address.
+const size_t kAlignElems = AlignedBuffer<double>::kAlignment / sizeof(double);
+
+// Armadillo has no way to re-point an existing object to other memory, so we
+// destroy it and construct a strict view in its place. Strict views can never
+// be resized or reallocated, which guarantees that later assignments write
+// into the store instead of silently detaching from it.
+void BindView(arma::mat &object, double *memory) {
+  size_t n_rows = object.n_rows;
+  size_t n_cols = object.n_cols;
+  std::memcpy(memory, object.memptr(), object.n_elem * sizeof(double));
+  object.~Mat();
+  new (&object) arma::mat(memory, n_rows, n_cols, false, true);
+}
+
+void BindView(arma::vec &object, double *memory) {
+  size_t n_elem = object.n_elem;
+  std::memcpy(memory, object.memptr(), n_elem * sizeof(double));
+  object.~Col();
+  new (&object) arma::vec(memory, n_elem, false, true);
+}
+
+void BindView(arma::cube &object, double *memory) {
+  size_t n_rows = object.n_rows;
+  size_t n_cols = object.n_cols;
+  size_t n_slices = object.n_slices;
+  std::memcpy(memory, object.memptr(), object.n_elem * sizeof(double));
+  object.~Cube();
+  new (&object) arma::cube(memory, n_rows, n_cols, n_slices, false, true);
+}
+
+}  // namespace
+
+void ParameterStore::Register(arma::mat &parameter, arma::mat &gradient) {
+  assert(arma::size(parameter) == arma::size(gradient));
+  AddEntry(parameter.n_elem, [&](double *parameter_memory, double *gradient_memory) {
+    BindView(parameter, parameter_memory);
+    BindView(gradient, gradient_memory);
+  });
+}
+
+void ParameterStore::Register(arma::vec &parameter, arma::vec &gradient) {
+  assert(parameter.n_elem == gradient.n_elem);
+  AddEntry(parameter.n_elem, [&](double *parameter_memory, double *gradient_memory) {
+    BindView(parameter, parameter_memory);
+    BindView(gradient, gradient_memory);
+  });
+}
+
+void ParameterStore::Register(arma::cube &parameter, arma::cube &gradient) {
+  assert(arma::size(parameter) == arma::size(gradient));
+  AddEntry(parameter.n_elem, [&](double *parameter_memory, double *gradient_memory) {
+    BindView(parameter, parameter_memory);
+    BindView(gradient, gradient_memory);
+  });
+}
+
+void ParameterStore::AddEntry(size_t n_elem,
+                              std::function<void(double *, double *)> bind) {
+  // Parameters can not be added once the tensors have been bound.
+  assert(!allocated);
+  entries.push_back({size, n_elem, bind});
+  size += (n_elem + kAlignElems - 1) / kAlignElems * kAlignElems;
+}
+
+void ParameterStore::Allocate() {
+  assert(!allocated);
+  parameters.Resize(size);
+  gradients.Resize(size);
+  for (Entry &entry : entries) {
+    entry.bind(parameters.Data() + entry.offset,
+               gradients.Data() + entry.offset);
+  }
+  allocated = true;
+}
+
+void ParameterStore::ZeroGradients() {
+  std::memset(gradients.Data(), 0, size * sizeof(double));
+}
+
+}  // namespace afs
@@ -0,0 +1,76 @@
+#ifndef PARAMETER_STORE_H_
+#define PARAMETER_STORE_H_
+
+#include <armadillo>
+#include <cassert>
+#include <functional>
+#include <vector>
+
+#include "utils/aligned_buffer.h"
+
+namespace afs {
+
+// Keeps the parameters and accumulated gradients of a whole network in two
+// flat, 64-byte aligned buffers.
+//
+// Usage:
+//   ParameterStore store;
+//   conv.RegisterParameters(store);
+//   dense.RegisterParameters(store);
+//   store.Allocate();
+//
+// Allocate() copies the current values into the buffers and re-binds every
+// registered armadillo object to a view of its slice, so the layers keep
+// working on their own members while an optimizer can update everything in a
+// single pass. Each slice starts on a 64-byte boundary. The store must
+// outlive the layers registered to it.
+class ParameterStore {
+ public:
+  ParameterStore() {}
+  ParameterStore(const ParameterStore &) = delete;
+  ParameterStore &operator=(const ParameterStore &) = delete;
+
+  // Register a parameter tensor and the tensor its gradient is accumulated
+  // into. Both must have the same shape.
+  void Register(arma::mat &parameter, arma::mat &gradient);
+  void Register(arma::vec &parameter, arma::vec &gradient);
+  void Register(arma::cube &parameter, arma::cube &gradient);
+
+  // Create the flat buffers and bind all registered tensors to them.
+  void Allocate();
+
+  // Zero all accumulated gradients.
+  void ZeroGradients();
+
+  double *GetParameters() { return parameters.Data(); }
+  double *GetGradients() { return gradients.Data(); }
+  const double *GetParameters() const { return parameters.Data(); }
+  const double *GetGradients() const { return gradients.Data(); }
+
+  // Number of elements in each flat buffer, including alignment padding.
+  size_t Size() const { return size; }
+  bool IsAllocated() const { return allocated; }
+
+ private:
+  struct Entry {
+    size_t offset;
+    size_t n_elem;
+    // Copies the current values to the given memory and re-binds the
+    // parameter and gradient tensors to it.
+    std::function<void(double *parameter_memory, double *gradient_memory)> bind;
+  };
+
+  void AddEntry(size_t n_elem,
+                std::function<void(double *, double *)> bind);
+
+  std::vector<Entry> entries;
+  size_t size = 0;
+  bool allocated = false;
+
+  AlignedBuffer<double> parameters;
+  AlignedBuffer<double> gradients;
+};
+
+}  // namespace afs
+
+#endif
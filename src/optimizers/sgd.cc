@@ -0,0 +1,70 @@
+#include "sgd.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "utils/alloc_profiler.h"
+#include "utils/trace.h"
+
+namespace afs {
+
+SGD::SGD(double learning_rate, double momentum, bool nesterov,
+         double weight_decay)
+    : Optimizer(learning_rate),
+      momentum(momentum),
+      nesterov(nesterov),
+      weight_decay(weight_decay) {
+  assert(momentum >= 0 && momentum < 1);
+  assert(!nesterov || momentum > 0);
+}
+
+void SGD::Step(ParameterStore &store, size_t batch_size) {
+  AFS_TRACE_SCOPE("SGD::Step");
+  AFS_ALLOC_SCOPE("SGD", this, kUpdate);
+  assert(store.IsAllocated());
+  const long n = store.Size();
+  double *w = store.GetParameters();
+  double *grad = store.GetGradients();
+  const double lr = learning_rate;
+  const double scale = 1.0 / batch_size;
+  const double mu = momentum;
+  const double decay = weight_decay;
+
+  if (mu == 0.0) {
+    #pragma omp parallel for simd aligned(w, grad : 64)
+    for (long i = 0; i < n; ++i) {
+      const double g = grad[i] * scale + decay * w[i];
+      w[i] -= lr * g;
+      grad[i] = 0.0;
+    }
+    return;
+  }
+
+  if (velocity.Size() != store.Size()) velocity.Resize(store.Size());
+  double *v = velocity.Data();
+  const double v_weight = nesterov ? mu : 1.0;
+  const double g_weight = nesterov ? 1.0 : 0.0;
+
+  // Classic and Nesterov momentum share one branch-free loop:
+  //   classic:  w -= lr * v
+  //   nesterov: w -= lr * (g + mu * v)
+  #pragma omp parallel for simd aligned(w, grad, v : 64)
+  for (long i = 0; i < n; ++i) {
+    const double g = grad[i] * scale + decay * w[i];
+    const double v_new = mu * v[i] + g;
+    v[i] = v_new;
+    w[i] -= lr * (g_weight * g + v_weight * v_new);
+    grad[i] = 0.0;
+  }
+}
+
+void SGD::GetState(std::vector<double> &state) const {
+  state.assign(velocity.Data(), velocity.Data() + velocity.Size());
+}
+
+void SGD::SetState(const double *state, size_t count) {
+  velocity.Resize(count);
+  std::copy(state, state + count, velocity.Data());
+}
+
+}  // namespace afs
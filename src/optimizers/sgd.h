@@ -0,0 +1,38 @@
+#ifndef SGD_H_
+#define SGD_H_
+
+#include "optimizers/optimizer.h"
+#include "utils/aligned_buffer.h"
+
+namespace afs {
+
+// Stochastic gradient descent with optional (Nesterov) momentum and L2
+// weight decay:
+//   g = grad / batch_size + weight_decay * w
+//   v = momentum * v + g
+//   w -= learning_rate * v                      (classic momentum)
+//   w -= learning_rate * (g + momentum * v)     (Nesterov momentum)
+// With momentum = 0 this is the plain SGD step used by the layers'
+// UpdateWeightsAndBiases() / UpdateFilterWeights().
+class SGD : public Optimizer {
+ public:
+  SGD(double learning_rate, double momentum = 0.0, bool nesterov = false,
+      double weight_decay = 0.0);
+
+  void Step(ParameterStore &store, size_t batch_size) override;
+
+  // The velocity of each parameter.
+  void GetState(std::vector<double> &state) const override;
+  void SetState(const double *state, size_t count) override;
+
+ private:
+  double momentum;
+  bool nesterov;
+  double weight_decay;
+
+  AlignedBuffer<double> velocity;
+};
+
+}  // namespace afs
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef ALIGNED_BUFFER_H_
+#define ALIGNED_BUFFER_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace afs {
+
+// Zero-initialized heap array whose first element sits on a 64-byte (cache
+// line) boundary, so SIMD loops over it can use aligned loads and stores.
+template <typename T>
+class AlignedBuffer {
+ public:
+  static constexpr size_t kAlignment = 64;
+
+  AlignedBuffer() {}
+  explicit AlignedBuffer(size_t size) { Resize(size); }
+  ~AlignedBuffer() { std::free(data); }
+
+  AlignedBuffer(const AlignedBuffer &) = delete;
+  AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+  AlignedBuffer(AlignedBuffer &&other) : data(other.data), size(other.size) {
+    other.data = nullptr;
+    other.size = 0;
+  }
+
+  AlignedBuffer &operator=(AlignedBuffer &&other) {
+    if (this != &other) {
+      std::free(data);
+      data = other.data;
+      size = other.size;
+      other.data = nullptr;
+      other.size = 0;
+    }
+    return *this;
+  }
+
+  // Reallocate to hold `size` elements. Previous content is discarded.
+  // Throws std::bad_alloc if the memory cannot be allocated, leaving the
+  // buffer empty.
+  void Resize(size_t size) {
+    std::free(data);
+    data = nullptr;
+    this->size = 0;
+    if (size == 0) return;
+    if (size > (SIZE_MAX - kAlignment) / sizeof(T)) throw std::bad_alloc();
+    // std::aligned_alloc requires the byte count to be a multiple of the
+    // alignment.
+    size_t num_bytes = size * sizeof(T);
+    num_bytes = (num_bytes + kAlignment - 1) / kAlignment * kAlignment;
+    data = static_cast<T *>(std::aligned_alloc(kAlignment, num_bytes));
+    if (data == nullptr) throw std::bad_alloc();
+    std::memset(data, 0, num_bytes);
+    this->size = size;
+  }
+
+  T *Data() { return data; }
+  const T *Data() const { return data; }
+  size_t Size() const { return size; }
+
+  T &operator[](size_t i) { return data[i]; }
+  const T &operator[](size_t i) const { return data[i]; }
+
+ private:
+  T *data = nullptr;
+  size_t size = 0;
+};
+
+}  // namespace afs
+
+#endif
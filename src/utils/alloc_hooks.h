@@ -0,0 +1,17 @@
+#ifndef ALLOC_HOOKS_H_
+#define ALLOC_HOOKS_H_
+
+// Routes the allocations of armadillo through the allocation profiler
+// (utils/alloc_profiler.h). Armadillo requires the functions to be declared
+// before <armadillo> is included, so with the AFS_ENABLE_ALLOC_PROFILING
+// CMake option this header is force-included in every source file.
+
+#include <cstddef>
+
+void *afs_profiled_malloc(size_t size);
+void afs_profiled_free(void *ptr);
+
+#define ARMA_ALIEN_MEM_ALLOC_FUNCTION afs_profiled_malloc
+#define ARMA_ALIEN_MEM_FREE_FUNCTION afs_profiled_free
+
+#endif
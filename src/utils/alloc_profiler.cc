@@ -0,0 +1,273 @@
+#include "alloc_profiler.h"
+
+#ifdef AFS_ENABLE_ALLOC_PROFILING
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "utils/alloc_hooks.h"
+
+namespace afs {
+
+const size_t kNumPhases = 5;
+
+struct AllocationTag {
+  std::string name;
+  AllocationPhase phase;
+  std::atomic<size_t> count{0};
+  std::atomic<size_t> allocated{0};
+  std::atomic<size_t> live{0};
+  std::atomic<size_t> peak{0};
+};
+
+namespace {
+
+// Stored in front of each block. 64 bytes keep the block 64-byte aligned.
+struct BlockHeader {
+  size_t size;
+  AllocationTag *tag;
+};
+const size_t kHeaderSize = 64;
+static_assert(sizeof(BlockHeader) <= kHeaderSize, "Block header too large");
+
+struct Counter {
+  std::atomic<size_t> live{0};
+  std::atomic<size_t> peak{0};
+};
+
+Counter total;
+Counter phases[kNumPhases];
+
+thread_local AllocationTag *current_tag = nullptr;
+// Innermost scope of the training thread.
+std::atomic<AllocationTag *> shared_tag{nullptr};
+std::atomic<std::thread::id> training_thread{std::thread::id()};
+
+struct Registry {
+  std::mutex mutex;
+  std::map<std::tuple<std::string, const void *, AllocationPhase>,
+           std::unique_ptr<AllocationTag>>
+      tags;
+  // Number of each layer instance, in order of first use.
+  std::map<std::pair<std::string, const void *>, size_t> instances;
+  std::map<std::string, size_t> num_instances;
+  std::vector<AllocationTag *> order;
+};
+
+Registry &GetRegistry() {
+  static Registry *registry = new Registry();
+  return *registry;
+}
+
+// Find or create the tag of a scope. Takes the registry lock.
+AllocationTag *RegisterTag(const char *layer, const void *instance,
+                           AllocationPhase phase) {
+  Registry &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  std::unique_ptr<AllocationTag> &entry =
+      registry.tags[std::make_tuple(std::string(layer), instance, phase)];
+  if (!entry) {
+    size_t &number = registry.instances[std::make_pair(layer, instance)];
+    if (number == 0) number = ++registry.num_instances[layer];
+    entry.reset(new AllocationTag());
+    entry->name = std::string(layer) + " #" + std::to_string(number);
+    entry->phase = phase;
+    registry.order.push_back(entry.get());
+  }
+  return entry.get();
+}
+
+// Direct-mapped cache of the tags each thread has entered, so that a scope
+// only takes the registry lock the first time a thread enters it, and the
+// OpenMP threads running Predict() concurrently do not serialize on it.
+// Tags are never freed, so cached pointers stay valid.
+struct CachedTag {
+  const char *layer = nullptr;
+  const void *instance = nullptr;
+  AllocationPhase phase = AllocationPhase::kOther;
+  AllocationTag *tag = nullptr;
+};
+const size_t kTagCacheSize = 256;
+thread_local CachedTag tag_cache[kTagCacheSize];
+
+AllocationTag *FindTag(const char *layer, const void *instance,
+                       AllocationPhase phase) {
+  const uintptr_t key = (reinterpret_cast<uintptr_t>(instance) >> 4) ^
+                        (reinterpret_cast<uintptr_t>(layer) >> 2);
+  CachedTag &cached =
+      tag_cache[(key * kNumPhases + static_cast<size_t>(phase)) %
+                kTagCacheSize];
+  if (cached.tag == nullptr || cached.layer != layer ||
+      cached.instance != instance || cached.phase != phase) {
+    cached.layer = layer;
+    cached.instance = instance;
+    cached.phase = phase;
+    cached.tag = RegisterTag(layer, instance, phase);
+  }
+  return cached.tag;
+}
+
+AllocationTag &UntaggedTag() {
+  static AllocationTag *tag = [] {
+    AllocationTag *tag = new AllocationTag();
+    tag->name = "(no scope)";
+    tag->phase = AllocationPhase::kOther;
+    return tag;
+  }();
+  return *tag;
+}
+
+AllocationTag *CurrentTag() {
+  if (current_tag != nullptr) return current_tag;
+  AllocationTag *tag = shared_tag.load(std::memory_order_relaxed);
+  return tag != nullptr ? tag : &UntaggedTag();
+}
+
+void UpdatePeak(std::atomic<size_t> &peak, size_t value) {
+  size_t current = peak.load(std::memory_order_relaxed);
+  while (value > current &&
+         !peak.compare_exchange_weak(current, value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+void Charge(std::atomic<size_t> &live, std::atomic<size_t> &peak,
+            size_t size) {
+  UpdatePeak(peak, live.fetch_add(size, std::memory_order_relaxed) + size);
+}
+
+const char *PhaseName(AllocationPhase phase) {
+  switch (phase) {
+    case AllocationPhase::kForward:
+      return "forward";
+    case AllocationPhase::kBackward:
+      return "backward";
+    case AllocationPhase::kUpdate:
+      return "update";
+    case AllocationPhase::kData:
+      return "data";
+    default:
+      return "other";
+  }
+}
+
+double MB(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+}  // namespace
+
+void AllocationProfiler::BeginStep() {
+  training_thread.store(std::this_thread::get_id());
+
+  Registry &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  std::vector<AllocationTag *> tags = registry.order;
+  tags.push_back(&UntaggedTag());
+  for (AllocationTag *tag : tags) {
+    tag->count = 0;
+    tag->allocated = 0;
+    tag->peak = tag->live.load();
+  }
+  for (Counter &phase : phases) phase.peak = phase.live.load();
+  total.peak = total.live.load();
+}
+
+void AllocationProfiler::PrintReport(std::ostream &out) {
+  Registry &registry = GetRegistry();
+  std::vector<AllocationTag *> tags;
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    tags = registry.order;
+  }
+  tags.push_back(&UntaggedTag());
+
+  size_t name_width = 5;
+  for (const AllocationTag *tag : tags) {
+    name_width = std::max(name_width, tag->name.size());
+  }
+
+  const std::ios::fmtflags flags = out.flags();
+  out << std::fixed << std::setprecision(3) << std::left
+      << std::setw(name_width) << "scope" << std::right << std::setw(10)
+      << "phase" << std::setw(10) << "allocs" << std::setw(12) << "MB alloc"
+      << std::setw(10) << "MB live" << std::setw(10) << "MB peak" << "\n";
+  for (const AllocationTag *tag : tags) {
+    if (tag->count == 0 && tag->live == 0) continue;
+    out << std::left << std::setw(name_width) << tag->name << std::right
+        << std::setw(10) << PhaseName(tag->phase) << std::setw(10)
+        << tag->count << std::setw(12) << MB(tag->allocated) << std::setw(10)
+        << MB(tag->live) << std::setw(10) << MB(tag->peak) << "\n";
+  }
+
+  out << "Live / peak MB:";
+  for (size_t p = 0; p < kNumPhases; ++p) {
+    out << " " << PhaseName(static_cast<AllocationPhase>(p)) << " "
+        << MB(phases[p].live) << " / " << MB(phases[p].peak) << ",";
+  }
+  out << " total " << MB(total.live) << " / " << MB(total.peak)
+      << std::endl;
+  out.flags(flags);
+}
+
+size_t AllocationProfiler::LiveBytes() { return total.live; }
+
+size_t AllocationProfiler::PeakLiveBytes() { return total.peak; }
+
+AllocationScope::AllocationScope(const char *layer, const void *instance,
+                                 AllocationPhase phase) {
+  AllocationTag *tag = FindTag(layer, instance, phase);
+
+  previous = current_tag;
+  current_tag = tag;
+  shared = std::this_thread::get_id() == training_thread.load();
+  previous_shared = shared ? shared_tag.exchange(tag) : nullptr;
+}
+
+AllocationScope::~AllocationScope() {
+  current_tag = previous;
+  if (shared) shared_tag.store(previous_shared);
+}
+
+}  // namespace afs
+
+void *afs_profiled_malloc(size_t size) {
+  using namespace afs;
+  const size_t block_size = (kHeaderSize + size + 63) / 64 * 64;
+  char *block = static_cast<char *>(std::aligned_alloc(64, block_size));
+  if (block == nullptr) return nullptr;
+
+  AllocationTag *tag = CurrentTag();
+  new (block) BlockHeader{size, tag};
+  tag->count.fetch_add(1, std::memory_order_relaxed);
+  tag->allocated.fetch_add(size, std::memory_order_relaxed);
+  Charge(tag->live, tag->peak, size);
+  Counter &phase = phases[static_cast<size_t>(tag->phase)];
+  Charge(phase.live, phase.peak, size);
+  Charge(total.live, total.peak, size);
+  return block + kHeaderSize;
+}
+
+void afs_profiled_free(void *ptr) {
+  using namespace afs;
+  if (ptr == nullptr) return;
+  char *block = static_cast<char *>(ptr) - kHeaderSize;
+  const BlockHeader *header = reinterpret_cast<const BlockHeader *>(block);
+  AllocationTag *tag = header->tag;
+  tag->live.fetch_sub(header->size, std::memory_order_relaxed);
+  phases[static_cast<size_t>(tag->phase)].live.fetch_sub(
+      header->size, std::memory_order_relaxed);
+  total.live.fetch_sub(header->size, std::memory_order_relaxed);
+  std::free(block);
+}
+
+#endif  // AFS_ENABLE_ALLOC_PROFILING
@@ -0,0 +1,90 @@
+#ifndef ALLOC_PROFILER_H_
+#define ALLOC_PROFILER_H_
+
+// Allocation accounting per layer and phase.
+//
+// Compiled in only with the AFS_ENABLE_ALLOC_PROFILING CMake option, which
+// routes every armadillo allocation through afs_profiled_malloc and
+// afs_profiled_free (utils/alloc_hooks.h). Otherwise AFS_ALLOC_SCOPE expands
+// to nothing.
+//
+//   void Conv2D::Forward(...) {
+//     AFS_ALLOC_SCOPE("Conv2D", this, kForward);
+//     ...
+//   }
+//   ...
+//   AllocationProfiler::BeginStep();
+//   ... one training step ...
+//   AllocationProfiler::PrintReport(std::cout);
+
+#ifdef AFS_ENABLE_ALLOC_PROFILING
+
+#include <cstddef>
+#include <ostream>
+
+namespace afs {
+
+enum class AllocationPhase { kForward, kBackward, kUpdate, kData, kOther };
+
+struct AllocationTag;
+
+// Counts the allocations, the bytes allocated and the bytes still live of
+// each (layer instance, phase) scope. Memory is charged to the scope that
+// allocated it until it is freed, so the live bytes of a layer's forward
+// scope are the activations it keeps for the backward pass.
+//
+// Allocations are charged to the innermost scope of the allocating thread.
+// Threads without a scope, such as the OpenMP workers of a layer, are
+// charged to the innermost scope of the training thread: the thread that
+// calls BeginStep().
+class AllocationProfiler {
+ public:
+  // Start a new step: resets the counts, bytes allocated and peaks, but not
+  // the live bytes, and makes the calling thread the training thread.
+  static void BeginStep();
+
+  // Per scope: allocations, MB allocated, MB live and peak MB live since
+  // BeginStep(), then the live and peak bytes of each phase and in total.
+  static void PrintReport(std::ostream &out);
+
+  // Bytes allocated through the profiler and not freed yet.
+  static size_t LiveBytes();
+  static size_t PeakLiveBytes();
+};
+
+// Charges the allocations of the current thread to `layer` (one entry per
+// instance) and `phase` during its lifetime. `layer` must be a string
+// literal.
+class AllocationScope {
+ public:
+  AllocationScope(const char *layer, const void *instance,
+                  AllocationPhase phase);
+  ~AllocationScope();
+
+  AllocationScope(const AllocationScope &) = delete;
+  AllocationScope &operator=(const AllocationScope &) = delete;
+
+ private:
+  AllocationTag *previous;
+  AllocationTag *previous_shared;
+  bool shared;
+};
+
+}  // namespace afs
+
+#define AFS_ALLOC_SCOPE_CONCAT_(a, b) a##b
+#define AFS_ALLOC_SCOPE_CONCAT(a, b) AFS_ALLOC_SCOPE_CONCAT_(a, b)
+#define AFS_ALLOC_SCOPE(layer, instance, phase)                     \
+  ::afs::AllocationScope AFS_ALLOC_SCOPE_CONCAT(afs_alloc_scope_, \
+                                                __LINE__)(        \
+      layer, instance, ::afs::AllocationPhase::phase)
+
+#else
+
+#define AFS_ALLOC_SCOPE(layer, instance, phase) \
+  do {                                          \
+  } while (0)
+
+#endif  // AFS_ENABLE_ALLOC_PROFILING
+
+#endif
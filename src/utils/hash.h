@@ -0,0 +1,102 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace afs {
+
+// 64-bit non-cryptographic hash of a byte buffer (XXH64 algorithm,
+// https://github.com/Cyan4973/xxHash). Consumes 32 bytes per iteration in
+// four independent lanes.
+class Hash {
+ public:
+  static uint64_t Compute(const void *data, size_t size, uint64_t seed = 0) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    const uint8_t *end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+      uint64_t v1 = seed + kPrime1 + kPrime2;
+      uint64_t v2 = seed + kPrime2;
+      uint64_t v3 = seed;
+      uint64_t v4 = seed - kPrime1;
+      const uint8_t *limit = end - 32;
+      do {
+        v1 = Round(v1, Read64(p));
+        v2 = Round(v2, Read64(p + 8));
+        v3 = Round(v3, Read64(p + 16));
+        v4 = Round(v4, Read64(p + 24));
+        p += 32;
+      } while (p <= limit);
+      h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+      h = MergeRound(h, v1);
+      h = MergeRound(h, v2);
+      h = MergeRound(h, v3);
+      h = MergeRound(h, v4);
+    } else {
+      h = seed + kPrime5;
+    }
+
+    h += size;
+
+    for (; p + 8 <= end; p += 8) {
+      h ^= Round(0, Read64(p));
+      h = Rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end) {
+      h ^= (uint64_t)Read32(p) * kPrime1;
+      h = Rotl(h, 23) * kPrime2 + kPrime3;
+      p += 4;
+    }
+    for (; p < end; ++p) {
+      h ^= (*p) * kPrime5;
+      h = Rotl(h, 11) * kPrime1;
+    }
+
+    // Avalanche
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+  }
+
+ private:
+  static constexpr uint64_t kPrime1 = 11400714785074694791ULL;
+  static constexpr uint64_t kPrime2 = 14029467366897019727ULL;
+  static constexpr uint64_t kPrime3 = 1609587929392839161ULL;
+  static constexpr uint64_t kPrime4 = 9650029242287828579ULL;
+  static constexpr uint64_t kPrime5 = 2870177450012600261ULL;
+
+  static uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+  static uint64_t Read64(const uint8_t *p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  static uint32_t Read32(const uint8_t *p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  static uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = Rotl(acc, 31);
+    return acc * kPrime1;
+  }
+
+  static uint64_t MergeRound(uint64_t acc, uint64_t value) {
+    acc ^= Round(0, value);
+    return acc * kPrime1 + kPrime4;
+  }
+};
+
+}  // namespace afs
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef LATENCY_RECORDER_H_
+#define LATENCY_RECORDER_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace afs {
+
+struct LatencySummary {
+  size_t count = 0;          // Events since the last Reset().
+  double p50_us = 0.0;
+  double p99_us = 0.0;
+  double max_us = 0.0;
+  double throughput = 0.0;   // Events per second since the last Reset().
+};
+
+// Thread-safe latency histogram over a sliding window of the most recent
+// events, used to report percentiles and throughput.
+class LatencyRecorder {
+ public:
+  explicit LatencyRecorder(size_t window_size = 100000)
+      : window_size(window_size), start(std::chrono::steady_clock::now()) {
+    samples.reserve(window_size);
+  }
+
+  void Record(double latency_us) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (samples.size() < window_size) {
+      samples.push_back(latency_us);
+    } else {
+      samples[next] = latency_us;
+      next = (next + 1) % window_size;
+    }
+    ++count;
+  }
+
+  LatencySummary Summarize() { return Summarize(false); }
+
+  // Summarize() and Reset() in one step, so that no event recorded between
+  // the two is lost, e.g. to report one window after the other.
+  LatencySummary SummarizeAndReset() { return Summarize(true); }
+
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ResetLocked();
+  }
+
+ private:
+  LatencySummary Summarize(bool reset) {
+    std::vector<double> sorted;
+    LatencySummary summary;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      summary.count = count;
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      summary.throughput = elapsed.count() > 0 ? count / elapsed.count() : 0;
+      if (reset) {
+        sorted.swap(samples);
+        samples.reserve(window_size);
+        ResetLocked();
+      } else {
+        sorted = samples;
+      }
+    }
+    if (sorted.empty()) return summary;
+    std::sort(sorted.begin(), sorted.end());
+    summary.p50_us = sorted[(sorted.size() - 1) * 50 / 100];
+    summary.p99_us = sorted[(sorted.size() - 1) * 99 / 100];
+    summary.max_us = sorted.back();
+    return summary;
+  }
+
+  void ResetLocked() {
+    samples.clear();
+    next = 0;
+    count = 0;
+    start = std::chrono::steady_clock::now();
+  }
+
+  size_t window_size;
+  std::mutex mutex;
+  std::vector<double> samples;
+  size_t next = 0;
+  size_t count = 0;
+  std::chrono::steady_clock::time_point start;
+};
+
+}  // namespace afs
+
+#endif
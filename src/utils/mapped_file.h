@@ -0,0 +1,90 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace afs {
+
+// Read-only memory mapping of a whole file. Pages are shared between all
+// processes mapping the same file and only loaded when they are touched.
+class MappedFile {
+ public:
+  MappedFile() {}
+  ~MappedFile() { Close(); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  MappedFile(MappedFile &&other) : data(other.data), size(other.size) {
+    other.data = nullptr;
+    other.size = 0;
+  }
+
+  MappedFile &operator=(MappedFile &&other) {
+    if (this != &other) {
+      Close();
+      data = other.data;
+      size = other.size;
+      other.data = nullptr;
+      other.size = 0;
+    }
+    return *this;
+  }
+
+  bool Open(const std::string &path) {
+    Close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Error opening file: " << path << std::endl;
+      return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+      std::cerr << "Error reading file size: " << path << std::endl;
+      ::close(fd);
+      return false;
+    }
+    void *mapping =
+        mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+      std::cerr << "Error mapping file: " << path << std::endl;
+      return false;
+    }
+    data = static_cast<const uint8_t *>(mapping);
+    size = file_stat.st_size;
+    return true;
+  }
+
+  void Close() {
+    if (data != nullptr) munmap(const_cast<uint8_t *>(data), size);
+    data = nullptr;
+    size = 0;
+  }
+
+  // Hint the kernel about the expected access pattern, e.g. MADV_SEQUENTIAL
+  // or MADV_WILLNEED.
+  void Advise(int advice) const {
+    if (data != nullptr) madvise(const_cast<uint8_t *>(data), size, advice);
+  }
+
+  bool IsOpen() const { return data != nullptr; }
+  const uint8_t *Data() const { return data; }
+  size_t Size() const { return size; }
+
+ private:
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+};
+
+}  // namespace afs
+
+#endif
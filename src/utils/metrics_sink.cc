@@ -0,0 +1,218 @@
+#include "metrics_sink.h"
+
+#include <cctype>
+#include <iostream>
+
+#include "utils/visualizer.h"
+
+namespace afs {
+
+namespace {
+
+std::FILE *OpenOutput(const std::string &path) {
+  if (path.empty()) return nullptr;
+  std::FILE *file = std::fopen(path.c_str(), "w");
+  if (file == nullptr) std::cerr << "Error opening file: " << path << std::endl;
+  return file;
+}
+
+// Metric names may only contain [a-zA-Z0-9_:].
+std::string PrometheusName(const std::string &name) {
+  std::string result = "afs_";
+  for (char c : name) {
+    const bool valid = std::isalnum(static_cast<unsigned char>(c)) || c == ':';
+    result += valid ? c : '_';
+  }
+  return result;
+}
+
+}  // namespace
+
+MetricsSink::~MetricsSink() { Stop(); }
+
+bool MetricsSink::Start(const MetricsSinkOptions &options) {
+  Stop();
+  this->options = options;
+
+  csv = OpenOutput(options.csv_path);
+  jsonl = OpenOutput(options.jsonl_path);
+  latest.clear();
+  series.clear();
+  dirty = false;
+  {
+    std::lock_guard<std::mutex> lock(plot_mutex);
+    pending_plots.clear();
+  }
+  const bool ok = (csv != nullptr || options.csv_path.empty()) &&
+                  (jsonl != nullptr || options.jsonl_path.empty()) &&
+                  (options.prometheus_path.empty() || WritePrometheus());
+  if (!ok) {
+    CloseOutputs();
+    return false;
+  }
+  if (csv != nullptr) std::fputs("step,seconds,name,value\n", csv);
+
+  queue.reset(new SpscQueue<Event>(options.queue_capacity));
+  num_dropped = 0;
+  stop = false;
+  start = std::chrono::steady_clock::now();
+  consumer = std::thread(&MetricsSink::Run, this);
+  return true;
+}
+
+void MetricsSink::Push(const char *name, double value, size_t step) {
+  if (!queue) return;
+  Event *event = queue->BeginPush();
+  if (event == nullptr) {
+    num_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  event->name = name;
+  event->value = value;
+  event->step = step;
+  event->seconds = elapsed.count();
+  queue->EndPush();
+}
+
+void MetricsSink::PollPlots() {
+  if (!options.plot) return;
+  std::map<std::string, std::vector<double>> plots;
+  {
+    std::unique_lock<std::mutex> lock(plot_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || pending_plots.empty()) return;
+    plots.swap(pending_plots);
+  }
+  for (const auto &entry : plots) {
+    Visualizer::PlotGraph(entry.second, entry.first);
+  }
+}
+
+void MetricsSink::Stop() {
+  if (!consumer.joinable()) return;
+  stop.store(true, std::memory_order_release);
+  consumer.join();
+  queue.reset();
+  CloseOutputs();
+  PollPlots();
+  if (num_dropped > 0) {
+    std::cerr << "MetricsSink: dropped " << num_dropped
+              << " events, the queue was full" << std::endl;
+  }
+}
+
+void MetricsSink::CloseOutputs() {
+  if (csv != nullptr) std::fclose(csv);
+  if (jsonl != nullptr) std::fclose(jsonl);
+  csv = jsonl = nullptr;
+}
+
+void MetricsSink::Run() {
+  const std::chrono::duration<double> refresh_interval(
+      options.refresh_seconds);
+  std::chrono::steady_clock::time_point last_refresh =
+      std::chrono::steady_clock::now();
+  while (true) {
+    // Everything pushed before Stop() is in the queue once `stop` is seen.
+    const bool stopping = stop.load(std::memory_order_acquire);
+    size_t num_events = 0;
+    for (Event *event = queue->Front(); event != nullptr;
+         event = queue->Front()) {
+      Write(*event);
+      queue->Pop();
+      ++num_events;
+    }
+    if (stopping) break;
+
+    const std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    if (now - last_refresh >= refresh_interval) {
+      Refresh();
+      last_refresh = now;
+    }
+    if (num_events == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  Refresh();
+}
+
+void MetricsSink::Write(const Event &event) {
+  if (csv != nullptr) {
+    std::fprintf(csv, "%zu,%.6f,%s,%.9g\n", event.step, event.seconds,
+                 event.name, event.value);
+  }
+  if (jsonl != nullptr) {
+    std::fprintf(jsonl,
+                 "{\"step\": %zu, \"seconds\": %.6f, \"name\": \"%s\", "
+                 "\"value\": %.9g}\n",
+                 event.step, event.seconds, event.name, event.value);
+  }
+  if (!options.prometheus_path.empty()) latest[event.name] = event.value;
+  if (options.plot) series[event.name].Add(event.value);
+  dirty = true;
+}
+
+void MetricsSink::Refresh() {
+  if (!dirty) return;
+  dirty = false;
+  if (csv != nullptr) std::fflush(csv);
+  if (jsonl != nullptr) std::fflush(jsonl);
+  if (!options.prometheus_path.empty()) WritePrometheus();
+  if (options.plot) {
+    // Hand the points over to PollPlots(); a snapshot not drawn yet is
+    // replaced by this newer one.
+    std::lock_guard<std::mutex> lock(plot_mutex);
+    for (const auto &entry : series) {
+      if (!entry.second.points.empty()) {
+        pending_plots[entry.first] = entry.second.points;
+      }
+    }
+  }
+}
+
+bool MetricsSink::WritePrometheus() {
+  // Write to a temporary file and rename it, so that a scraper never reads
+  // a partial file.
+  const std::string tmp_path = options.prometheus_path + ".tmp";
+  std::FILE *file = std::fopen(tmp_path.c_str(), "w");
+  if (file == nullptr) {
+    std::cerr << "Error opening file: " << tmp_path << std::endl;
+    return false;
+  }
+  for (const auto &entry : latest) {
+    const std::string name = PrometheusName(entry.first);
+    std::fprintf(file, "# TYPE %s gauge\n%s %.9g\n", name.c_str(),
+                 name.c_str(), entry.second);
+  }
+  std::fprintf(file, "# TYPE afs_metrics_dropped_total counter\n"
+                     "afs_metrics_dropped_total %zu\n",
+               num_dropped.load(std::memory_order_relaxed));
+  bool ok = std::fclose(file) == 0;
+  if (!ok || std::rename(tmp_path.c_str(),
+                         options.prometheus_path.c_str()) != 0) {
+    std::cerr << "Error writing file: " << options.prometheus_path
+              << std::endl;
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+void MetricsSink::PlotSeries::Add(double value) {
+  pending_sum += value;
+  if (++num_pending < stride) return;
+  points.push_back(pending_sum / stride);
+  pending_sum = 0.0;
+  num_pending = 0;
+  if (points.size() < 2 * kMaxPlotPoints) return;
+
+  for (size_t i = 0; i < kMaxPlotPoints; ++i) {
+    points[i] = (points[2 * i] + points[2 * i + 1]) / 2;
+  }
+  points.resize(kMaxPlotPoints);
+  stride *= 2;
+}
+
+}  // namespace afs
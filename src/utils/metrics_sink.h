@@ -0,0 +1,136 @@
+#ifndef METRICS_SINK_H_
+#define METRICS_SINK_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/spsc_queue.h"
+
+namespace afs {
+
+struct MetricsSinkOptions {
+  // Outputs left empty are not written.
+  std::string csv_path;          // step,seconds,name,value
+  std::string jsonl_path;        // One JSON object per event.
+  std::string prometheus_path;   // Latest value of each metric, text format.
+
+  // Show one OpenCV window per metric. Needs a display. HighGUI is not
+  // supported off the main thread on every backend, so the plots are drawn
+  // by PollPlots(), which the training thread has to call.
+  bool plot = false;
+
+  // Files are flushed, the Prometheus file rewritten and the plots redrawn
+  // at most once per interval.
+  double refresh_seconds = 1.0;
+
+  // Events that can wait for the consumer. Once the queue is full, new
+  // events are dropped and counted instead of blocking the trainer.
+  size_t queue_capacity = 1 << 14;
+};
+
+// Records scalar metrics (loss, accuracy, throughput, learning rate...) of a
+// training run without slowing it down.
+//
+// Push() only writes the event into a lock-free queue; a background thread
+// formats it, writes the files and prepares the plots. Events must be pushed
+// from a single thread. The plots themselves are drawn by PollPlots(), on the
+// thread calling it.
+//
+//   MetricsSink metrics;
+//   MetricsSinkOptions options;
+//   options.csv_path = "metrics.csv";
+//   if (!metrics.Start(options)) return 1;
+//   ...
+//   metrics.Push("train_loss", loss, step);
+//   metrics.PollPlots();
+//   ...
+//   metrics.Stop();
+class MetricsSink {
+ public:
+  MetricsSink() = default;
+  // Writes the queued events and stops the consumer.
+  ~MetricsSink();
+
+  MetricsSink(const MetricsSink &) = delete;
+  MetricsSink &operator=(const MetricsSink &) = delete;
+
+  // Open the outputs and start the consumer. Returns false if an output
+  // could not be opened.
+  bool Start(const MetricsSinkOptions &options);
+
+  // Queue `value` of metric `name` at training step `step`. `name` must
+  // outlive the sink, e.g. be a string literal. Never blocks.
+  void Push(const char *name, double value, size_t step);
+
+  // With `plot`, draw the plots prepared by the consumer since the last
+  // call, if any, on the calling thread. Call it regularly from the thread
+  // that owns the windows, e.g. once per batch. Never waits for the
+  // consumer.
+  void PollPlots();
+
+  // Write the queued events, close the outputs and join the consumer. With
+  // `plot`, also draws the final plots on the calling thread.
+  void Stop();
+
+  // Events dropped because the queue was full.
+  size_t GetNumDropped() const {
+    return num_dropped.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Event {
+    const char *name;
+    double value;
+    size_t step;
+    double seconds;
+  };
+
+  // History of a metric for plotting. Once it holds 2 * kMaxPlotPoints
+  // points, neighbouring points are averaged, so plotting stays bounded
+  // however long the run.
+  struct PlotSeries {
+    std::vector<double> points;
+    size_t stride = 1;
+    double pending_sum = 0.0;
+    size_t num_pending = 0;
+
+    void Add(double value);
+  };
+  static const size_t kMaxPlotPoints = 1000;
+
+  void Run();
+  void Write(const Event &event);
+  void Refresh();
+  bool WritePrometheus();
+  void CloseOutputs();
+
+  MetricsSinkOptions options;
+  std::unique_ptr<SpscQueue<Event>> queue;
+  std::chrono::steady_clock::time_point start;
+  std::atomic<size_t> num_dropped{0};
+  std::atomic<bool> stop{false};
+  std::thread consumer;
+
+  // Consumer state.
+  std::FILE *csv = nullptr;
+  std::FILE *jsonl = nullptr;
+  std::map<std::string, double> latest;
+  std::map<std::string, PlotSeries> series;
+  bool dirty = false;
+
+  // Plots prepared by the consumer for PollPlots().
+  std::mutex plot_mutex;
+  std::map<std::string, std::vector<double>> pending_plots;
+};
+
+}  // namespace afs
+
+#endif
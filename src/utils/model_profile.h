@@ -0,0 +1,171 @@
+#ifndef MODEL_PROFILE_H_
+#define MODEL_PROFILE_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "layers/layer_cost.h"
+
+namespace afs {
+
+// Cost summary of a network: the analytic FLOPs and bytes of each layer
+// and, once the time spent in the layers is recorded, the GFLOP/s and GB/s
+// they achieve. Given the peak compute and bandwidth of the machine, it also
+// reports the roofline efficiency of each layer: achieved GFLOP/s over
+// min(peak GFLOP/s, FLOPs per byte * peak GB/s).
+//
+//   ModelProfile profile;
+//   const size_t kConv1 = profile.Add("conv1", c1.GetCost());
+//   ...
+//   profile.Print(std::cout);
+//   ... profile.AddForwardTime(kConv1, seconds) ...
+//   profile.Print(std::cout);
+class ModelProfile {
+ public:
+  // With zero peaks, the efficiency columns are left out.
+  explicit ModelProfile(double peak_gflops = 0.0,
+                        double peak_gbytes_per_s = 0.0)
+      : peak_gflops(peak_gflops), peak_gbytes_per_s(peak_gbytes_per_s) {}
+
+  // Returns the index of the layer.
+  size_t Add(const std::string &name, const LayerCost &cost) {
+    layers.push_back({name, cost});
+    return layers.size() - 1;
+  }
+
+  // Time spent in the forward (backward) pass of `num_samples` samples.
+  void AddForwardTime(size_t layer, double seconds, size_t num_samples = 1) {
+    assert(layer < layers.size());
+    layers[layer].forward.seconds += seconds;
+    layers[layer].forward.num_samples += num_samples;
+  }
+
+  void AddBackwardTime(size_t layer, double seconds, size_t num_samples = 1) {
+    assert(layer < layers.size());
+    layers[layer].backward.seconds += seconds;
+    layers[layer].backward.num_samples += num_samples;
+  }
+
+  void ResetTimes() {
+    for (Layer &layer : layers) layer.forward = layer.backward = Timing();
+  }
+
+  // One row per layer and a total row. The measured columns appear once
+  // times were recorded.
+  void Print(std::ostream &out) const {
+    bool timed = false;
+    for (const Layer &layer : layers) {
+      timed = timed || layer.forward.num_samples > 0 ||
+              layer.backward.num_samples > 0;
+    }
+    const bool roofline = timed && peak_gflops > 0 && peak_gbytes_per_s > 0;
+
+    Layer total = {"total", LayerCost()};
+    for (const Layer &layer : layers) {
+      total.cost.num_parameters += layer.cost.num_parameters;
+      total.cost.forward_flops += layer.cost.forward_flops;
+      total.cost.forward_bytes += layer.cost.forward_bytes;
+      total.cost.backward_flops += layer.cost.backward_flops;
+      total.cost.backward_bytes += layer.cost.backward_bytes;
+      total.forward.seconds += layer.forward.SecondsPerSample();
+      total.backward.seconds += layer.backward.SecondsPerSample();
+    }
+    total.forward.num_samples = total.backward.num_samples = 1;
+
+    size_t name_width = 5;
+    for (const Layer &layer : layers) {
+      name_width = std::max(name_width, layer.name.size());
+    }
+
+    std::ostringstream table;
+    table << std::fixed << std::left << std::setw(name_width) << "layer"
+          << std::right << std::setw(10) << "params";
+    for (const char *phase : {"fwd", "bwd"}) {
+      table << std::setw(11) << (std::string(phase) + " MFLOP")
+            << std::setw(10) << (std::string(phase) + " KB") << std::setw(8)
+            << "FLOP/B";
+      if (timed) {
+        table << std::setw(10) << (std::string(phase) + " us")
+              << std::setw(9) << "GFLOP/s" << std::setw(8) << "GB/s";
+        if (roofline) table << std::setw(7) << "eff%";
+      }
+    }
+    if (timed) table << std::setw(7) << "time%";
+    table << "\n";
+
+    const double total_seconds =
+        total.forward.seconds + total.backward.seconds;
+    auto print_row = [&](const Layer &layer) {
+      table << std::left << std::setw(name_width) << layer.name << std::right
+            << std::setw(10) << layer.cost.num_parameters;
+      PrintPhase(table, layer.cost.forward_flops, layer.cost.forward_bytes,
+                 layer.forward, timed, roofline);
+      PrintPhase(table, layer.cost.backward_flops, layer.cost.backward_bytes,
+                 layer.backward, timed, roofline);
+      if (timed) {
+        const double seconds = layer.forward.SecondsPerSample() +
+                               layer.backward.SecondsPerSample();
+        table << std::setprecision(1) << std::setw(7)
+              << (total_seconds > 0 ? 100 * seconds / total_seconds : 0.0);
+      }
+      table << "\n";
+    };
+    for (const Layer &layer : layers) print_row(layer);
+    print_row(total);
+    out << table.str();
+  }
+
+ private:
+  struct Timing {
+    double seconds = 0.0;
+    size_t num_samples = 0;
+
+    double SecondsPerSample() const {
+      return num_samples > 0 ? seconds / num_samples : 0.0;
+    }
+  };
+
+  struct Layer {
+    std::string name;
+    LayerCost cost;
+    Timing forward;
+    Timing backward;
+  };
+
+  void PrintPhase(std::ostream &table, double flops, double bytes,
+                  const Timing &timing, bool timed, bool roofline) const {
+    table << std::setprecision(3) << std::setw(11) << flops * 1e-6
+          << std::setprecision(1) << std::setw(10) << bytes / 1024
+          << std::setprecision(2) << std::setw(8)
+          << (bytes > 0 ? flops / bytes : 0.0);
+    if (!timed) return;
+
+    const double seconds = timing.SecondsPerSample();
+    const double gflops = seconds > 0 ? flops / seconds * 1e-9 : 0.0;
+    const double gbytes_per_s = seconds > 0 ? bytes / seconds * 1e-9 : 0.0;
+    table << std::setprecision(1) << std::setw(10) << seconds * 1e6
+          << std::setprecision(2) << std::setw(9) << gflops << std::setw(8)
+          << gbytes_per_s;
+    if (roofline) {
+      const double attainable =
+          std::min(peak_gflops,
+                   (bytes > 0 ? flops / bytes : 0.0) * peak_gbytes_per_s);
+      table << std::setprecision(1) << std::setw(7)
+            << (attainable > 0 ? 100 * gflops / attainable : 0.0);
+    }
+  }
+
+  double peak_gflops;
+  double peak_gbytes_per_s;
+  std::vector<Layer> layers;
+};
+
+}  // namespace afs
+
+#endif
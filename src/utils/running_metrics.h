@@ -0,0 +1,105 @@
+#ifndef RUNNING_METRICS_H_
+#define RUNNING_METRICS_H_
+
+#include <algorithm>
+#include <armadillo>
+#include <cstddef>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+namespace afs {
+
+// Accuracy, mean loss and confusion matrix accumulated one prediction at a
+// time, so that they can be collected from forward passes the trainer
+// already runs instead of a separate evaluation pass.
+//
+//   RunningMetrics train_metrics(10);
+//   ... for each training sample:
+//     loss = l.Forward(s_out, target);
+//     train_metrics.Add(s_out, target, loss);
+//   ...
+//   std::cout << train_metrics.Accuracy() << std::endl;
+//   train_metrics.Reset();
+//
+// Metrics collected during training average over weights that change from
+// batch to batch, and over dropout in training mode.
+class RunningMetrics {
+ public:
+  // With zero classes, no confusion matrix is kept.
+  explicit RunningMetrics(size_t num_classes = 0)
+      : confusion(num_classes, num_classes, arma::fill::zeros) {}
+
+  // The predicted and actual classes are the largest entries of `output` and
+  // `target`.
+  void Add(const arma::vec &output, const arma::vec &target, double loss) {
+    Add(output.index_max(), target.index_max(), loss);
+  }
+
+  void Add(size_t predicted, size_t actual, double loss) {
+    ++count;
+    total_loss += loss;
+    if (predicted == actual) ++correct;
+    if (predicted < confusion.n_cols && actual < confusion.n_rows) {
+      ++confusion(actual, predicted);
+    }
+  }
+
+  // Add the predictions counted by `other`, e.g. by another thread.
+  void Merge(const RunningMetrics &other) {
+    count += other.count;
+    correct += other.correct;
+    total_loss += other.total_loss;
+    if (arma::size(confusion) == arma::size(other.confusion)) {
+      confusion += other.confusion;
+    }
+  }
+
+  void Reset() {
+    count = 0;
+    correct = 0;
+    total_loss = 0.0;
+    confusion.zeros();
+  }
+
+  size_t Count() const { return count; }
+  double Accuracy() const {
+    return count > 0 ? static_cast<double>(correct) / count : 0.0;
+  }
+  double MeanLoss() const { return count > 0 ? total_loss / count : 0.0; }
+
+  // Entry (actual, predicted) counts the samples of class `actual`
+  // predicted as `predicted`.
+  const arma::umat &GetConfusionMatrix() const { return confusion; }
+
+  // The confusion matrix, one row per actual class.
+  void PrintConfusionMatrix(std::ostream &out) const {
+    size_t width = 6;
+    if (confusion.n_elem > 0) {
+      width = std::max<size_t>(width, std::to_string(confusion.max()).size() +
+                                          1);
+    }
+    out << std::setw(width) << "";
+    for (size_t j = 0; j < confusion.n_cols; ++j) {
+      out << std::setw(width) << j;
+    }
+    out << "\n";
+    for (size_t i = 0; i < confusion.n_rows; ++i) {
+      out << std::setw(width) << i;
+      for (size_t j = 0; j < confusion.n_cols; ++j) {
+        out << std::setw(width) << confusion(i, j);
+      }
+      out << "\n";
+    }
+  }
+
+ private:
+  size_t count = 0;
+  size_t correct = 0;
+  double total_loss = 0.0;
+  arma::umat confusion;
+};
+
+}  // namespace afs
+
+#endif
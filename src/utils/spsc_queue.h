@@ -0,0 +1,67 @@
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace afs {
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread.
+//
+// The slots are allocated once and reused: the producer fills the slot
+// returned by BeginPush() in place and publishes it with EndPush(), the
+// consumer reads Front() and hands the slot back with Pop(). Objects keep
+// their buffers between uses, so a queue of batches never reallocates.
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity) : slots(capacity + 1) {
+    assert(capacity > 0);
+  }
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  // Producer side. Returns null if the queue is full.
+  T *BeginPush() {
+    const size_t tail_index = tail.load(std::memory_order_relaxed);
+    if (Next(tail_index) == head.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &slots[tail_index];
+  }
+  void EndPush() {
+    tail.store(Next(tail.load(std::memory_order_relaxed)),
+               std::memory_order_release);
+  }
+
+  // Consumer side. Returns null if the queue is empty.
+  T *Front() {
+    const size_t head_index = head.load(std::memory_order_relaxed);
+    if (head_index == tail.load(std::memory_order_acquire)) return nullptr;
+    return &slots[head_index];
+  }
+  void Pop() {
+    head.store(Next(head.load(std::memory_order_relaxed)),
+               std::memory_order_release);
+  }
+
+  size_t Capacity() const { return slots.size() - 1; }
+
+ private:
+  size_t Next(size_t index) const {
+    return index + 1 == slots.size() ? 0 : index + 1;
+  }
+
+  std::vector<T> slots;
+  // Keep the indices written by each side on separate cache lines.
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
+
+}  // namespace afs
+
+#endif
@@ -0,0 +1,130 @@
+#include "trace.h"
+
+#ifdef AFS_ENABLE_TRACING
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace afs {
+
+namespace {
+
+struct Event {
+  const char *name;
+  uint64_t begin_ns;
+  uint64_t end_ns;
+};
+
+// Single-writer ring buffer of the events of one thread. `head` counts the
+// events ever recorded; event i is in slot i % kBufferSize.
+struct ThreadBuffer {
+  size_t tid = 0;
+  std::string name;
+  std::vector<Event> events;
+  std::atomic<uint64_t> head{0};
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+Registry &GetRegistry() {
+  static Registry *registry = new Registry();
+  return *registry;
+}
+
+ThreadBuffer &GetThreadBuffer() {
+  thread_local std::shared_ptr<ThreadBuffer> buffer;
+  if (!buffer) {
+    buffer = std::make_shared<ThreadBuffer>();
+    buffer->events.resize(Tracer::kBufferSize);
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    buffer->tid = registry.buffers.size() + 1;
+    registry.buffers.push_back(buffer);
+  }
+  return *buffer;
+}
+
+}  // namespace
+
+void Tracer::Record(const char *name, uint64_t begin_ns, uint64_t end_ns) {
+  ThreadBuffer &buffer = GetThreadBuffer();
+  const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+  buffer.events[head % kBufferSize] = {name, begin_ns, end_ns};
+  buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::SetThreadName(const std::string &name) {
+  ThreadBuffer &buffer = GetThreadBuffer();
+  std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+  buffer.name = name;
+}
+
+bool Tracer::WriteChromeTrace(const std::string &path) {
+  std::ofstream file(path);
+  if (!file) {
+    std::cerr << "Cannot write trace: " << path << std::endl;
+    return false;
+  }
+  file << std::fixed << std::setprecision(3);
+  file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+  Registry &registry = GetRegistry();
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  std::vector<std::string> names;
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    buffers = registry.buffers;
+    for (const auto &buffer : buffers) names.push_back(buffer->name);
+  }
+
+  bool first = true;
+  std::vector<Event> events;
+  for (size_t b = 0; b < buffers.size(); ++b) {
+    const ThreadBuffer &buffer = *buffers[b];
+    if (!names[b].empty()) {
+      file << (first ? "\n" : ",\n")
+           << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+              "\"tid\": "
+           << buffer.tid << ", \"args\": {\"name\": \"" << names[b]
+           << "\"}}";
+      first = false;
+    }
+
+    // Copy the events, then drop those the thread overwrote meanwhile.
+    const uint64_t end = buffer.head.load(std::memory_order_acquire);
+    uint64_t begin = end > kBufferSize ? end - kBufferSize : 0;
+    events.clear();
+    for (uint64_t i = begin; i < end; ++i) {
+      events.push_back(buffer.events[i % kBufferSize]);
+    }
+    const uint64_t head = buffer.head.load(std::memory_order_acquire);
+    const uint64_t valid = head > kBufferSize ? head - kBufferSize : 0;
+    const size_t skip = valid > begin ? std::min<uint64_t>(valid - begin,
+                                                           events.size())
+                                      : 0;
+
+    for (size_t i = skip; i < events.size(); ++i) {
+      const Event &event = events[i];
+      file << (first ? "\n" : ",\n") << "{\"name\": \"" << event.name
+           << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer.tid
+           << ", \"ts\": " << event.begin_ns * 1e-3
+           << ", \"dur\": " << (event.end_ns - event.begin_ns) * 1e-3 << "}";
+      first = false;
+    }
+  }
+  file << "\n]}" << std::endl;
+  return static_cast<bool>(file);
+}
+
+}  // namespace afs
+
+#endif  // AFS_ENABLE_TRACING
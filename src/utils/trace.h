@@ -0,0 +1,95 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+// Scoped tracing of the hot path, exported in the Chrome trace event format
+// (chrome://tracing, https://ui.perfetto.dev).
+//
+// Tracing is compiled in only when AFS_ENABLE_TRACING is defined (CMake
+// option AFS_ENABLE_TRACING). Otherwise the macros below expand to nothing
+// and none of this header is compiled.
+//
+//   void Conv2D::Forward(...) {
+//     AFS_TRACE_SCOPE("Conv2D::Forward");
+//     ...
+//   }
+//   ...
+//   AFS_TRACE_WRITE("trace.json");
+
+#ifdef AFS_ENABLE_TRACING
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace afs {
+
+// Records the events of each thread into its own ring buffer. Recording is
+// lock-free: a thread only takes a lock the first time it records, to
+// register its buffer. Once a buffer is full, the oldest events are
+// overwritten.
+class Tracer {
+ public:
+  // Events kept per thread.
+  static const size_t kBufferSize = 1 << 16;
+
+  // Nanoseconds since the first traced event.
+  static uint64_t Now() {
+    static const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+  // Record an event of the calling thread. `name` must outlive the tracer,
+  // e.g. be a string literal.
+  static void Record(const char *name, uint64_t begin_ns, uint64_t end_ns);
+
+  // Name of the calling thread in the trace.
+  static void SetThreadName(const std::string &name);
+
+  // Write the events of all threads, including the threads that exited, as
+  // Chrome trace JSON. Can be called while other threads are recording;
+  // events overwritten during the export are left out.
+  static bool WriteChromeTrace(const std::string &path);
+};
+
+// Records the lifetime of the scope as one event.
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name) : name(name), begin(Tracer::Now()) {}
+  ~TraceScope() { Tracer::Record(name, begin, Tracer::Now()); }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+ private:
+  const char *name;
+  uint64_t begin;
+};
+
+}  // namespace afs
+
+#define AFS_TRACE_CONCAT_(a, b) a##b
+#define AFS_TRACE_CONCAT(a, b) AFS_TRACE_CONCAT_(a, b)
+#define AFS_TRACE_SCOPE(name) \
+  ::afs::TraceScope AFS_TRACE_CONCAT(afs_trace_scope_, __LINE__)(name)
+#define AFS_TRACE_THREAD_NAME(name) ::afs::Tracer::SetThreadName(name)
+#define AFS_TRACE_WRITE(path) ::afs::Tracer::WriteChromeTrace(path)
+
+#else
+
+#define AFS_TRACE_SCOPE(name) \
+  do {                        \
+  } while (0)
+#define AFS_TRACE_THREAD_NAME(name) \
+  do {                              \
+  } while (0)
+#define AFS_TRACE_WRITE(path) \
+  do {                        \
+  } while (0)
+
+#endif  // AFS_ENABLE_TRACING
+
+#endif
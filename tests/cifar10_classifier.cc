@@ -0,0 +1,404 @@
+// CIFAR-10 classification with a three-block conv net. Also serves as the
+// reference conv workload: after every epoch it reports the throughput of
+// the forward, backward and update phases separately.
+//
+// Usage:
+//   ./cifar10_classifier [data_dir | --synthetic] [epochs]
+//                        [peak_gflops peak_gbytes_per_s]
+//
+// data_dir holds the binary version of the dataset (data_batch_1.bin ...
+// test_batch.bin), ../data/CIFAR10 by default. With --synthetic, random
+// images and labels are generated instead, so the benchmark runs without
+// the dataset.
+//
+// The analytic FLOPs and bytes of each layer are printed at startup, and
+// with the time measured in each layer after every epoch. Given the peak
+// compute and memory bandwidth of the machine, the table also shows the
+// roofline efficiency of each layer.
+//
+// Built with -DAFS_ENABLE_ALLOC_PROFILING=ON, it also reports the memory
+// allocated by each layer and phase during the last batch of every epoch.
+
+#include <armadillo>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "datasets/cifar10_data.h"
+#include "datasets/data_loader.h"
+#include "datasets/dataset.h"
+#include "layers/conv2d.h"
+#include "layers/dense.h"
+#include "layers/max_pooling.h"
+#include "layers/relu.h"
+#include "layers/softmax.h"
+#include "losses/cross_entropy_loss.h"
+#include "optimizers/adam.h"
+#include "optimizers/parameter_store.h"
+#include "utils/alloc_profiler.h"
+#include "utils/data_transformer.h"
+#include "utils/metrics_sink.h"
+#include "utils/model_profile.h"
+#include "utils/running_metrics.h"
+#include "utils/trace.h"
+
+using namespace afs;
+using namespace std;
+
+typedef std::chrono::steady_clock Clock;
+
+double SecondsSince(Clock::time_point start) {
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+// Random images with random labels, laid out like the CIFAR-10 records.
+Dataset MakeSyntheticDataset(size_t num_samples, uint64_t seed) {
+  const size_t kRecordSize = 1 + 32 * 32 * 3;
+  std::shared_ptr<uint8_t> records(new uint8_t[num_samples * kRecordSize],
+                                   std::default_delete<uint8_t[]>());
+  std::mt19937_64 rng(seed);
+  for (size_t i = 0; i < num_samples * kRecordSize; ++i) {
+    records.get()[i] = rng() % 256;
+  }
+  for (size_t i = 0; i < num_samples; ++i) {
+    records.get()[i * kRecordSize] = rng() % 10;
+  }
+  Dataset dataset(32, 32, 3);
+  dataset.AddRecords(records, num_samples, kRecordSize, 0, 1, 10);
+  dataset.SetNormalization(1.0 / 255.0);
+  return dataset;
+}
+
+int main(int argc, char **argv) {
+  const std::string source = argc > 1 ? argv[1] : "../data/CIFAR10";
+  const bool synthetic = source == "--synthetic";
+  const size_t kEpochs = argc > 2 ? std::stoul(argv[2]) : 10;
+  const double kPeakGflops = argc > 4 ? std::stod(argv[3]) : 0.0;
+  const double kPeakGbytesPerSecond = argc > 4 ? std::stod(argv[4]) : 0.0;
+
+  Dataset train_data;
+  Dataset validation_data;
+  if (synthetic) {
+    MakeSyntheticDataset(5000, 0).Split(0.9, train_data, validation_data);
+  } else {
+    CIFAR10Data cifar(source);
+    train_data = cifar.getTrainData();
+    validation_data = cifar.getValidationData();
+  }
+
+  std::cout << "Training data size: " << train_data.Size() << std::endl;
+  std::cout << "Validation data size: " << validation_data.Size() << std::endl;
+  std::cout << std::endl;
+
+  const size_t kTrainDataSize = train_data.Size();
+  // Intermediate epochs are validated on a random subset, the last one on
+  // the whole validation set.
+  const size_t kValidSubsetSize = 2000;
+  const double kLearningRate = 0.001;
+  const size_t kBatchSize = 32;
+  const size_t kNumBatches = kTrainDataSize / kBatchSize;
+
+  // Define the network layers
+  Conv2D c1(32, 32, 3, 5, 5, 1, 1, 16);
+  // Output is 28 x 28 x 16
+
+  ReLU r1(28, 28, 16);
+  MaxPooling mp1(28, 28, 16, 2, 2, 2, 2);
+  // Output is 14 x 14 x 16
+
+  Conv2D c2(14, 14, 16, 3, 3, 1, 1, 32);
+  // Output is 12 x 12 x 32
+
+  ReLU r2(12, 12, 32);
+  MaxPooling mp2(12, 12, 32, 2, 2, 2, 2);
+  // Output is 6 x 6 x 32
+
+  Conv2D c3(6, 6, 32, 3, 3, 1, 1, 64);
+  // Output is 4 x 4 x 64
+
+  ReLU r3(4, 4, 64);
+  MaxPooling mp3(4, 4, 64, 2, 2, 2, 2);
+  // Output is 2 x 2 x 64
+
+  Dense d(2 * 2 * 64, 10);
+  // Output is a vector of size 10
+
+  Softmax s(10);
+  // Output is a vector of size 10
+
+  CrossEntropyLoss l(10);
+
+  ModelProfile profile(kPeakGflops, kPeakGbytesPerSecond);
+  const size_t kConv1 = profile.Add("conv1", c1.GetCost());
+  const size_t kReLU1 = profile.Add("relu1", r1.GetCost());
+  const size_t kPool1 = profile.Add("pool1", mp1.GetCost());
+  const size_t kConv2 = profile.Add("conv2", c2.GetCost());
+  const size_t kReLU2 = profile.Add("relu2", r2.GetCost());
+  const size_t kPool2 = profile.Add("pool2", mp2.GetCost());
+  const size_t kConv3 = profile.Add("conv3", c3.GetCost());
+  const size_t kReLU3 = profile.Add("relu3", r3.GetCost());
+  const size_t kPool3 = profile.Add("pool3", mp3.GetCost());
+  const size_t kDense = profile.Add("dense", d.GetCost());
+  const size_t kSoftmax = profile.Add("softmax", s.GetCost());
+  std::cout << "Cost per image:" << std::endl;
+  profile.Print(std::cout);
+  std::cout << std::endl;
+
+  // Run one layer and add its time to the profile.
+  auto forward = [&profile](size_t layer, auto step) {
+    auto start = Clock::now();
+    step();
+    profile.AddForwardTime(layer, SecondsSince(start));
+  };
+  auto backward = [&profile](size_t layer, auto step) {
+    auto start = Clock::now();
+    step();
+    profile.AddBackwardTime(layer, SecondsSince(start));
+  };
+
+  ParameterStore parameters;
+  c1.RegisterParameters(parameters);
+  c2.RegisterParameters(parameters);
+  c3.RegisterParameters(parameters);
+  d.RegisterParameters(parameters);
+  parameters.Allocate();
+
+  Adam optimizer(kLearningRate);
+
+  // Initialize armadillo structures to store intermediate outputs (Ie. outputs
+  // of hidden layers)
+  arma::cube c1_out, r1_out, mp1_out;
+  arma::cube c2_out, r2_out, mp2_out;
+  arma::cube c3_out, r3_out, mp3_out;
+  arma::vec d_out;
+  arma::vec s_out;
+
+  // Gradients flowing back through the network
+  arma::vec grad_wrt_predicted_distribution, grad_wrt_s_in;
+  arma::cube grad_wrt_d_in, grad_wrt_mp3_in, grad_wrt_r3_in, grad_wrt_c3_in;
+  arma::cube grad_wrt_mp2_in, grad_wrt_r2_in, grad_wrt_c2_in;
+  arma::cube grad_wrt_mp1_in, grad_wrt_r1_in;
+
+  // Training images are randomly cropped from a 4-pixel padding, mirrored
+  // and brightened on the loader threads.
+  std::mt19937_64 rng(0);
+  DataLoader loader(kBatchSize);
+  AugmentationOptions augmentation;
+  augmentation.crop_padding = 4;
+  augmentation.horizontal_flip = true;
+  augmentation.brightness = 0.1;
+  loader.SetAugmentation(augmentation);
+
+  // Metrics go to cifar10_metrics.csv and, for scraping during long
+  // benchmark runs, cifar10_metrics.prom.
+  MetricsSink metrics;
+  MetricsSinkOptions metrics_options;
+  metrics_options.csv_path = "cifar10_metrics.csv";
+  metrics_options.prometheus_path = "cifar10_metrics.prom";
+  metrics_options.plot = std::getenv("DISPLAY") != nullptr;
+  if (!metrics.Start(metrics_options)) return 1;
+  metrics.Push("learning_rate", kLearningRate, 0);
+
+  // The training accuracy is collected from the forward passes of the
+  // training itself.
+  RunningMetrics train_metrics(10);
+  RunningMetrics validation_metrics(10);
+
+  // Inference-only forward pass. It only reads the layers, so evaluation
+  // runs on all cores, each thread with its own activations.
+  struct Activations {
+    arma::cube c1_out, r1_out, mp1_out, c2_out, r2_out, mp2_out, c3_out, r3_out, mp3_out;
+    arma::vec d_out;
+  };
+  auto predict = [&](const arma::cube &input, Activations &a,
+                     arma::vec &output) {
+    c1.Predict(input, a.c1_out);
+    r1.Predict(a.c1_out, a.r1_out);
+    mp1.Predict(a.r1_out, a.mp1_out);
+    c2.Predict(a.mp1_out, a.c2_out);
+    r2.Predict(a.c2_out, a.r2_out);
+    mp2.Predict(a.r2_out, a.mp2_out);
+    c3.Predict(a.mp2_out, a.c3_out);
+    r3.Predict(a.c3_out, a.r3_out);
+    mp3.Predict(a.r3_out, a.mp3_out);
+    d.Predict(a.mp3_out, a.d_out);
+    s.Predict(a.d_out, output);
+  };
+
+  for (size_t epoch = 0; epoch < kEpochs; ++epoch) {
+    std::cout << "*** Epoch " << epoch + 1 << "/" << kEpochs << ":"
+              << std::endl;
+    train_data.Shuffle(rng);
+    loader.Start(train_data);
+
+    double forward_seconds = 0.0;
+    double backward_seconds = 0.0;
+    double update_seconds = 0.0;
+    double epoch_loss = 0.0;
+    auto epoch_start = Clock::now();
+
+    for (size_t batch_idx = 0; batch_idx < kNumBatches; ++batch_idx) {
+      AFS_TRACE_SCOPE("Training batch");
+#ifdef AFS_ENABLE_ALLOC_PROFILING
+      AllocationProfiler::BeginStep();
+#endif
+      Batch *batch = loader.Next();
+      double mini_batch_loss = 0.0;
+      for (size_t i = 0; i < kBatchSize; ++i) {
+        // Forward pass
+        auto start = Clock::now();
+        forward(kConv1, [&] { c1.Forward(batch->inputs[i], c1_out); });
+        forward(kReLU1, [&] { r1.Forward(c1_out, r1_out); });
+        forward(kPool1, [&] { mp1.Forward(r1_out, mp1_out); });
+        forward(kConv2, [&] { c2.Forward(mp1_out, c2_out); });
+        forward(kReLU2, [&] { r2.Forward(c2_out, r2_out); });
+        forward(kPool2, [&] { mp2.Forward(r2_out, mp2_out); });
+        forward(kConv3, [&] { c3.Forward(mp2_out, c3_out); });
+        forward(kReLU3, [&] { r3.Forward(c3_out, r3_out); });
+        forward(kPool3, [&] { mp3.Forward(r3_out, mp3_out); });
+        forward(kDense, [&] { d.Forward(mp3_out, d_out); });
+        forward(kSoftmax, [&] { s.Forward(d_out, s_out); });
+        const double loss = l.Forward(s_out, batch->targets[i]);
+        mini_batch_loss += loss;
+        train_metrics.Add(s_out, batch->targets[i], loss);
+        forward_seconds += SecondsSince(start);
+
+        // Backward pass
+        start = Clock::now();
+        l.Backward();
+        grad_wrt_predicted_distribution =
+            l.GetGradientWrtPredictedDistribution();
+        backward(kSoftmax, [&] {
+          s.Backward(grad_wrt_predicted_distribution);
+          grad_wrt_s_in = s.GetGradientWrtInput();
+        });
+        backward(kDense, [&] {
+          d.Backward(grad_wrt_s_in);
+          grad_wrt_d_in = DataTransformer::VecToCube(
+              d.GetGradientWrtInput(), mp3.output.n_rows, mp3.output.n_cols,
+              mp3.output.n_slices);
+        });
+        backward(kPool3, [&] {
+          mp3.Backward(grad_wrt_d_in);
+          grad_wrt_mp3_in = mp3.GetGradientWrtInput();
+        });
+        backward(kReLU3, [&] {
+          r3.Backward(grad_wrt_mp3_in);
+          grad_wrt_r3_in = r3.GetGradientWrtInput();
+        });
+        backward(kConv3, [&] {
+          c3.Backward(grad_wrt_r3_in);
+          grad_wrt_c3_in = c3.GetGradientWrtInput();
+        });
+        backward(kPool2, [&] {
+          mp2.Backward(grad_wrt_c3_in);
+          grad_wrt_mp2_in = mp2.GetGradientWrtInput();
+        });
+        backward(kReLU2, [&] {
+          r2.Backward(grad_wrt_mp2_in);
+          grad_wrt_r2_in = r2.GetGradientWrtInput();
+        });
+        backward(kConv2, [&] {
+          c2.Backward(grad_wrt_r2_in);
+          grad_wrt_c2_in = c2.GetGradientWrtInput();
+        });
+        backward(kPool1, [&] {
+          mp1.Backward(grad_wrt_c2_in);
+          grad_wrt_mp1_in = mp1.GetGradientWrtInput();
+        });
+        backward(kReLU1, [&] {
+          r1.Backward(grad_wrt_mp1_in);
+          grad_wrt_r1_in = r1.GetGradientWrtInput();
+        });
+        backward(kConv1, [&] { c1.Backward(grad_wrt_r1_in); });
+        backward_seconds += SecondsSince(start);
+      }
+      epoch_loss += mini_batch_loss;
+      metrics.Push("train_loss", mini_batch_loss / kBatchSize,
+                   epoch * kNumBatches + batch_idx + 1);
+      metrics.PollPlots();
+
+      std::cout << '\r' << "Batch " << batch_idx + 1 << "/" << kNumBatches
+                << " Batch loss: " << mini_batch_loss / kBatchSize
+                << std::flush;
+
+      // Update params
+      auto start = Clock::now();
+      optimizer.Step(parameters, kBatchSize);
+      update_seconds += SecondsSince(start);
+    }
+    const double epoch_seconds = SecondsSince(epoch_start);
+    const double num_images = kNumBatches * kBatchSize;
+
+    std::cout << std::endl;
+    std::cout << "Training loss: " << epoch_loss / num_images
+              << ", running accuracy: " << train_metrics.Accuracy()
+              << std::endl;
+    metrics.Push("train_accuracy", train_metrics.Accuracy(),
+                 (epoch + 1) * kNumBatches);
+    train_metrics.Reset();
+    std::cout << "Throughput (images/s): forward "
+              << num_images / forward_seconds << ", backward "
+              << num_images / backward_seconds << ", update "
+              << num_images / update_seconds << ", overall "
+              << num_images / epoch_seconds << std::endl;
+    metrics.Push("train_images_per_second", num_images / epoch_seconds,
+                 (epoch + 1) * kNumBatches);
+    std::cout << "Time spent waiting for data: " << loader.GetWaitSeconds()
+              << "s" << std::endl;
+    profile.Print(std::cout);
+    profile.ResetTimes();
+#ifdef AFS_ENABLE_ALLOC_PROFILING
+    AllocationProfiler::PrintReport(std::cout);
+#endif
+
+    // Compute validation loss and accuracy after epoch, without keeping
+    // activations for a backward pass
+    AFS_TRACE_SCOPE("Validation");
+    const Dataset validation_subset =
+        epoch + 1 < kEpochs
+            ? validation_data.Sample(kValidSubsetSize, rng)
+            : validation_data;
+    validation_metrics.Reset();
+    #pragma omp parallel
+    {
+      Activations activations;
+      arma::cube sample;
+      arma::vec sample_target, prediction;
+      RunningMetrics thread_metrics(10);
+      #pragma omp for schedule(dynamic, 64) nowait
+      for (size_t i = 0; i < validation_subset.Size(); ++i) {
+        validation_subset.GetSample(i, sample);
+        validation_subset.GetTarget(i, sample_target);
+        predict(sample, activations, prediction);
+        thread_metrics.Add(prediction, sample_target,
+                           l.Evaluate(prediction, sample_target));
+      }
+      #pragma omp critical
+      validation_metrics.Merge(thread_metrics);
+    }
+    std::cout << "Val loss: " << validation_metrics.MeanLoss()
+              << ", accuracy: " << validation_metrics.Accuracy() << " ("
+              << validation_subset.Size() << " images)" << std::endl;
+    metrics.Push("val_loss", validation_metrics.MeanLoss(),
+                 (epoch + 1) * kNumBatches);
+    metrics.Push("val_accuracy", validation_metrics.Accuracy(),
+                 (epoch + 1) * kNumBatches);
+    if (epoch + 1 == kEpochs) {
+      std::cout << "Confusion matrix (rows: actual, columns: predicted):"
+                << std::endl;
+      validation_metrics.PrintConfusionMatrix(std::cout);
+    }
+    std::cout << std::endl;
+  }
+
+  // Written only in builds with AFS_ENABLE_TRACING.
+  AFS_TRACE_WRITE("cifar10_trace.json");
+}
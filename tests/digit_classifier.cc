@@ -1,18 +1,27 @@
 #include <armadillo>
 #include <cassert>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <vector>
 
+#include "datasets/data_loader.h"
 #include "datasets/mnist.h"
+#include "inference/background_validator.h"
+#include "io/async_checkpointer.h"
+#include "io/checkpoint.h"
 #include "layers/conv2d.h"
 #include "layers/dense.h"
 #include "layers/max_pooling.h"
 #include "layers/relu.h"
 #include "layers/softmax.h"
 #include "losses/cross_entropy_loss.h"
-#include "utils/visualizer.h"
+#include "optimizers/adam.h"
+#include "optimizers/parameter_store.h"
 #include "utils/data_transformer.h"
+#include "utils/metrics_sink.h"
+#include "utils/running_metrics.h"
+#include "utils/trace.h"
 
 using namespace afs;
 using namespace std;
@@ -21,26 +30,18 @@ int main(int argc, char **argv) {
   // Load MNIST data
   MNISTData md("../data/MNIST");
 
-  std::vector<arma::cube> train_data = md.getTrainData();
-  std::vector<arma::vec> train_labels = md.getTrainLabels();
+  Dataset train_data = md.getTrainData();
+  const Dataset &validation_data = md.getValidationData();
+  const Dataset &test_data = md.getTestData();
 
-  std::vector<arma::cube> validation_data = md.getValidationData();
-  std::vector<arma::vec> validation_labels = md.getValidationLabels();
-
-  assert(train_data.size() == train_labels.size());
-  assert(validation_data.size() == validation_labels.size());
-
-  std::vector<arma::cube> test_data = md.getTestData();
-
-  std::cout << "Training data size: " << train_data.size() << std::endl;
-  std::cout << "Validation data size: " << validation_data.size() << std::endl;
-  std::cout << "Test data size: " << test_data.size() << std::endl;
+  std::cout << "Training data size: " << train_data.Size() << std::endl;
+  std::cout << "Validation data size: " << validation_data.Size() << std::endl;
+  std::cout << "Test data size: " << test_data.Size() << std::endl;
   std::cout << std::endl;
 
-  const size_t kTrainDataSize = train_data.size();
-  const size_t kValidDataSize = validation_data.size();
-  const size_t kTestDataSize = test_data.size();
-  const double kLearningRate = 0.01;
+  const size_t kTrainDataSize = train_data.Size();
+  const size_t kTestDataSize = test_data.Size();
+  const double kLearningRate = 0.001;
   const size_t kEpochs = 10;
   const size_t kBatchSize = 16;
   const size_t kNumBatches = kTrainDataSize / kBatchSize;
@@ -72,6 +73,20 @@ int main(int argc, char **argv) {
 
   CrossEntropyLoss l(10);
 
+  // Keep all trainable parameters in one flat buffer so that the optimizer
+  // updates the whole network in a single pass.
+  ParameterStore parameters;
+  c1.RegisterParameters(parameters);
+  c2.RegisterParameters(parameters);
+  d.RegisterParameters(parameters);
+  parameters.Allocate();
+
+  Adam optimizer(kLearningRate);
+
+  // Snapshot the network and optimizer state every 500 batches or 10
+  // minutes, without stopping training.
+  AsyncCheckpointer checkpointer(500, 600);
+
   // Initialize armadillo structures to store intermediate outputs (Ie. outputs
   // of hidden layers)
   arma::cube c1_out = arma::zeros(24, 24, 6);
@@ -83,22 +98,84 @@ int main(int argc, char **argv) {
   arma::vec d_out = arma::zeros(10);
   arma::vec s_out = arma::zeros(10);
 
+  // The training samples are visited in a new order every epoch. Batches
+  // are assembled on background threads while the previous one trains, and
+  // the digits are shifted by up to 2 pixels on the way.
+  std::mt19937_64 rng(0);
+  DataLoader loader(kBatchSize);
+  AugmentationOptions augmentation;
+  augmentation.max_translation = 2;
+  loader.SetAugmentation(augmentation);
+
   // Initialize loss and cumulative loss. Cumulative loss totals loss over all
   // training examples in a minibatch.
   double loss;
   double epoch_loss = 0.0;
   double mini_batch_loss;
-  std::vector<double> train_loss_history;
+
+  // Metrics are written to lenet_metrics.csv on a background thread, and
+  // plotted when a display is available.
+  MetricsSink metrics;
+  MetricsSinkOptions metrics_options;
+  metrics_options.csv_path = "lenet_metrics.csv";
+  metrics_options.plot = std::getenv("DISPLAY") != nullptr;
+  if (!metrics.Start(metrics_options)) return 1;
+
+  // The training accuracy is collected from the forward passes of the
+  // training itself; only the validation set gets an extra pass.
+  RunningMetrics train_metrics(10);
+
+  // The validation pass runs on a snapshot of the weights, on background
+  // threads, while the next epoch trains.
+  BackgroundValidator validator(
+      validation_data, 10,
+      [l](const arma::vec &prediction, const arma::vec &target) {
+        return l.Evaluate(prediction, target);
+      });
+  auto report_validation = [&](const ValidationResult &result) {
+    std::cout << std::endl
+              << "Epoch " << result.step << " validation loss: "
+              << result.metrics.MeanLoss()
+              << " Val accuracy: " << result.metrics.Accuracy() << " ("
+              << result.seconds << "s)" << std::endl;
+    metrics.Push("val_loss", result.metrics.MeanLoss(),
+                 result.step * kNumBatches);
+    metrics.Push("val_accuracy", result.metrics.Accuracy(),
+                 result.step * kNumBatches);
+  };
+  ValidationResult validation;
+
+  // Inference-only forward pass. It only reads the layers, so evaluation
+  // runs on all cores, each thread with its own activations.
+  struct Activations {
+    arma::cube c1_out, r1_out, mp1_out, c2_out, r2_out, mp2_out;
+    arma::vec d_out;
+  };
+  auto predict = [&](const arma::cube &input, Activations &a,
+                     arma::vec &output) {
+    c1.Predict(input, a.c1_out);
+    r1.Predict(a.c1_out, a.r1_out);
+    mp1.Predict(a.r1_out, a.mp1_out);
+    c2.Predict(a.mp1_out, a.c2_out);
+    r2.Predict(a.c2_out, a.r2_out);
+    mp2.Predict(a.r2_out, a.mp2_out);
+    d.Predict(a.mp2_out, a.d_out);
+    s.Predict(a.d_out, output);
+  };
 
   for (size_t epoch = 0; epoch < kEpochs; ++epoch) {
     std::cout << "*** Epoch " << epoch + 1 << "/" << kEpochs << ":"
               << std::endl;
+    train_data.Shuffle(rng);
+    loader.Start(train_data);
 
     for (size_t batch_idx = 0; batch_idx < kNumBatches; ++batch_idx) {
+      AFS_TRACE_SCOPE("Training batch");
+      Batch *batch = loader.Next();
       mini_batch_loss = 0.0;
       for (size_t i = 0; i < kBatchSize; ++i) {
         // Forward pass
-        c1.Forward(train_data[batch_idx * kBatchSize + i], c1_out);
+        c1.Forward(batch->inputs[i], c1_out);
         r1.Forward(c1_out, r1_out);
         mp1.Forward(r1_out, mp1_out);
         c2.Forward(mp1_out, c2_out);
@@ -108,8 +185,9 @@ int main(int argc, char **argv) {
         s.Forward(d_out, s_out);
 
         // Compute the loss
-        loss = l.Forward(s_out, train_labels[batch_idx * kBatchSize + i]);
+        loss = l.Forward(s_out, batch->targets[i]);
         mini_batch_loss += loss;
+        train_metrics.Add(s_out, batch->targets[i], loss);
 
         // Backward pass
         l.Backward();
@@ -137,94 +215,101 @@ int main(int argc, char **argv) {
       }
       epoch_loss += mini_batch_loss;
 
-      train_loss_history.push_back(mini_batch_loss / kBatchSize);
-      Visualizer::PlotGraph(train_loss_history, "Loss");
+      metrics.Push("train_loss", mini_batch_loss / kBatchSize,
+                   epoch * kNumBatches + batch_idx + 1);
+      metrics.PollPlots();
 
       std::cout << '\r' << "Batch " << batch_idx + 1 << "/" << kNumBatches
                 << " Batch loss: " << mini_batch_loss << std::flush;
 
       // Update params
-      d.UpdateWeightsAndBiases(kBatchSize, kLearningRate);
-      c1.UpdateFilterWeights(kBatchSize, kLearningRate);
-      c2.UpdateFilterWeights(kBatchSize, kLearningRate);
+      optimizer.Step(parameters, kBatchSize);
+
+      if (checkpointer.ShouldSave()) {
+        CheckpointWriter &snapshot = checkpointer.GetBuffer();
+        snapshot.Add(c1);
+        snapshot.Add(r1);
+        snapshot.Add(mp1);
+        snapshot.Add(c2);
+        snapshot.Add(r2);
+        snapshot.Add(mp2);
+        snapshot.Add(d);
+        snapshot.Add(s);
+        snapshot.SetOptimizerState(optimizer);
+        checkpointer.Submit("lenet_latest.afsm");
+      }
+
+      while (validator.Poll(validation)) report_validation(validation);
     }
 
     // Output loss on training dataset after each epoch
     std::cout << std::endl;
     std::cout << "Training loss: " << epoch_loss / (kBatchSize * kNumBatches)
               << std::endl;
+    std::cout << "Time spent waiting for data: " << loader.GetWaitSeconds()
+              << "s" << std::endl;
 
-    // Compute the training accuracy after epoch
-    double correct = 0.0;
-    for (size_t i = 0; i < kTrainDataSize; ++i) {
-      // Forward pass
-      c1.Forward(train_data[i], c1_out);
-      r1.Forward(c1_out, r1_out);
-      mp1.Forward(r1_out, mp1_out);
-      c2.Forward(mp1_out, c2_out);
-      r2.Forward(c2_out, r2_out);
-      mp2.Forward(r2_out, mp2_out);
-      d.Forward(mp2_out, d_out);
-      s.Forward(d_out, s_out);
-
-      if (train_labels[i].index_max() == s_out.index_max()) correct += 1.0;
-    }
-
-    // Output accuracy on training dataset after each epoch
-    std::cout << "Training accuracy: " << correct / kTrainDataSize << std::endl;
-
-    // Compute validation accuracy after epoch
-    epoch_loss = 0.0;
-    correct = 0.0;
-    for (size_t i = 0; i < kValidDataSize; ++i) {
-      // Forward pass
-      c1.Forward(validation_data[i], c1_out);
-      r1.Forward(c1_out, r1_out);
-      mp1.Forward(r1_out, mp1_out);
-      c2.Forward(mp1_out, c2_out);
-      r2.Forward(c2_out, r2_out);
-      mp2.Forward(r2_out, mp2_out);
-      d.Forward(mp2_out, d_out);
-      s.Forward(d_out, s_out);
-
-      epoch_loss += l.Forward(s_out, validation_labels[i]);
-
-      if (validation_labels[i].index_max() == s_out.index_max()) correct += 1.0;
-    }
-
-    // Output validation loss after each epoch
-    std::cout << "Validation loss: " << epoch_loss / (kBatchSize * kNumBatches)
+    // Output the running accuracy of the training forward passes
+    std::cout << "Training accuracy: " << train_metrics.Accuracy()
               << std::endl;
-
-    // Output validation accuracy after each epoch
-    std::cout << "Val accuracy: " << correct / kValidDataSize << std::endl;
+    metrics.Push("train_accuracy", train_metrics.Accuracy(),
+                 (epoch + 1) * kNumBatches);
+    train_metrics.Reset();
+
+    // Validate the weights of this epoch in the background
+    InferenceModel &snapshot = validator.GetBuffer();
+    snapshot.Add(c1);
+    snapshot.Add(r1);
+    snapshot.Add(mp1);
+    snapshot.Add(c2);
+    snapshot.Add(r2);
+    snapshot.Add(mp2);
+    snapshot.Add(d);
+    snapshot.Add(s);
+    validator.Submit(epoch + 1);
     std::cout << std::endl;
 
-    // Reset cumulative loss and correct count
+    // Reset cumulative loss
     epoch_loss = 0.0;
-    correct = 0.0;
 
     // Write results on test data to results csv
+    std::vector<size_t> test_labels(kTestDataSize);
+    #pragma omp parallel
+    {
+      Activations activations;
+      arma::cube sample;
+      arma::vec prediction;
+      #pragma omp for schedule(dynamic, 64)
+      for (size_t i = 0; i < kTestDataSize; ++i) {
+        test_data.GetSample(i, sample);
+        predict(sample, activations, prediction);
+        test_labels[i] = prediction.index_max();
+      }
+    }
     std::fstream fout("lenet_" + std::to_string(epoch) + ".csv",
                       std::ios::out);
     fout << "ImageId,Label" << std::endl;
     for (size_t i = 0; i < kTestDataSize; ++i) {
-      // Forward pass
-      c1.Forward(test_data[i], c1_out);
-      r1.Forward(c1_out, r1_out);
-      mp1.Forward(r1_out, mp1_out);
-      c2.Forward(mp1_out, c2_out);
-      r2.Forward(c2_out, r2_out);
-      mp2.Forward(r2_out, mp2_out);
-      d.Forward(mp2_out, d_out);
-      s.Forward(d_out, s_out);
-
-      fout << std::to_string(i + 1) << "," << std::to_string(s_out.index_max())
-            << std::endl;
+      fout << i + 1 << "," << test_labels[i] << "\n";
     }
     fout.close();
+
+    // Save the trained network
+    CheckpointWriter checkpoint;
+    checkpoint.Add(c1);
+    checkpoint.Add(r1);
+    checkpoint.Add(mp1);
+    checkpoint.Add(c2);
+    checkpoint.Add(r2);
+    checkpoint.Add(mp2);
+    checkpoint.Add(d);
+    checkpoint.Add(s);
+    checkpoint.Write("lenet_" + std::to_string(epoch) + ".afsm");
   }
 
-  cv::waitKey(0);
+  validator.Wait();
+  while (validator.Poll(validation)) report_validation(validation);
 
+  // Written only in builds with AFS_ENABLE_TRACING.
+  AFS_TRACE_WRITE("lenet_trace.json");
 }
@@ -1,5 +1,6 @@
 #include <armadillo>
 #include <cassert>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <vector>
@@ -12,8 +13,9 @@
 #include "layers/softmax.h"
 #include "layers/dropout.h"
 #include "losses/cross_entropy_loss.h"
-#include "utils/visualizer.h"
 #include "utils/data_transformer.h"
+#include "utils/metrics_sink.h"
+#include "utils/running_metrics.h"
 
 using namespace afs;
 using namespace std;
@@ -22,25 +24,18 @@ int main(int argc, char **argv) {
   // Load MNIST data
   MNISTData md("../data/MNIST");
 
-  std::vector<arma::cube> train_data = md.getTrainData();
-  std::vector<arma::vec> train_labels = md.getTrainLabels();
+  Dataset train_data = md.getTrainData();
+  const Dataset &validation_data = md.getValidationData();
+  const Dataset &test_data = md.getTestData();
 
-  std::vector<arma::cube> validation_data = md.getValidationData();
-  std::vector<arma::vec> validation_labels = md.getValidationLabels();
-
-  assert(train_data.size() == train_labels.size());
-  assert(validation_data.size() == validation_labels.size());
-
-  std::vector<arma::cube> test_data = md.getTestData();
-
-  std::cout << "Training data size: " << train_data.size() << std::endl;
-  std::cout << "Validation data size: " << validation_data.size() << std::endl;
-  std::cout << "Test data size: " << test_data.size() << std::endl;
+  std::cout << "Training data size: " << train_data.Size() << std::endl;
+  std::cout << "Validation data size: " << validation_data.Size() << std::endl;
+  std::cout << "Test data size: " << test_data.Size() << std::endl;
   std::cout << std::endl;
 
-  const size_t kTrainDataSize = train_data.size();
-  const size_t kValidDataSize = validation_data.size();
-  const size_t kTestDataSize = test_data.size();
+  const size_t kTrainDataSize = train_data.Size();
+  const size_t kValidDataSize = validation_data.Size();
+  const size_t kTestDataSize = test_data.Size();
   const double kLearningRate = 0.01;
   const size_t kEpochs = 10;
   const size_t kBatchSize = 16;
@@ -87,22 +82,64 @@ int main(int argc, char **argv) {
   arma::vec d_out = arma::zeros(10);
   arma::vec s_out = arma::zeros(10);
 
+  // The training samples are visited in a new order every epoch
+  std::mt19937_64 rng(0);
+
+  // Buffers the samples are read into
+  arma::cube input;
+  arma::vec target;
+
   // Initialize loss and cumulative loss. Cumulative loss totals loss over all
   // training examples in a minibatch.
   double loss;
   double epoch_loss = 0.0;
   double mini_batch_loss;
-  std::vector<double> train_loss_history;
+
+  // Metrics are written to lenet_dropout_metrics.csv on a background thread,
+  // and plotted when a display is available.
+  MetricsSink metrics;
+  MetricsSinkOptions metrics_options;
+  metrics_options.csv_path = "lenet_dropout_metrics.csv";
+  metrics_options.plot = std::getenv("DISPLAY") != nullptr;
+  if (!metrics.Start(metrics_options)) return 1;
+
+  // The training accuracy is collected from the forward passes of the
+  // training itself; only the validation set gets an extra pass.
+  RunningMetrics train_metrics(10);
+  RunningMetrics validation_metrics(10);
+
+  // Inference-only forward pass. It only reads the layers, so evaluation
+  // runs on all cores, each thread with its own activations.
+  struct Activations {
+    arma::cube c1_out, r1_out, mp1_out, c2_out, c2_dropout_out, r2_out, mp2_out;
+    arma::vec d_out;
+  };
+  auto predict = [&](const arma::cube &input, Activations &a,
+                     arma::vec &output) {
+    c1.Predict(input, a.c1_out);
+    r1.Predict(a.c1_out, a.r1_out);
+    mp1.Predict(a.r1_out, a.mp1_out);
+    c2.Predict(a.mp1_out, a.c2_out);
+    c2_dropout.Predict(a.c2_out, a.c2_dropout_out);
+    r2.Predict(a.c2_dropout_out, a.r2_out);
+    mp2.Predict(a.r2_out, a.mp2_out);
+    d.Predict(a.mp2_out, a.d_out);
+    s.Predict(a.d_out, output);
+  };
 
   for (size_t epoch = 0; epoch < kEpochs; ++epoch) {
     std::cout << "*** Epoch " << epoch + 1 << "/" << kEpochs << ":"
               << std::endl;
+    train_data.Shuffle(rng);
 
     for (size_t batch_idx = 0; batch_idx < kNumBatches; ++batch_idx) {
       mini_batch_loss = 0.0;
       for (size_t i = 0; i < kBatchSize; ++i) {
         // Forward pass
-        c1.Forward(train_data[batch_idx * kBatchSize + i], c1_out);
+        const size_t sample_idx = batch_idx * kBatchSize + i;
+        train_data.GetSample(sample_idx, input);
+        train_data.GetTarget(sample_idx, target);
+        c1.Forward(input, c1_out);
         r1.Forward(c1_out, r1_out);
         mp1.Forward(r1_out, mp1_out);
         c2.Forward(mp1_out, c2_out);
@@ -113,8 +150,9 @@ int main(int argc, char **argv) {
         s.Forward(d_out, s_out);
 
         // Compute the loss
-        loss = l.Forward(s_out, train_labels[batch_idx * kBatchSize + i]);
+        loss = l.Forward(s_out, target);
         mini_batch_loss += loss;
+        train_metrics.Add(s_out, target, loss);
 
         // Backward pass
         l.Backward();
@@ -143,8 +181,9 @@ int main(int argc, char **argv) {
       }
       epoch_loss += mini_batch_loss;
 
-      train_loss_history.push_back(mini_batch_loss / kBatchSize);
-      Visualizer::PlotGraph(train_loss_history, "Loss");
+      metrics.Push("train_loss", mini_batch_loss / kBatchSize,
+                   epoch * kNumBatches + batch_idx + 1);
+      metrics.PollPlots();
 
       std::cout << '\r' << "Batch " << batch_idx + 1 << "/" << kNumBatches
                 << " Batch loss: " << mini_batch_loss << std::flush;
@@ -160,80 +199,68 @@ int main(int argc, char **argv) {
     std::cout << "Training loss: " << epoch_loss / (kBatchSize * kNumBatches)
               << std::endl;
 
-    // Compute the training accuracy after epoch
-    double correct = 0.0;
-    for (size_t i = 0; i < kTrainDataSize; ++i) {
-      // Forward pass
-      c1.Forward(train_data[i], c1_out);
-      r1.Forward(c1_out, r1_out);
-      mp1.Forward(r1_out, mp1_out);
-      c2.Forward(mp1_out, c2_out);
-      c2_dropout.Forward(c2_out, c2_dropout_out, DropoutMode::kTest);
-      r2.Forward(c2_dropout_out, r2_out);
-      mp2.Forward(r2_out, mp2_out);
-      d.Forward(mp2_out, d_out);
-      s.Forward(d_out, s_out);
-
-      if (train_labels[i].index_max() == s_out.index_max()) correct += 1.0;
-    }
-
-    // Output accuracy on training dataset after each epoch
-    std::cout << "Training accuracy: " << correct / kTrainDataSize << std::endl;
-
-    // Compute validation accuracy after epoch
-    epoch_loss = 0.0;
-    correct = 0.0;
-    for (size_t i = 0; i < kValidDataSize; ++i) {
-      // Forward pass
-      c1.Forward(validation_data[i], c1_out);
-      r1.Forward(c1_out, r1_out);
-      mp1.Forward(r1_out, mp1_out);
-      c2.Forward(mp1_out, c2_out);
-      c2_dropout.Forward(c2_out, c2_dropout_out, DropoutMode::kTest);
-      r2.Forward(c2_dropout_out, r2_out);
-      mp2.Forward(r2_out, mp2_out);
-      d.Forward(mp2_out, d_out);
-      s.Forward(d_out, s_out);
-
-      epoch_loss += l.Forward(s_out, validation_labels[i]);
-
-      if (validation_labels[i].index_max() == s_out.index_max()) correct += 1.0;
+    // Output the running accuracy of the training forward passes, with
+    // dropout in training mode
+    std::cout << "Training accuracy: " << train_metrics.Accuracy()
+              << std::endl;
+    metrics.Push("train_accuracy", train_metrics.Accuracy(),
+                 (epoch + 1) * kNumBatches);
+    train_metrics.Reset();
+
+    // Compute validation loss and accuracy after epoch, without keeping
+    // activations for a backward pass
+    validation_metrics.Reset();
+    #pragma omp parallel
+    {
+      Activations activations;
+      arma::cube sample;
+      arma::vec sample_target, prediction;
+      RunningMetrics thread_metrics(10);
+      #pragma omp for schedule(dynamic, 64) nowait
+      for (size_t i = 0; i < kValidDataSize; ++i) {
+        validation_data.GetSample(i, sample);
+        validation_data.GetTarget(i, sample_target);
+        predict(sample, activations, prediction);
+        thread_metrics.Add(prediction, sample_target,
+                           l.Evaluate(prediction, sample_target));
+      }
+      #pragma omp critical
+      validation_metrics.Merge(thread_metrics);
     }
 
-    // Output validation loss after each epoch
-    std::cout << "Validation loss: " << epoch_loss / (kBatchSize * kNumBatches)
+    std::cout << "Validation loss: " << validation_metrics.MeanLoss()
               << std::endl;
-
-    // Output validation accuracy after each epoch
-    std::cout << "Val accuracy: " << correct / kValidDataSize << std::endl;
+    metrics.Push("val_loss", validation_metrics.MeanLoss(),
+                 (epoch + 1) * kNumBatches);
+    std::cout << "Val accuracy: " << validation_metrics.Accuracy()
+              << std::endl;
+    metrics.Push("val_accuracy", validation_metrics.Accuracy(),
+                 (epoch + 1) * kNumBatches);
     std::cout << std::endl;
 
-    // Reset cumulative loss and correct count
+    // Reset cumulative loss
     epoch_loss = 0.0;
-    correct = 0.0;
 
     // Write results on test data to results csv
+    std::vector<size_t> test_labels(kTestDataSize);
+    #pragma omp parallel
+    {
+      Activations activations;
+      arma::cube sample;
+      arma::vec prediction;
+      #pragma omp for schedule(dynamic, 64)
+      for (size_t i = 0; i < kTestDataSize; ++i) {
+        test_data.GetSample(i, sample);
+        predict(sample, activations, prediction);
+        test_labels[i] = prediction.index_max();
+      }
+    }
     std::fstream fout("lenet_" + std::to_string(epoch) + ".csv",
                       std::ios::out);
     fout << "ImageId,Label" << std::endl;
     for (size_t i = 0; i < kTestDataSize; ++i) {
-      // Forward pass
-      c1.Forward(test_data[i], c1_out);
-      r1.Forward(c1_out, r1_out);
-      mp1.Forward(r1_out, mp1_out);
-      c2.Forward(mp1_out, c2_out);
-      c2_dropout.Forward(c2_out, c2_dropout_out, DropoutMode::kTest);
-      r2.Forward(c2_dropout_out, r2_out);
-      mp2.Forward(r2_out, mp2_out);
-      d.Forward(mp2_out, d_out);
-      s.Forward(d_out, s_out);
-
-      fout << std::to_string(i + 1) << "," << std::to_string(s_out.index_max())
-            << std::endl;
+      fout << i + 1 << "," << test_labels[i] << "\n";
     }
     fout.close();
   }
-
-  cv::waitKey(0);
-
 }
@@ -1,18 +1,19 @@
+#include <algorithm>
 #include <armadillo>
 #include <cassert>
 #include <cmath>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
-#include <opencv2/opencv.hpp>
-#include <opencv2/plot.hpp>
 #include <vector>
 
 #include "datasets/wine_quality.h"
 #include "layers/dense.h"
 #include "layers/sigmoid.h"
 #include "losses/mse_loss.h"
-#include "utils/visualizer.h"
 #include "utils/data_transformer.h"
+#include "utils/metrics_sink.h"
+#include "utils/running_metrics.h"
 
 using namespace afs;
 using namespace std;
@@ -21,30 +22,23 @@ int main(int argc, char **argv) {
   // Load Wine quality data
   WineQualityData dataset("../data/WineQuality/winequality-red.csv", 0.8);
 
-  std::vector<arma::vec> train_data = dataset.getTrainData();
-  std::vector<arma::vec> train_labels = dataset.getTrainLabels();
+  Dataset train_data = dataset.getTrainData();
+  const Dataset &validation_data = dataset.getValidationData();
+  const Dataset &test_data = dataset.getTestData();
 
-  std::vector<arma::vec> validation_data = dataset.getValidationData();
-  std::vector<arma::vec> validation_labels = dataset.getValidationLabels();
-
-  assert(train_data.size() == train_labels.size());
-  assert(validation_data.size() == validation_labels.size());
-
-  std::vector<arma::vec> test_data = dataset.getTestData();
-
-  std::cout << "Training data size: " << train_data.size() << std::endl;
-  std::cout << "Validation data size: " << validation_data.size() << std::endl;
-  std::cout << "Test data size: " << test_data.size() << std::endl;
+  std::cout << "Training data size: " << train_data.Size() << std::endl;
+  std::cout << "Validation data size: " << validation_data.Size() << std::endl;
+  std::cout << "Test data size: " << test_data.Size() << std::endl;
   std::cout << std::endl;
 
-  const size_t kTrainDataSize = train_data.size();
-  const size_t kValidDataSize = validation_data.size();
+  const size_t kTrainDataSize = train_data.Size();
+  const size_t kValidDataSize = validation_data.Size();
   const double kLearningRate = 0.001;
   const size_t kEpochs = 16;
   const size_t kBatchSize = 32;
   const size_t kNumBatches = kTrainDataSize / kBatchSize;
 
-  Dense d1(train_data[0].n_rows, 16);
+  Dense d1(train_data.SampleSize(), 16);
   Sigmoid s1(16);
   Dense d2(16, 1);
 
@@ -56,32 +50,70 @@ int main(int argc, char **argv) {
   arma::vec s1_out;
   arma::vec d2_out;
 
+  // The training samples are visited in a new order every epoch
+  std::mt19937_64 rng(0);
+
+  // Buffers the samples are read into
+  arma::vec input;
+  arma::vec target;
+
   // Initialize loss and cumulative loss. Cumulative loss totals loss over all
   // training examples in a minibatch.
   double loss;
   double epoch_loss = 0.0;
   double mini_batch_loss;
 
-  std::vector<double> loss_history;
-  std::vector<double> val_loss_history;
+  // Metrics are written to wine_metrics.csv on a background thread, and
+  // plotted when a display is available.
+  MetricsSink metrics;
+  MetricsSinkOptions metrics_options;
+  metrics_options.csv_path = "wine_metrics.csv";
+  metrics_options.plot = std::getenv("DISPLAY") != nullptr;
+  if (!metrics.Start(metrics_options)) return 1;
+
+  // A prediction is correct when it rounds to the quality score. The
+  // training accuracy is collected from the forward passes of the training
+  // itself; only the validation set gets an extra pass.
+  auto quality = [](double value) {
+    return static_cast<size_t>(std::lround(std::max(0.0, value)));
+  };
+  RunningMetrics train_metrics;
+  RunningMetrics validation_metrics;
+
+  // Inference-only forward pass. It only reads the layers, so evaluation
+  // runs on all cores, each thread with its own activations.
+  struct Activations {
+    arma::vec d1_out, s1_out;
+  };
+  auto predict = [&](const arma::vec &input, Activations &a,
+                     arma::vec &output) {
+    d1.Predict(input, a.d1_out);
+    s1.Predict(a.d1_out, a.s1_out);
+    d2.Predict(a.s1_out, output);
+  };
 
   for (size_t epoch = 0; epoch < kEpochs; ++epoch) {
     epoch_loss = 0.0;
 
     std::cout << "*** Epoch " << epoch + 1 << "/" << kEpochs << ":"
               << std::endl;
+    train_data.Shuffle(rng);
 
     for (size_t batch_idx = 0; batch_idx < kNumBatches; ++batch_idx) {
       mini_batch_loss = 0.0;
       for (size_t i = 0; i < kBatchSize; ++i) {
         // Forward pass
-        d1.Forward(train_data[batch_idx * kBatchSize + i], d1_out);
+        const size_t sample_idx = batch_idx * kBatchSize + i;
+        train_data.GetSample(sample_idx, input);
+        train_data.GetTarget(sample_idx, target);
+        d1.Forward(input, d1_out);
         s1.Forward(d1_out, s1_out);
         d2.Forward(s1_out, d2_out);
 
         // Compute the loss
-        loss = l.Forward(d2_out, train_labels[batch_idx * kBatchSize + i]);
+        loss = l.Forward(d2_out, target);
         mini_batch_loss += loss;
+        train_metrics.Add(quality(d2_out[0]), quality(target[0]), loss);
 
         // Backward pass
         l.Backward();
@@ -95,8 +127,9 @@ int main(int argc, char **argv) {
         arma::vec d1_grad = d1.GetGradientWrtInput();
       }
       epoch_loss += mini_batch_loss;
-      loss_history.push_back(mini_batch_loss / kBatchSize);
-      Visualizer::PlotGraph(loss_history, "Loss");
+      metrics.Push("train_loss", mini_batch_loss / kBatchSize,
+                   epoch * kNumBatches + batch_idx + 1);
+      metrics.PollPlots();
 
       std::cout << '\r' << "Batch " << batch_idx + 1 << "/" << kNumBatches
                 << " Batch loss: " << mini_batch_loss << std::flush;
@@ -111,51 +144,41 @@ int main(int argc, char **argv) {
     std::cout << "Training loss: " << epoch_loss / (kBatchSize * kNumBatches)
               << std::endl;
 
-    // Compute the training accuracy after epoch
-    double correct = 0.0;
-    for (size_t i = 0; i < kTrainDataSize; ++i) {
-      // Forward pass
-      d1.Forward(train_data[i], d1_out);
-      s1.Forward(d1_out, s1_out);
-      d2.Forward(s1_out, d2_out);
-
-      if ((int)train_labels[i][0] == (int)(round(d2_out[0]))) {
-        correct += 1.0;
-      }
-    }
-
-    // Output accuracy on training dataset after each epoch
-    std::cout << "Training accuracy: " << correct / kTrainDataSize << std::endl;
-
-    // Compute validation accuracy after epoch
-    epoch_loss = 0.0;
-    correct = 0.0;
-    for (size_t i = 0; i < kValidDataSize; ++i) {
-      // Forward pass
-      d1.Forward(validation_data[i], d1_out);
-      s1.Forward(d1_out, s1_out);
-      d2.Forward(s1_out, d2_out);
-
-      // Compute the loss
-      loss = l.Forward(d2_out, validation_labels[i]);
-      epoch_loss += loss;
-
-      if ((int)train_labels[i][0] == (int)(round(d2_out[0]))) {
-        correct += 1.0;
+    // Output the running accuracy of the training forward passes
+    std::cout << "Training accuracy: " << train_metrics.Accuracy()
+              << std::endl;
+    metrics.Push("train_accuracy", train_metrics.Accuracy(),
+                 (epoch + 1) * kNumBatches);
+    train_metrics.Reset();
+
+    // Compute validation loss and accuracy after epoch, without keeping
+    // activations for a backward pass
+    validation_metrics.Reset();
+    #pragma omp parallel
+    {
+      Activations activations;
+      arma::vec sample, sample_target, prediction;
+      RunningMetrics thread_metrics;
+      #pragma omp for schedule(dynamic, 64) nowait
+      for (size_t i = 0; i < kValidDataSize; ++i) {
+        validation_data.GetSample(i, sample);
+        validation_data.GetTarget(i, sample_target);
+        predict(sample, activations, prediction);
+        thread_metrics.Add(quality(prediction[0]), quality(sample_target[0]),
+                           l.Evaluate(prediction, sample_target));
       }
+      #pragma omp critical
+      validation_metrics.Merge(thread_metrics);
     }
 
-    // Output validation loss after each epoch
-    double avg_loss_on_sample = epoch_loss / (kBatchSize * kNumBatches);
-    val_loss_history.push_back(avg_loss_on_sample);
-    Visualizer::PlotGraph(val_loss_history, "Val Loss");
-    std::cout << "Validation loss: " << avg_loss_on_sample
+    std::cout << "Validation loss: " << validation_metrics.MeanLoss()
               << std::endl;
-
-    // Output validation accuracy after each epoch
-    std::cout << "Val accuracy: " << correct / kValidDataSize << std::endl;
+    metrics.Push("val_loss", validation_metrics.MeanLoss(),
+                 (epoch + 1) * kNumBatches);
+    std::cout << "Val accuracy: " << validation_metrics.Accuracy()
+              << std::endl;
+    metrics.Push("val_accuracy", validation_metrics.Accuracy(),
+                 (epoch + 1) * kNumBatches);
     std::cout << std::endl;
   }
-
-  cv::waitKey(0);
 }
@@ -0,0 +1,111 @@
+#include <armadillo>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "layers/fixed/dense.h"
+#include "layers/fixed/sigmoid.h"
+#include "losses/fixed/mse_loss.h"
+
+using namespace afs;
+using namespace std;
+
+// Same network as xor_calculator.cc, built from the fixed-size layers: every
+// shape is known at compile time, so training does no heap allocation.
+int main(int argc, char **argv) {
+  std::vector<arma::vec::fixed<2>> train_data;
+  std::vector<arma::vec::fixed<1>> train_labels;
+
+  for (double i = 0; i <= 1; ++i) {
+    for (double j = 0; j <= 1; ++j) {
+      arma::vec::fixed<2> data({i, j});
+      arma::vec::fixed<1> label({(double)((int)i ^ (int)j)});
+      train_data.push_back(data);
+      train_labels.push_back(label);
+    }
+  }
+
+  const size_t kTrainDataSize = train_data.size();
+  const double kLearningRate = 1.0;
+  const size_t kEpochs = 5000;
+  const size_t kBatchSize = 1;
+  const size_t kNumBatches = kTrainDataSize / kBatchSize;
+
+  fixed::Dense<2, 4> d1;
+  fixed::Sigmoid<4> s1;
+  fixed::Dense<4, 1> d2;
+  fixed::Sigmoid<1> s2;
+
+  fixed::MSELoss<1> l;
+
+  // Intermediate outputs (Ie. outputs of hidden layers)
+  arma::vec::fixed<4> d1_out;
+  arma::vec::fixed<4> s1_out;
+  arma::vec::fixed<1> d2_out;
+  arma::vec::fixed<1> s2_out;
+
+  double epoch_loss = 0.0;
+  double mini_batch_loss;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t epoch = 0; epoch < kEpochs; ++epoch) {
+    for (size_t batch_idx = 0; batch_idx < kNumBatches; ++batch_idx) {
+      mini_batch_loss = 0.0;
+      for (size_t i = 0; i < kBatchSize; ++i) {
+        // Forward pass
+        d1.Forward(train_data[batch_idx * kBatchSize + i], d1_out);
+        s1.Forward(d1_out, s1_out);
+        d2.Forward(s1_out, d2_out);
+        s2.Forward(d2_out, s2_out);
+
+        // Compute the loss
+        mini_batch_loss +=
+            l.Forward(s2_out, train_labels[batch_idx * kBatchSize + i]);
+
+        // Backward pass
+        l.Backward();
+        s2.Backward(l.GetGradientWrtPredictedDistribution());
+        d2.Backward(s2.GetGradientWrtInput());
+        s1.Backward(d2.GetGradientWrtInput());
+        d1.Backward(s1.GetGradientWrtInput());
+      }
+      epoch_loss += mini_batch_loss;
+
+      // Update params
+      d1.UpdateWeightsAndBiases(kBatchSize, kLearningRate);
+      d2.UpdateWeightsAndBiases(kBatchSize, kLearningRate);
+    }
+
+    if ((epoch + 1) % 1000 == 0) {
+      std::cout << "*** Epoch " << epoch + 1 << "/" << kEpochs
+                << " Training loss: " << epoch_loss / (kBatchSize * kNumBatches)
+                << std::endl;
+    }
+    epoch_loss = 0.0;
+  }
+  std::chrono::duration<double, std::micro> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Training time per sample: "
+            << elapsed.count() / (kEpochs * kTrainDataSize) << " us"
+            << std::endl;
+
+  // Compute the training accuracy
+  double correct = 0.0;
+  for (size_t i = 0; i < kTrainDataSize; ++i) {
+    d1.Forward(train_data[i], d1_out);
+    s1.Forward(d1_out, s1_out);
+    d2.Forward(s1_out, d2_out);
+    s2.Forward(d2_out, s2_out);
+
+    cout << (int)train_data[i][0]
+          << " XOR " << (int)train_data[i][1]
+          << " = " << s2_out[0] << " ~ " << (int)train_labels[i][0]
+          << endl;
+
+    if ((int)train_labels[i][0] == (int)(s2_out[0] > 0.5)) {
+      correct += 1.0;
+    }
+  }
+  std::cout << "Training accuracy: " << correct / kTrainDataSize << std::endl;
+}
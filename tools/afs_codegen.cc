@@ -0,0 +1,306 @@
+// Ahead-of-time compiler for trained networks: turns a checkpoint into a
+// self-contained C++ header without any dependency besides the standard
+// library.
+//
+// Usage:
+//   ./afs_codegen <model.afsm> <output.h> [namespace]
+//
+// All shapes and loop bounds in the generated code are compile-time
+// constants and the parameters are `inline constexpr alignas(64)` arrays, so
+// the compiler can unroll and vectorize every layer, and a program including
+// the header from several files links a single copy of the weights (C++17).
+// Checkpoints with NaN or infinite parameters are rejected. The generated
+// header provides:
+//   namespace <namespace> {
+//   constexpr int kInputSize, kOutputSize;
+//   void Predict(const double *input, double *output);
+//   }
+// `input` is the input cube in column-major (armadillo) order. Predict() is
+// reentrant; intermediate activations live on the stack.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "io/checkpoint.h"
+
+using namespace afs;
+
+// Kernels shared by all generated models, templated on the layer shapes.
+const char *kKernels = R"(namespace detail {
+
+template <int H, int W, int D, int FH, int FW, int HS, int VS, int NF>
+inline void Conv2D(const double *in, const double *filters, double *out) {
+  constexpr int OH = (H - FH) / VS + 1;
+  constexpr int OW = (W - FW) / HS + 1;
+  for (int f = 0; f < NF; ++f) {
+    const double *filter = filters + f * FH * FW * D;
+    for (int oc = 0; oc < OW; ++oc) {
+      for (int orow = 0; orow < OH; ++orow) {
+        double sum = 0.0;
+        for (int s = 0; s < D; ++s) {
+          for (int c = 0; c < FW; ++c) {
+            const double *in_col = in + (oc * HS + c) * H + s * H * W + orow * VS;
+            const double *f_col = filter + c * FH + s * FH * FW;
+            for (int r = 0; r < FH; ++r) sum += in_col[r] * f_col[r];
+          }
+        }
+        out[orow + oc * OH + f * OH * OW] = sum;
+      }
+    }
+  }
+}
+
+template <int H, int W, int D, int PH, int PW, int VS, int HS>
+inline void MaxPooling(const double *in, double *out) {
+  constexpr int OH = (H - PH) / VS + 1;
+  constexpr int OW = (W - PW) / HS + 1;
+  for (int s = 0; s < D; ++s) {
+    for (int oc = 0; oc < OW; ++oc) {
+      for (int orow = 0; orow < OH; ++orow) {
+        const double *window = in + s * H * W + oc * HS * H + orow * VS;
+        double max = window[0];
+        for (int c = 0; c < PW; ++c) {
+          for (int r = 0; r < PH; ++r) max = std::max(max, window[c * H + r]);
+        }
+        out[orow + oc * OH + s * OH * OW] = max;
+      }
+    }
+  }
+}
+
+template <int N>
+inline void ReLU(const double *in, double *out) {
+  for (int i = 0; i < N; ++i) out[i] = in[i] > 0.0 ? in[i] : 0.0;
+}
+
+template <int IN, int OUT>
+inline void Dense(const double *in, const double *weights,
+                  const double *biases, double *out) {
+  for (int o = 0; o < OUT; ++o) out[o] = biases[o];
+  // The weights are stored column-major: one column per input.
+  for (int i = 0; i < IN; ++i) {
+    const double x = in[i];
+    for (int o = 0; o < OUT; ++o) out[o] += weights[i * OUT + o] * x;
+  }
+}
+
+template <int N>
+inline void Sigmoid(const double *in, double *out) {
+  for (int i = 0; i < N; ++i) out[i] = 1.0 / (1.0 + std::exp(-in[i]));
+}
+
+template <int N>
+inline void Softmax(const double *in, double *out) {
+  double max = in[0];
+  for (int i = 1; i < N; ++i) max = std::max(max, in[i]);
+  double sum = 0.0;
+  for (int i = 0; i < N; ++i) {
+    out[i] = std::exp(in[i] - max);
+    sum += out[i];
+  }
+  for (int i = 0; i < N; ++i) out[i] /= sum;
+}
+
+template <int N>
+inline void Copy(const double *in, double *out) {
+  for (int i = 0; i < N; ++i) out[i] = in[i];
+}
+
+}  // namespace detail
+)";
+
+// Returns false if a value has no C++ literal, i.e. is NaN or infinite.
+bool WriteArray(std::ostream &out, const std::string &name,
+                const double *values, size_t count) {
+  out << "alignas(64) inline constexpr double " << name << "[" << count
+      << "] = {";
+  char buffer[32];
+  for (size_t i = 0; i < count; ++i) {
+    if (!std::isfinite(values[i])) {
+      std::cerr << "Non-finite value " << values[i] << " at index " << i
+                << " of " << name << std::endl;
+      return false;
+    }
+    if (i % 4 == 0) out << "\n   ";
+    std::snprintf(buffer, sizeof(buffer), " %.17g,", values[i]);
+    out << buffer;
+  }
+  out << "\n};\n\n";
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " <model.afsm> <output.h> [namespace]" << std::endl;
+    return 1;
+  }
+  const std::string model_path = argv[1];
+  const std::string output_path = argv[2];
+  const std::string name_space = argc > 3 ? argv[3] : "afs_model";
+
+  Checkpoint checkpoint;
+  if (!checkpoint.Load(model_path)) return 1;
+
+  std::ostringstream params;  // Parameter arrays
+  std::ostringstream calls;   // Body of Predict()
+
+  // Shape of the current activation, and size of the largest one.
+  size_t height = 0, width = 0, depth = 0;
+  size_t input_size = 0;
+  size_t max_size = 0;
+  // Activations alternate between two stack buffers; the first layer reads
+  // `input` directly.
+  std::string src = "input";
+  int dst_buffer = 0;
+
+  // Check that a layer takes the output of the previous one, as
+  // InferenceModel::Load() does, since the generated code does not check
+  // any bounds. Layers on 3D data after one on 3D data need the same shape,
+  // other layers the same number of values.
+  bool is_cube = false;
+  auto takes_input = [&](size_t i, size_t h, size_t w, size_t d, bool cube) {
+    const bool match = input_size == 0 ||
+                       (cube && is_cube
+                            ? h == height && w == width && d == depth
+                            : h * w * d == height * width * depth);
+    if (!match) {
+      std::cerr << "Layer " << i << " of " << model_path
+                << " does not take the output of the previous layer"
+                << std::endl;
+    }
+    is_cube = cube;
+    return match;
+  };
+
+  for (size_t i = 0; i < checkpoint.NumLayers(); ++i) {
+    const LayerRecord &record = checkpoint.GetLayer(i);
+    const uint64_t *shape = record.shape;
+    const std::string dst = "buffer" + std::to_string(dst_buffer);
+    const std::string prefix = "kLayer" + std::to_string(i);
+    size_t in_size = 0;
+
+    switch (checkpoint.GetLayerType(i)) {
+      case LayerType::kConv2D:
+        if (!takes_input(i, shape[0], shape[1], shape[2], true)) return 1;
+        in_size = shape[0] * shape[1] * shape[2];
+        if (!WriteArray(params, prefix + "Filters", checkpoint.GetBlob(i, 0),
+                        record.blobs[0].count)) {
+          return 1;
+        }
+        calls << "  detail::Conv2D<" << shape[0] << ", " << shape[1] << ", "
+              << shape[2] << ", " << shape[3] << ", " << shape[4] << ", "
+              << shape[5] << ", " << shape[6] << ", " << shape[7] << ">("
+              << src << ", " << prefix << "Filters, " << dst << ");\n";
+        height = (shape[0] - shape[3]) / shape[6] + 1;
+        width = (shape[1] - shape[4]) / shape[5] + 1;
+        depth = shape[7];
+        break;
+      case LayerType::kMaxPooling:
+        if (!takes_input(i, shape[0], shape[1], shape[2], true)) return 1;
+        in_size = shape[0] * shape[1] * shape[2];
+        calls << "  detail::MaxPooling<" << shape[0] << ", " << shape[1]
+              << ", " << shape[2] << ", " << shape[3] << ", " << shape[4]
+              << ", " << shape[5] << ", " << shape[6] << ">(" << src << ", "
+              << dst << ");\n";
+        height = (shape[0] - shape[3]) / shape[5] + 1;
+        width = (shape[1] - shape[4]) / shape[6] + 1;
+        depth = shape[2];
+        break;
+      case LayerType::kReLU:
+        if (!takes_input(i, shape[0], shape[1], shape[2], true)) return 1;
+        in_size = shape[0] * shape[1] * shape[2];
+        calls << "  detail::ReLU<" << in_size << ">(" << src << ", " << dst
+              << ");\n";
+        height = shape[0];
+        width = shape[1];
+        depth = shape[2];
+        break;
+      case LayerType::kDense:
+        if (!takes_input(i, shape[0], 1, 1, false)) return 1;
+        in_size = shape[0];
+        if (!WriteArray(params, prefix + "Weights", checkpoint.GetBlob(i, 0),
+                        record.blobs[0].count) ||
+            !WriteArray(params, prefix + "Biases", checkpoint.GetBlob(i, 1),
+                        record.blobs[1].count)) {
+          return 1;
+        }
+        calls << "  detail::Dense<" << shape[0] << ", " << shape[1] << ">("
+              << src << ", " << prefix << "Weights, " << prefix << "Biases, "
+              << dst << ");\n";
+        height = shape[1];
+        width = depth = 1;
+        break;
+      case LayerType::kSigmoid:
+      case LayerType::kSoftmax:
+        if (!takes_input(i, shape[0], 1, 1, false)) return 1;
+        in_size = shape[0];
+        calls << "  detail::"
+              << (checkpoint.GetLayerType(i) == LayerType::kSigmoid
+                      ? "Sigmoid<"
+                      : "Softmax<")
+              << in_size << ">(" << src << ", " << dst << ");\n";
+        height = shape[0];
+        width = depth = 1;
+        break;
+      case LayerType::kDropout:
+        // Identity at inference time.
+        continue;
+      default:
+        std::cerr << "Unsupported layer type " << record.type << std::endl;
+        return 1;
+    }
+
+    if (input_size == 0) input_size = in_size;
+    max_size = std::max(max_size, height * width * depth);
+    src = dst;
+    dst_buffer = 1 - dst_buffer;
+  }
+
+  if (input_size == 0) {
+    std::cerr << "No layers to generate in " << model_path << std::endl;
+    return 1;
+  }
+  const size_t output_size = height * width * depth;
+
+  std::string guard = name_space;
+  std::transform(guard.begin(), guard.end(), guard.begin(), ::toupper);
+  guard += "_H_";
+
+  std::ofstream out(output_path);
+  if (!out) {
+    std::cerr << "Error opening file: " << output_path << std::endl;
+    return 1;
+  }
+  out << "// Generated by afs_codegen from " << model_path
+      << ". Do not edit.\n\n"
+      << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+      << "#include <algorithm>\n#include <cmath>\n\n"
+      << "namespace " << name_space << " {\n\n"
+      << kKernels << "\n"
+      << "constexpr int kInputSize = " << input_size << ";\n"
+      << "constexpr int kOutputSize = " << output_size << ";\n\n"
+      << params.str()
+      << "inline void Predict(const double *input, double *output) {\n"
+      << "  alignas(64) double buffer0[" << max_size << "];\n"
+      << "  alignas(64) double buffer1[" << max_size << "];\n"
+      << calls.str()
+      << "  detail::Copy<kOutputSize>(" << src << ", output);\n"
+      << "}\n\n"
+      << "}  // namespace " << name_space << "\n\n"
+      << "#endif\n";
+  out.close();
+  if (!out) {
+    std::cerr << "Error writing file: " << output_path << std::endl;
+    return 1;
+  }
+
+  std::cout << "Generated " << output_path << ": input " << input_size
+            << ", output " << output_size << std::endl;
+  return 0;
+}
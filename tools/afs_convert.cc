@@ -0,0 +1,123 @@
+// Converts a dataset into sharded *.afsrec record files, to be streamed with
+// RecordStream.
+//
+// Usage:
+//   ./afs_convert <mnist|wine|cifar10> <input> <output_prefix>
+//                 [records_per_shard] [train|test]
+//
+// <input> is the data folder for MNIST and CIFAR-10, and the CSV file for
+// wine quality. Shards are written as
+// <output_prefix>-<index>-of-<count>.afsrec. The samples keep their raw
+// uint8 or float32 values; the normalization of the dataset is recorded in
+// the shard header and applied when reading.
+
+#include <armadillo>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "datasets/cifar10_data.h"
+#include "datasets/dataset.h"
+#include "datasets/mnist.h"
+#include "datasets/wine_quality.h"
+#include "io/record_file.h"
+
+using namespace afs;
+
+RecordSchema MakeSchema(const Dataset &dataset) {
+  RecordSchema schema;
+  schema.data_type = dataset.GetDataType() == Dataset::DataType::kUInt8
+                         ? RecordDataType::kUInt8
+                         : RecordDataType::kFloat32;
+  schema.rows = dataset.Rows();
+  schema.cols = dataset.Cols();
+  schema.channels = dataset.Channels();
+  if (dataset.HasTargets()) {
+    schema.num_classes = dataset.NumClasses();
+    schema.target_size = dataset.TargetSize();
+  }
+  schema.scale = dataset.GetScale();
+  schema.offset = dataset.GetOffset();
+  schema.l2_normalize = dataset.GetL2Normalize();
+  return schema;
+}
+
+bool WriteShards(const Dataset &dataset, const std::string &prefix,
+                 size_t records_per_shard) {
+  const RecordSchema schema = MakeSchema(dataset);
+  const size_t num_shards =
+      (dataset.Size() + records_per_shard - 1) / records_per_shard;
+
+  std::vector<uint8_t> record(schema.TargetBytes() + schema.SampleBytes());
+  uint8_t *sample = record.data() + schema.TargetBytes();
+  arma::vec target;
+  RecordWriter writer;
+  for (size_t shard = 0; shard < num_shards; ++shard) {
+    const std::string path = RecordReader::ShardName(prefix, shard, num_shards);
+    if (!writer.Open(path, schema)) return false;
+
+    const size_t first = shard * records_per_shard;
+    const size_t last = std::min(first + records_per_shard, dataset.Size());
+    for (size_t i = first; i < last; ++i) {
+      if (schema.num_classes > 0) {
+        record[0] = dataset.GetLabel(i);
+      } else if (schema.target_size > 0) {
+        dataset.GetTarget(i, target);
+        for (size_t j = 0; j < schema.target_size; ++j) {
+          float value = target(j);
+          std::memcpy(record.data() + j * sizeof(float), &value,
+                      sizeof(float));
+        }
+      }
+      if (schema.data_type == RecordDataType::kUInt8) {
+        std::memcpy(sample, dataset.GetRawUInt8(i), schema.SampleBytes());
+      } else {
+        std::memcpy(sample, dataset.GetRawFloat(i), schema.SampleBytes());
+      }
+      if (!writer.Append(record.data(), record.size())) return false;
+    }
+
+    if (!writer.Close()) return false;
+    std::cout << path << ": " << last - first << " records" << std::endl;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0]
+              << " <mnist|wine|cifar10> <input> <output_prefix>"
+                 " [records_per_shard] [train|test]"
+              << std::endl;
+    return 1;
+  }
+  const std::string format = argv[1];
+  const std::string input = argv[2];
+  const std::string prefix = argv[3];
+  const size_t records_per_shard = argc > 4 ? std::stoul(argv[4]) : 10000;
+  const bool test = argc > 5 && std::string(argv[5]) == "test";
+  if (records_per_shard == 0) {
+    std::cerr << "records_per_shard must be positive" << std::endl;
+    return 1;
+  }
+
+  // All samples of the split, in a shuffled order (split ratio 1).
+  Dataset dataset;
+  if (format == "mnist") {
+    MNISTData mnist(input, 1.0);
+    dataset = test ? mnist.getTestData() : mnist.getTrainData();
+  } else if (format == "wine") {
+    WineQualityData wine(input, 1.0);
+    dataset = wine.getTrainData();
+  } else if (format == "cifar10") {
+    CIFAR10Data cifar(input, 1.0);
+    dataset = test ? cifar.getTestData() : cifar.getTrainData();
+  } else {
+    std::cerr << "Unknown dataset format: " << format << std::endl;
+    return 1;
+  }
+
+  return WriteShards(dataset, prefix, records_per_shard) ? 0 : 1;
+}
@@ -0,0 +1,356 @@
+// Batch prediction: runs a checkpoint over a large input file and writes one
+// line per sample, in input order.
+//
+// Usage:
+//   ./afs_predict <model.afsm> <input> <output.csv> [chunk_size] [scale]
+//                 [offset]
+//
+// <input> is one of
+//   - a CSV file (*.csv) of numeric values, one sample per row, with an
+//     optional header. Rows with one more field than the model input start
+//     with a label or id, which is skipped.
+//   - an image archive (*.afsimg)
+//   - the prefix of *.afsrec shards written by afs_convert. A shard that
+//     cannot be read stops the run with an error.
+//   - an IDX file of unsigned bytes, e.g. t10k-images-idx3-ubyte
+// Samples are stored channel by channel, each channel row by row, as in the
+// datasets. Shards are normalized as recorded in their header; the other
+// inputs as value * scale + offset, by default with scale 1/255 for the
+// image formats and 1 for CSV.
+//
+// The output starts with a header line, followed by "<id>,<label>" for each
+// sample, ids starting at 1, or "<id>,<value>" for a model with a single
+// output.
+//
+// Samples are read `chunk_size` at a time (default 4096) on a background
+// thread while the previous chunk is predicted on all cores. The lines of a
+// chunk are formatted into one buffer and written with a single fwrite.
+
+#include <algorithm>
+#include <armadillo>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "datasets/data_loader.h"
+#include "datasets/idx_file.h"
+#include "datasets/image_archive.h"
+#include "datasets/record_stream.h"
+#include "inference/inference_model.h"
+#include "io/csv_parser.h"
+#include "io/record_file.h"
+
+using namespace afs;
+
+// Size of the stdio buffer of the output file.
+const size_t kOutputBufferSize = 1 << 24;
+
+bool EndsWith(const std::string &text, const std::string &suffix) {
+  return text.size() >= suffix.size() &&
+         text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Convert a sample stored as [depth][height][width] into a cube of the
+// model input shape.
+template <typename T>
+void ToCube(const T *raw, const InferenceModel &model, double scale,
+            double offset, arma::cube &out) {
+  const size_t height = model.GetInputHeight();
+  const size_t width = model.GetInputWidth();
+  const size_t depth = model.GetInputDepth();
+  out.set_size(height, width, depth);
+  double *values = out.memptr();
+  for (size_t s = 0; s < depth; ++s)
+    for (size_t r = 0; r < height; ++r)
+      for (size_t c = 0; c < width; ++c)
+        values[(s * width + c) * height + r] =
+            raw[(s * height + r) * width + c] * scale + offset;
+}
+
+// Samples of an input file, read in order a chunk at a time.
+class InputSource {
+ public:
+  virtual ~InputSource() {}
+
+  // Read the next `max_samples` samples at most into `inputs`, resized to
+  // the number read: 0 at the end of the input. The cubes already in
+  // `inputs` are reused. Returns false on errors.
+  virtual bool Read(size_t max_samples, std::vector<arma::cube> &inputs) = 0;
+};
+
+// Memory-mapped uint8 samples of an IDX file or an image archive.
+class PixelSource : public InputSource {
+ public:
+  PixelSource(const InferenceModel &model, double scale, double offset)
+      : model(model), scale(scale), offset(offset) {}
+
+  bool OpenIdx(const std::string &path) {
+    if (!idx.Open(path)) return false;
+    num_samples = idx.NumDims() > 0 ? idx.Dim(0) : 0;
+    sample_size = 1;
+    for (size_t i = 1; i < idx.NumDims(); ++i) sample_size *= idx.Dim(i);
+    pixels = idx.Data();
+    return CheckSampleSize(path);
+  }
+
+  bool OpenArchive(const std::string &path) {
+    if (!archive.Open(path)) return false;
+    num_samples = archive.NumSamples();
+    sample_size = archive.SampleSize();
+    pixels = archive.GetPixels(0);
+    return CheckSampleSize(path);
+  }
+
+  bool Read(size_t max_samples, std::vector<arma::cube> &inputs) override {
+    const size_t count = std::min(max_samples, num_samples - next);
+    inputs.resize(count);
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < count; ++i) {
+      ToCube(pixels + (next + i) * sample_size, model, scale, offset,
+             inputs[i]);
+    }
+    next += count;
+    return true;
+  }
+
+ private:
+  bool CheckSampleSize(const std::string &path) {
+    if (sample_size == model.GetInputSize()) return true;
+    std::cerr << "Samples of " << path << " have " << sample_size
+              << " values, the model expects " << model.GetInputSize()
+              << std::endl;
+    return false;
+  }
+
+  const InferenceModel &model;
+  double scale;
+  double offset;
+  IdxFile idx;
+  ImageArchive archive;
+  const uint8_t *pixels = nullptr;
+  size_t num_samples = 0;
+  size_t sample_size = 0;
+  size_t next = 0;
+};
+
+// Rows of a CSV file, parsed a chunk at a time.
+class CsvSource : public InputSource {
+ public:
+  CsvSource(const InferenceModel &model, double scale, double offset)
+      : model(model), scale(scale), offset(offset) {}
+
+  bool Open(const std::string &path) {
+    this->path = path;
+    return reader.Open(path);
+  }
+
+  bool Read(size_t max_samples, std::vector<arma::cube> &inputs) override {
+    size_t count;
+    if (!reader.ReadRows(max_samples, values, count)) return false;
+    inputs.resize(count);
+    if (count == 0) return true;
+
+    const size_t num_cols = reader.NumCols();
+    const size_t skip = num_cols - model.GetInputSize();
+    if (num_cols < model.GetInputSize() || skip > 1) {
+      std::cerr << "Rows of " << path << " have " << num_cols
+                << " fields, the model expects " << model.GetInputSize()
+                << std::endl;
+      return false;
+    }
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < count; ++i) {
+      ToCube(values.data() + i * num_cols + skip, model, scale, offset,
+             inputs[i]);
+    }
+    return true;
+  }
+
+ private:
+  const InferenceModel &model;
+  double scale;
+  double offset;
+  std::string path;
+  CsvReader reader;
+  std::vector<float> values;
+};
+
+// Samples of *.afsrec shards, in storage order.
+class RecordSource : public InputSource {
+ public:
+  RecordSource(const InferenceModel &model,
+               const std::vector<std::string> &shards)
+      : model(model), stream(shards, 0, 0, true) {}
+
+  bool Read(size_t max_samples, std::vector<arma::cube> &inputs) override {
+    const size_t count = stream.NextBatch(batch, max_samples);
+    // Output lines are numbered by position, so a skipped shard would shift
+    // every later id.
+    if (stream.Failed()) return false;
+    if (count > 0 && stream.GetSchema().SampleSize() != model.GetInputSize()) {
+      std::cerr << "Samples of the shards have "
+                << stream.GetSchema().SampleSize()
+                << " values, the model expects " << model.GetInputSize()
+                << std::endl;
+      return false;
+    }
+    // The shards decode into rows x cols x channels cubes, the layout of
+    // the model input.
+    inputs.resize(count);
+    for (size_t i = 0; i < count; ++i) std::swap(inputs[i], batch.inputs[i]);
+    return true;
+  }
+
+ private:
+  const InferenceModel &model;
+  RecordStream stream;
+  Batch batch;
+};
+
+// Appends the lines of the predictions to a buffer, written to the output
+// file once per chunk.
+class OutputWriter {
+ public:
+  ~OutputWriter() { Close(); }
+
+  bool Open(const std::string &path, bool values) {
+    this->path = path;
+    this->values = values;
+    file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+      std::cerr << "Error opening file: " << path << std::endl;
+      return false;
+    }
+    std::setvbuf(file, nullptr, _IOFBF, kOutputBufferSize);
+    return Write(values ? "Id,Value\n" : "Id,Label\n");
+  }
+
+  bool WriteChunk(const std::vector<arma::vec> &outputs) {
+    text.clear();
+    char number[64];
+    for (const arma::vec &output : outputs) {
+      ++num_lines;
+      char *end = std::to_chars(number, number + sizeof(number), num_lines).ptr;
+      *end++ = ',';
+      if (values) {
+        end += std::snprintf(end, number + sizeof(number) - end, "%.9g",
+                             output(0));
+      } else {
+        end = std::to_chars(end, number + sizeof(number),
+                            (size_t)output.index_max())
+                  .ptr;
+      }
+      *end++ = '\n';
+      text.append(number, end);
+    }
+    return Write(text);
+  }
+
+  bool Close() {
+    if (file == nullptr) return true;
+    const bool ok = std::fclose(file) == 0;
+    file = nullptr;
+    if (!ok) std::cerr << "Error writing file: " << path << std::endl;
+    return ok;
+  }
+
+ private:
+  bool Write(const std::string &data) {
+    if (std::fwrite(data.data(), 1, data.size(), file) == data.size()) {
+      return true;
+    }
+    std::cerr << "Error writing file: " << path << std::endl;
+    return false;
+  }
+
+  std::string path;
+  std::FILE *file = nullptr;
+  bool values = false;
+  size_t num_lines = 0;
+  std::string text;
+};
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0]
+              << " <model.afsm> <input> <output.csv> [chunk_size] [scale]"
+                 " [offset]"
+              << std::endl;
+    return 1;
+  }
+  const std::string model_path = argv[1];
+  const std::string input_path = argv[2];
+  const std::string output_path = argv[3];
+  const size_t chunk_size = argc > 4 ? std::stoul(argv[4]) : 4096;
+  const bool csv = EndsWith(input_path, ".csv");
+  const double scale = argc > 5 ? std::stod(argv[5]) : csv ? 1.0 : 1.0 / 255;
+  const double offset = argc > 6 ? std::stod(argv[6]) : 0.0;
+  if (chunk_size == 0) {
+    std::cerr << "chunk_size must be positive" << std::endl;
+    return 1;
+  }
+
+  InferenceModel model;
+  if (!model.Load(model_path)) return 1;
+
+  std::unique_ptr<InputSource> source;
+  if (csv) {
+    CsvSource *csv_source = new CsvSource(model, scale, offset);
+    source.reset(csv_source);
+    if (!csv_source->Open(input_path)) return 1;
+  } else if (EndsWith(input_path, ".afsimg")) {
+    PixelSource *pixel_source = new PixelSource(model, scale, offset);
+    source.reset(pixel_source);
+    if (!pixel_source->OpenArchive(input_path)) return 1;
+  } else {
+    const std::vector<std::string> shards =
+        RecordReader::ListShards(input_path);
+    if (!shards.empty()) {
+      source.reset(new RecordSource(model, shards));
+    } else {
+      PixelSource *pixel_source = new PixelSource(model, scale, offset);
+      source.reset(pixel_source);
+      if (!pixel_source->OpenIdx(input_path)) return 1;
+    }
+  }
+
+  OutputWriter writer;
+  if (!writer.Open(output_path, model.GetOutputSize() == 1)) return 1;
+
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  // The next chunk is read while the current one is predicted.
+  std::vector<arma::cube> chunks[2];
+  std::vector<arma::vec> outputs;
+  int current = 0;
+  bool ok = source->Read(chunk_size, chunks[current]);
+  size_t num_samples = 0;
+  while (ok && !chunks[current].empty()) {
+    std::future<bool> next =
+        std::async(std::launch::async, [&source, &chunks, chunk_size,
+                                        current] {
+          return source->Read(chunk_size, chunks[1 - current]);
+        });
+    model.PredictBatch(chunks[current], outputs);
+    num_samples += outputs.size();
+    ok = writer.WriteChunk(outputs);
+    ok = next.get() && ok;
+    current = 1 - current;
+  }
+  ok = writer.Close() && ok;
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Predicted " << num_samples << " samples in "
+            << elapsed.count() << "s ("
+            << num_samples / std::max(elapsed.count(), 1e-9)
+            << " samples/s)" << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+// Inference server: loads a checkpoint and serves predictions over a Unix
+// domain socket, batching concurrent requests.
+//
+// Usage:
+//   ./afs_server <model.afsm> [socket_path] [max_batch_size] [max_wait_us]
+//                [cache_mb]
+//
+// With cache_mb > 0, outputs are memoized in an LRU cache of that size keyed
+// by a hash of the input. At most 256 connections are served at once; more
+// clients wait to be accepted until one closes.
+//
+// Protocol, one request after another on a connection, native byte order:
+//   request:  uint32 n, followed by n float64 input values
+//             (the input cube in column-major order)
+//   response: uint32 m, followed by m float64 output values
+//             (m = 0 if the request had the wrong size, after which the
+//             server closes the connection without reading its values)
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <armadillo>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "inference/dynamic_batcher.h"
+#include "inference/inference_cache.h"
+#include "inference/inference_model.h"
+
+using namespace afs;
+
+// Each connection is served by its own thread. Beyond this many, new clients
+// wait in the listen backlog until a connection closes.
+const size_t kMaxConnections = 256;
+
+// Counts the open connections, to bound the number of serving threads.
+class ConnectionLimit {
+ public:
+  explicit ConnectionLimit(size_t max_connections)
+      : max_connections(max_connections) {}
+
+  // Block until a connection may be opened.
+  void Acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return active < max_connections; });
+    ++active;
+  }
+
+  void Release() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      --active;
+    }
+    condition.notify_one();
+  }
+
+ private:
+  size_t max_connections;
+  std::mutex mutex;
+  std::condition_variable condition;
+  size_t active = 0;
+};
+
+bool ReadAll(int fd, void *data, size_t size) {
+  char *ptr = static_cast<char *>(data);
+  while (size > 0) {
+    ssize_t n = read(fd, ptr, size);
+    if (n <= 0) return false;
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const void *data, size_t size) {
+  const char *ptr = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t n = write(fd, ptr, size);
+    if (n <= 0) return false;
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+void ServeConnection(int fd, DynamicBatcher &batcher,
+                     const InferenceModel &model, ConnectionLimit &limit) {
+  const size_t input_size = model.GetInputSize();
+  std::vector<double> values(input_size);
+  while (true) {
+    uint32_t n;
+    if (!ReadAll(fd, &n, sizeof(n))) break;
+    // Check the size before reading the payload: the count comes from the
+    // client and must not decide how much memory the server allocates.
+    if (n != input_size) {
+      uint32_t zero = 0;
+      WriteAll(fd, &zero, sizeof(zero));
+      break;
+    }
+    if (!ReadAll(fd, values.data(), n * sizeof(double))) break;
+
+    arma::cube input(values.data(), model.GetInputHeight(),
+                     model.GetInputWidth(), model.GetInputDepth());
+    arma::vec output = batcher.Submit(std::move(input)).get();
+
+    uint32_t m = output.n_elem;
+    if (!WriteAll(fd, &m, sizeof(m)) ||
+        !WriteAll(fd, output.memptr(), m * sizeof(double))) {
+      break;
+    }
+  }
+  close(fd);
+  limit.Release();
+}
+
+void ReportStats(DynamicBatcher &batcher, InferenceCache *cache) {
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::seconds(10));
+    // Reset in the same step, so that no request falls between two reports.
+    LatencySummary summary = batcher.GetLatency().SummarizeAndReset();
+    if (summary.count == 0) continue;
+    std::cout << "Requests: " << summary.count
+              << " Throughput: " << summary.throughput << " req/s"
+              << " p50: " << summary.p50_us << " us"
+              << " p99: " << summary.p99_us << " us"
+              << " Avg batch size: " << batcher.GetAverageBatchSize()
+              << std::endl;
+    if (cache != nullptr) {
+      std::cout << "Cache hits: " << cache->GetHits()
+                << " misses: " << cache->GetMisses()
+                << " evictions: " << cache->GetEvictions()
+                << " entries: " << cache->Size()
+                << " memory: " << cache->GetMemoryUsage() << " bytes"
+                << std::endl;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0]
+              << " <model.afsm> [socket_path] [max_batch_size] [max_wait_us]"
+                 " [cache_mb]"
+              << std::endl;
+    return 1;
+  }
+  const std::string model_path = argv[1];
+  const std::string socket_path = argc > 2 ? argv[2] : "/tmp/afs_server.sock";
+  const size_t max_batch_size = argc > 3 ? std::stoul(argv[3]) : 32;
+  const long max_wait_us = argc > 4 ? std::stol(argv[4]) : 2000;
+  const size_t cache_mb = argc > 5 ? std::stoul(argv[5]) : 0;
+
+  InferenceModel model;
+  if (!model.Load(model_path)) return 1;
+  std::cout << "Loaded " << model_path << ": " << model.NumLayers()
+            << " layers, input " << model.GetInputHeight() << "x"
+            << model.GetInputWidth() << "x" << model.GetInputDepth()
+            << ", output " << model.GetOutputSize() << std::endl;
+
+  // Clients closing their connection must not kill the server.
+  std::signal(SIGPIPE, SIG_IGN);
+
+  int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server_fd < 0) {
+    std::cerr << "Error creating socket" << std::endl;
+    return 1;
+  }
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path too long: " << socket_path << std::endl;
+    return 1;
+  }
+  std::strcpy(address.sun_path, socket_path.c_str());
+  unlink(socket_path.c_str());
+  if (bind(server_fd, (sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(server_fd, 128) != 0) {
+    std::cerr << "Error listening on " << socket_path << std::endl;
+    return 1;
+  }
+
+  std::unique_ptr<InferenceCache> cache;
+  if (cache_mb > 0) cache.reset(new InferenceCache(cache_mb << 20));
+
+  DynamicBatcher batcher(model, max_batch_size, max_wait_us, cache.get());
+  std::thread(ReportStats, std::ref(batcher), cache.get()).detach();
+
+  std::cout << "Listening on " << socket_path << " (max batch size "
+            << max_batch_size << ", max wait " << max_wait_us << " us)"
+            << std::endl;
+  ConnectionLimit limit(kMaxConnections);
+  while (true) {
+    limit.Acquire();
+    int client_fd = accept(server_fd, nullptr, nullptr);
+    if (client_fd < 0) {
+      limit.Release();
+      continue;
+    }
+    std::thread(ServeConnection, client_fd, std::ref(batcher),
+                std::cref(model), std::ref(limit))
+        .detach();
+  }
+}